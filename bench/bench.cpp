@@ -0,0 +1,332 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "utils.h"
+#include "tile.h"
+#include "tilemap.h"
+
+// Runs f repeatedly for at least BENCH_SECONDS and returns how many times per second it ran
+#define BENCH_SECONDS 0.5
+
+template<typename F>
+static double runs_per_second(F f) {
+	typedef std::chrono::steady_clock Clock;
+	size_t runs = 0;
+	Clock::time_point start = Clock::now();
+	double elapsed = 0.0;
+	do {
+		f();
+		runs++;
+		elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+	} while (elapsed < BENCH_SECONDS);
+	return (double)runs / elapsed;
+}
+
+// Keeps results alive so the compiler cannot drop the work that made them
+static volatile size_t bench_sink;
+
+// Tile comparison
+
+#define BENCH_TILES 1024
+#define BENCH_CANDIDATES 16
+
+typedef Fl_Color Bench_Tile[NUM_TILE_PIXELS];
+
+// are_identical_tiles before the kernels: whole colors compared pixel by pixel, each flip in turn
+static bool scalar_identical_tiles(const Bench_Tile &t1, const Bench_Tile &t2, bool &x_flip, bool &y_flip) {
+	for (int i = 0; i < NUM_TILE_PIXELS; i++) {
+		if (t1[i] != t2[i]) {
+			goto not_identical;
+		}
+	}
+	return true;
+not_identical:
+	for (int y = 0; y < TILE_SIZE; y++) {
+		for (int x = 0; x < TILE_SIZE; x++) {
+			if (t1[y*TILE_SIZE+x] != t2[y*TILE_SIZE+TILE_SIZE-x-1]) {
+				goto not_x_flipped;
+			}
+		}
+	}
+	x_flip = true;
+	return true;
+not_x_flipped:
+	for (int y = 0; y < TILE_SIZE; y++) {
+		for (int x = 0; x < TILE_SIZE; x++) {
+			if (t1[y*TILE_SIZE+x] != t2[(TILE_SIZE-y-1)*TILE_SIZE+x]) {
+				goto not_y_flipped;
+			}
+		}
+	}
+	y_flip = true;
+	return true;
+not_y_flipped:
+	for (int y = 0; y < TILE_SIZE; y++) {
+		for (int x = 0; x < TILE_SIZE; x++) {
+			if (t1[y*TILE_SIZE+x] != t2[(TILE_SIZE-y-1)*TILE_SIZE+TILE_SIZE-x-1]) {
+				return false;
+			}
+		}
+	}
+	x_flip = y_flip = true;
+	return true;
+}
+
+static void flip_bench_tile(const uchar *src, uchar *dst, bool x_flip, bool y_flip) {
+	for (int y = 0; y < TILE_SIZE; y++) {
+		int sy = y_flip ? TILE_SIZE - y - 1 : y;
+		for (int x = 0; x < TILE_SIZE; x++) {
+			int sx = x_flip ? TILE_SIZE - x - 1 : x;
+			dst[y*TILE_SIZE+x] = src[sy*TILE_SIZE+sx];
+		}
+	}
+}
+
+static void bench_tile_compare() {
+	// Tiles of a few colors, as in real graphics; some candidates are copies or flips of the tile
+	// and the rest differ from it only in their last pixel, so no comparison can stop early
+	static const Fl_Color colors[4] = {0xFFFFFF00, 0xA0A0A000, 0x50505000, 0x00000000};
+	std::mt19937 rng(1);
+	std::vector<uchar> tiles(BENCH_TILES * NUM_TILE_PIXELS);
+	std::vector<uchar> candidates(BENCH_TILES * BENCH_CANDIDATES * NUM_TILE_PIXELS);
+	for (size_t t = 0; t < BENCH_TILES; t++) {
+		uchar *tile = &tiles[t * NUM_TILE_PIXELS];
+		for (int i = 0; i < NUM_TILE_PIXELS; i++) {
+			tile[i] = (uchar)(rng() % 4);
+		}
+		for (size_t c = 0; c < BENCH_CANDIDATES; c++) {
+			uchar *candidate = &candidates[(t * BENCH_CANDIDATES + c) * NUM_TILE_PIXELS];
+			unsigned int kind = rng() % 8;
+			flip_bench_tile(tile, candidate, kind & 1, kind & 2);
+			if (kind >= 4) {
+				candidate[NUM_TILE_PIXELS - 1] ^= 1;
+			}
+		}
+	}
+	std::vector<Bench_Tile> tile_colors(BENCH_TILES), candidate_colors(BENCH_TILES * BENCH_CANDIDATES);
+	for (size_t i = 0; i < tiles.size(); i++) {
+		tile_colors[i / NUM_TILE_PIXELS][i % NUM_TILE_PIXELS] = colors[tiles[i]];
+	}
+	for (size_t i = 0; i < candidates.size(); i++) {
+		candidate_colors[i / NUM_TILE_PIXELS][i % NUM_TILE_PIXELS] = colors[candidates[i]];
+	}
+
+	const double compares = (double)(BENCH_TILES * BENCH_CANDIDATES);
+	printf("Tile comparisons with flips (%d tiles x %d candidates):\n", BENCH_TILES, BENCH_CANDIDATES);
+
+	size_t expected = 0;
+	double rate = runs_per_second([&]() {
+		size_t matches = 0;
+		for (size_t t = 0; t < BENCH_TILES; t++) {
+			for (size_t c = 0; c < BENCH_CANDIDATES; c++) {
+				bool x_flip = false, y_flip = false;
+				matches += scalar_identical_tiles(tile_colors[t], candidate_colors[t * BENCH_CANDIDATES + c],
+					x_flip, y_flip);
+			}
+		}
+		bench_sink = expected = matches;
+	}) * compares;
+	printf("  %-10s %8.1f M compares/s\n", "scalar", rate / 1e6);
+
+	// As in build_tilemap, each tile's flipped forms are made once and compared with every candidate
+	for (const Tile_Compare_Kernel &kernel : tile_compare_kernels()) {
+		size_t matches = 0;
+		rate = runs_per_second([&]() {
+			matches = 0;
+			uchar forms[4][NUM_TILE_PIXELS];
+			for (size_t t = 0; t < BENCH_TILES; t++) {
+				const uchar *tile = &tiles[t * NUM_TILE_PIXELS];
+				for (int f = 0; f < 4; f++) {
+					flip_bench_tile(tile, forms[f], f & 1, f & 2);
+				}
+				for (size_t c = 0; c < BENCH_CANDIDATES; c++) {
+					const uchar *candidate = &candidates[(t * BENCH_CANDIDATES + c) * NUM_TILE_PIXELS];
+					for (int f = 0; f < 4; f++) {
+						if (kernel.equal(forms[f], candidate, NUM_TILE_PIXELS)) {
+							matches++;
+							break;
+						}
+					}
+				}
+			}
+			bench_sink = matches;
+		}) * compares;
+		printf("  %-10s %8.1f M compares/s%s\n", kernel.name, rate / 1e6,
+			matches == expected ? "" : " (MISMATCH)");
+	}
+}
+
+// ASM tilemap import
+
+#define BENCH_ASM_BYTES (4 * 1024 * 1024)
+
+static uchar regex_asm_number(const std::string &data, size_t &i) {
+	uchar v = 0;
+	size_t len = data.length();
+	char c = data[i];
+	if (c == '#') {
+		if (++i == len) { return v; }
+		c = data[i];
+	}
+	if (c == '$') {
+		while (++i < len) {
+			c = data[i];
+			if (!isxdigit(c)) { break; }
+			v = v * 16 + (uchar)(c - (c < 'A' ? '0' : c < 'a' ? 'A' - 0xA : 'a' - 0xA));
+		}
+	}
+	else if (c == '&') {
+		while (++i < len) {
+			c = data[i];
+			if (!isdigit(c) || c == '8' || c == '9') { break; }
+			v = v * 8 + (uchar)(c - '0');
+		}
+	}
+	else if (c == '%') {
+		while (++i < len) {
+			c = data[i];
+			if (c != '0' && c != '1') { break; }
+			v = v * 2 + (uchar)(c - '0');
+		}
+	}
+	else if (isdigit(c)) {
+		do {
+			v = v * 10 + (uchar)(c - '0');
+			if (++i == len) { break; }
+			c = data[i];
+		} while (isdigit(c));
+	}
+	return v;
+}
+
+// The ASM importer before the hand-written lexer: a std::regex match on each line read with std::getline
+static bool regex_import_asm_tiles(const char *f, std::vector<uchar> &bytes) {
+	std::ifstream ifs(f);
+	std::regex rx(
+		"^"
+		R"([ \t]*)" // space
+		R"((?:[A-Za-z0-9_\.@#\$]*(?:\b|[ \t:]+))?)" // label (alphanumeric or . @ # $ followed by colons)
+		R"((?:\.?(?:[Dd][Bb]|[Bb][Yy][Tt][Ee]?)\b([^;]*))?)" // db (rgbasm), .db (wla-dx), .byte or .byt (ca65)
+		R"((?:;.*)?)" // ; comment
+		"$"
+	);
+	while (ifs.good()) {
+		std::string line;
+		std::getline(ifs, line);
+		std::smatch sm;
+		std::regex_match(line, sm, rx);
+		size_t n = sm.size();
+		if (n != 2) { return false; }
+		const std::string &data = sm[1];
+		bool got_number = false;
+		size_t len = data.length();
+		for (size_t i = 0; i < len; i++) {
+			char c = data[i];
+			if ((isdigit(c) || c == '$' || c == '&' || c == '%' || c == '#') && !got_number) {
+				uchar v = regex_asm_number(data, i);
+				i--;
+				bytes.push_back(v);
+				got_number = true;
+				continue;
+			}
+			else if (c == ',') {
+				if (got_number) {
+					got_number = false;
+				}
+				else {
+					bytes.push_back(0);
+				}
+			}
+			else if (!isspace(c)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static void bench_asm_import() {
+	// Labeled blocks of db and .byte rows in the number styles the importer reads, with comments
+	std::string path = (std::filesystem::temp_directory_path() / "tilemapstudio-bench.asm").string();
+	FILE *file = fopen(path.c_str(), "wb");
+	if (!file) {
+		fprintf(stderr, "Cannot write %s\n", path.c_str());
+		return;
+	}
+	std::mt19937 rng(1);
+	size_t size = 0, values = 0;
+	for (int row = 0; size < BENCH_ASM_BYTES; row++) {
+		char line[256];
+		int n = 0;
+		if (row % 32 == 0) {
+			n = snprintf(line, sizeof(line), "Tilemap%d::\n", row / 32);
+			fwrite(line, 1, (size_t)n, file);
+			size += (size_t)n;
+		}
+		n = snprintf(line, sizeof(line), row % 2 ? "\t.byte " : "\tdb ");
+		for (int i = 0; i < 16; i++) {
+			unsigned int v = rng() % 256;
+			const char *sep = i ? ", " : "";
+			switch (rng() % 4) {
+			case 0: n += snprintf(line + n, sizeof(line) - n, "%s$%02x", sep, v); break;
+			case 1: n += snprintf(line + n, sizeof(line) - n, "%s%u", sep, v); break;
+			case 2: n += snprintf(line + n, sizeof(line) - n, "%s&%o", sep, v); break;
+			default: n += snprintf(line + n, sizeof(line) - n, "%s%%%d%d%d%d", sep, v & 8 ? 1 : 0, v & 4 ? 1 : 0,
+				v & 2 ? 1 : 0, v & 1 ? 1 : 0);
+			}
+		}
+		n += snprintf(line + n, sizeof(line) - n, row % 8 ? "\n" : " ; row %d\n", row);
+		fwrite(line, 1, (size_t)n, file);
+		size += (size_t)n;
+		values += 16;
+	}
+	fclose(file);
+
+	const double mb = (double)size / (1024 * 1024);
+	printf("ASM tilemap import (%.1f MB, %zu values):\n", mb, values);
+
+	size_t count = 0;
+	double rate = runs_per_second([&]() {
+		std::vector<uchar> bytes;
+		regex_import_asm_tiles(path.c_str(), bytes);
+		bench_sink = count = bytes.size();
+	}) * mb;
+	printf("  %-10s %8.1f MB/s%s\n", "regex", rate, count == values ? "" : " (MISMATCH)");
+
+	Import_Options options = {};
+	rate = runs_per_second([&]() {
+		Tilemap tilemap;
+		tilemap.import_tiles(path.c_str(), NULL, options);
+		bench_sink = count = tilemap.size();
+	}) * mb;
+	printf("  %-10s %8.1f MB/s%s\n", "lexer", rate, count == values ? "" : " (MISMATCH)");
+
+	remove(path.c_str());
+}
+
+static const struct {
+	const char *name;
+	void (*run)(void);
+} benchmarks[] = {
+	{"tiles", bench_tile_compare},
+	{"asm", bench_asm_import},
+};
+
+int main(int argc, char **argv) {
+	for (const auto &b : benchmarks) {
+		bool selected = argc < 2;
+		for (int i = 1; i < argc; i++) {
+			selected = selected || !strcmp(argv[i], b.name);
+		}
+		if (selected) {
+			b.run();
+		}
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,344 @@
+#include <cstring>
+#include <cctype>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "version.h"
+#include "utils.h"
+#include "tilemap-format.h"
+#include "palette-format.h"
+#include "image-to-tiles.h"
+#include "cli.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#define TILESET_EXT ".tiles.png"
+
+static const char *format_names[] = {
+	"plain", "gbc", "gbc-attrmap", "gba-4bpp", "gba-8bpp", "nds-4bpp", "nds-8bpp", "sgb", "snes",
+	"rby-town-map", "gsc-town-map", "pc-town-map", "sw-town-map", "pokegear-card"
+};
+
+static const char *palette_format_names[] = {
+	"indexed", "png", "bmp", "rgb", "jasc", "act", "aco", "ase",
+	"col", "riff", "txt", "gpl", "xml", "json", "map", "hex"
+};
+
+static void print_usage(FILE *f) {
+	fputs("Usage: " PROGRAM_EXE_NAME " --image-to-tiles [options] image...\n"
+		"\n"
+		"Converts each image to a tilemap, a tileset (<name>" TILESET_EXT "), and a palette.\n"
+		"\n"
+		"Options:\n"
+		"  -f, --format FORMAT       tilemap format (default: plain); one of:\n"
+		"                            plain, gbc, gbc-attrmap, gba-4bpp, gba-8bpp, nds-4bpp,\n"
+		"                            nds-8bpp, sgb, snes, rby-town-map, gsc-town-map,\n"
+		"                            pc-town-map, sw-town-map, pokegear-card\n"
+		"  -s, --start-id HEX        first tile ID (default: 000)\n"
+		"  -b, --blank-id HEX        use this tile ID for blank spaces\n"
+		"  -z, --color-zero RRGGBB   use this color as color 0 of every palette\n"
+		"  -p, --palette FORMAT      palette format (default: indexed), or none; one of:\n"
+		"                            indexed, png, bmp, rgb, jasc, act, aco, ase, col,\n"
+		"                            riff, txt, gpl, xml, json, map, hex\n"
+		"  -i, --start-index HEX     first palette index (default: 0)\n"
+		"  -w, --tileset-width N     tiles per row of the tileset (default: 16)\n"
+		"  -n, --no-extra-blank-tiles\n"
+		"                            do not pad the tileset's last row with blank tiles\n"
+		"  -o, --output-dir DIR      write output files to DIR (default: beside each image)\n"
+		"  -j, --jobs N              convert up to N images at once (default: all cores)\n"
+		"  -h, --help                show this help\n", f);
+}
+
+static bool parse_hex(const char *s, unsigned long max, unsigned long &v) {
+	if (!s || !*s) { return false; }
+	char *end;
+	v = strtoul(s, &end, 16);
+	return !*end && v <= max;
+}
+
+static bool parse_dec(const char *s, unsigned long min, unsigned long max, unsigned long &v) {
+	if (!s || !*s) { return false; }
+	char *end;
+	v = strtoul(s, &end, 10);
+	return !*end && v >= min && v <= max;
+}
+
+static bool parse_name(const char *s, const char **names, size_t n, int &v) {
+	if (!s) { return false; }
+	for (size_t i = 0; i < n; i++) {
+		if (!strcmp(s, names[i])) {
+			v = (int)i;
+			return true;
+		}
+	}
+	unsigned long d;
+	if (parse_dec(s, 0, n - 1, d)) {
+		v = (int)d;
+		return true;
+	}
+	return false;
+}
+
+static bool is_rgb_color(const char *s) {
+	size_t n = s ? strlen(s) : 0;
+	return n > 0 && n <= 6 && strspn(s, "0123456789ABCDEFabcdef") == n;
+}
+
+static size_t dir_sep_index(const std::string &f) {
+#ifdef _WIN32
+	return f.find_last_of("/\\");
+#else
+	return f.find_last_of('/');
+#endif
+}
+
+struct Conversion {
+	std::string image, tileset, tilemap, attrmap, palette, tilepal, message;
+	bool success;
+};
+
+static void prepare_conversion(Conversion &c, const char *image, const char *output_dir, Tilemap_Format fmt,
+	Palette_Format pal_fmt) {
+	c.image = image;
+	c.success = false;
+	size_t sep = dir_sep_index(c.image);
+	std::string name = sep == std::string::npos ? c.image : c.image.substr(sep + 1);
+	if (size_t dot = name.find_last_of('.'); dot != std::string::npos && dot > 0) {
+		name.erase(dot);
+	}
+	std::string base;
+	if (output_dir) {
+		base = output_dir;
+		if (!base.empty() && dir_sep_index(base) != base.size() - 1) {
+			base += DIR_SEP;
+		}
+	}
+	else if (sep != std::string::npos) {
+		base = c.image.substr(0, sep + 1);
+	}
+	base += name;
+	c.tileset = base + TILESET_EXT;
+	c.tilemap = base + format_extension(fmt);
+	c.attrmap = base + ATTRMAP_EXT;
+	const char *palette_ext = palette_extension(pal_fmt);
+	c.palette = palette_ext ? base + palette_ext : c.tileset;
+	c.tilepal = base + TILEPAL_EXT;
+}
+
+// Paths that name the same file compare equal; Windows paths are case-insensitive
+static std::string output_key(const std::string &f) {
+	std::string key = f;
+#ifdef _WIN32
+	for (char &ch : key) {
+		ch = ch == '/' ? '\\' : (char)tolower((uchar)ch);
+	}
+#endif
+	return key;
+}
+
+// Conversions run concurrently, so two that write the same file would clobber each other
+static bool check_output_clashes(const std::vector<Conversion> &conversions) {
+	std::unordered_map<std::string, size_t> owners;
+	for (size_t i = 0; i < conversions.size(); i++) {
+		const Conversion &c = conversions[i];
+		for (const std::string *f : {&c.tileset, &c.tilemap, &c.attrmap, &c.palette, &c.tilepal}) {
+			auto [it, inserted] = owners.emplace(output_key(*f), i);
+			if (!inserted && it->second != i) {
+				fprintf(stderr, "%s: %s and %s would both write %s\n", PROGRAM_EXE_NAME,
+					conversions[it->second].image.c_str(), c.image.c_str(), f->c_str());
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static int run_image_to_tiles(int argc, char **argv, int argi) {
+	Image_to_Tiles_Options options = {};
+	options.fmt = Tilemap_Format::PLAIN;
+	options.make_palette = true;
+	options.palette_format = Palette_Format::INDEXED;
+	options.color_zero = parse_rgb_color("FF00FF");
+	options.blank_id = 0x07F;
+	options.tileset_width = 16;
+	const char *output_dir = NULL;
+	size_t jobs = 0;
+	std::vector<const char *> images;
+	// Where the options whose limits depend on the format are, to check once the format is known
+	int start_id_argi = 0, blank_id_argi = 0, start_index_argi = 0;
+
+	for (; argi < argc; argi++) {
+		const char *arg = argv[argi];
+		if (arg[0] != '-' || !arg[1]) {
+			images.push_back(arg);
+			continue;
+		}
+		if (!strcmp(arg, "--")) {
+			images.insert(images.end(), argv + argi + 1, argv + argc);
+			break;
+		}
+		if (!strcmp(arg, "-h") || !strcmp(arg, "--help")) {
+			print_usage(stdout);
+			return EXIT_SUCCESS;
+		}
+		if (!strcmp(arg, "-n") || !strcmp(arg, "--no-extra-blank-tiles")) {
+			options.no_extra_blank_tiles = true;
+			continue;
+		}
+		const char *value = argi + 1 < argc ? argv[argi + 1] : NULL;
+		bool valid;
+		unsigned long v = 0;
+		if (!strcmp(arg, "-f") || !strcmp(arg, "--format")) {
+			int i = 0;
+			valid = parse_name(value, format_names, _countof(format_names), i);
+			options.fmt = (Tilemap_Format)i;
+		}
+		else if (!strcmp(arg, "-s") || !strcmp(arg, "--start-id")) {
+			valid = parse_hex(value, 0xFFFF, v);
+			options.start_id = (uint16_t)v;
+			start_id_argi = argi;
+		}
+		else if (!strcmp(arg, "-b") || !strcmp(arg, "--blank-id")) {
+			valid = parse_hex(value, 0xFFFF, v);
+			options.use_blank = true;
+			options.blank_id = (uint16_t)v;
+			blank_id_argi = argi;
+		}
+		else if (!strcmp(arg, "-z") || !strcmp(arg, "--color-zero")) {
+			valid = is_rgb_color(value);
+			if (valid) {
+				options.use_color_zero = true;
+				options.color_zero = parse_rgb_color(value);
+			}
+		}
+		else if (!strcmp(arg, "-p") || !strcmp(arg, "--palette")) {
+			int i = 0;
+			if (value && !strcmp(value, "none")) {
+				valid = true;
+				options.make_palette = false;
+			}
+			else {
+				valid = parse_name(value, palette_format_names, _countof(palette_format_names), i);
+				options.make_palette = true;
+				options.palette_format = (Palette_Format)i;
+			}
+		}
+		else if (!strcmp(arg, "-i") || !strcmp(arg, "--start-index")) {
+			valid = parse_hex(value, 0xFF, v);
+			options.start_index = (uint8_t)v;
+			start_index_argi = argi;
+		}
+		else if (!strcmp(arg, "-w") || !strcmp(arg, "--tileset-width")) {
+			valid = parse_dec(value, 1, 1024, v);
+			options.tileset_width = (int)v;
+		}
+		else if (!strcmp(arg, "-o") || !strcmp(arg, "--output-dir")) {
+			valid = value && *value;
+			output_dir = value;
+		}
+		else if (!strcmp(arg, "-j") || !strcmp(arg, "--jobs")) {
+			valid = parse_dec(value, 1, 1024, v);
+			jobs = (size_t)v;
+		}
+		else {
+			fprintf(stderr, "%s: unknown option: %s\n", PROGRAM_EXE_NAME, arg);
+			print_usage(stderr);
+			return EXIT_FAILURE;
+		}
+		if (!valid) {
+			fprintf(stderr, "%s: invalid value for %s: %s\n", PROGRAM_EXE_NAME, arg, value ? value : "(none)");
+			return EXIT_FAILURE;
+		}
+		argi++;
+	}
+
+	// Tile IDs must fit the format's tileset, and the start index its palettes, as in the dialog
+	int max_id = format_tileset_size(options.fmt) - 1;
+	int max_index = format_palettes_size(options.fmt);
+	if (max_index == 1) {
+		max_index = format_palette_size(options.fmt);
+	}
+	max_index--;
+	for (auto [i, valid] : {
+		std::pair(start_id_argi, options.start_id <= max_id),
+		std::pair(blank_id_argi, options.blank_id <= max_id),
+		std::pair(start_index_argi, !format_can_make_palettes(options.fmt) || options.start_index <= max_index),
+	}) {
+		if (i && !valid) {
+			fprintf(stderr, "%s: invalid value for %s: %s\n", PROGRAM_EXE_NAME, argv[i], argv[i + 1]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (images.empty()) {
+		fprintf(stderr, "%s: no images to convert\n", PROGRAM_EXE_NAME);
+		print_usage(stderr);
+		return EXIT_FAILURE;
+	}
+
+	size_t n = images.size();
+	std::vector<Conversion> conversions(n);
+	for (size_t i = 0; i < n; i++) {
+		prepare_conversion(conversions[i], images[i], output_dir, options.fmt, options.palette_format);
+	}
+	if (!check_output_clashes(conversions)) {
+		return EXIT_FAILURE;
+	}
+
+	// Each image is independent, so convert contiguous runs of them on separate threads,
+	// sharing the cores between them instead of letting each read its image on all of them
+	size_t nw = jobs ? std::min(jobs, n) : num_workers(n, 1);
+	options.max_workers = nw > 1 ? std::max((size_t)std::thread::hardware_concurrency() / nw, (size_t)1) : 0;
+	parallel_for(nw, n, [&](size_t, size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			Conversion &c = conversions[i];
+			Image_to_Tiles_Options o = options;
+			o.image_filename = c.image.c_str();
+			o.tileset_filename = c.tileset.c_str();
+			o.tilemap_filename = c.tilemap.c_str();
+			o.attrmap_filename = c.attrmap.c_str();
+			o.palette_filename = c.palette.c_str();
+			o.tilepal_filename = c.tilepal.c_str();
+			size_t width;
+			c.success = image_to_tiles(o, c.message, width);
+		}
+	});
+
+	int status = EXIT_SUCCESS;
+	for (const Conversion &c : conversions) {
+		// Dialog messages span several lines; print each on one
+		std::string msg;
+		for (char ch : c.message) {
+			if (ch != '\n') { msg += ch; }
+			else if (!msg.empty() && msg.back() != ' ') { msg += ' '; }
+		}
+		if (c.success) {
+			printf("%s\n", msg.c_str());
+		}
+		else {
+			fprintf(stderr, "%s: %s\n", PROGRAM_EXE_NAME, msg.c_str());
+			status = EXIT_FAILURE;
+		}
+	}
+	return status;
+}
+
+bool run_command_line(int argc, char **argv, int &status) {
+	if (argc < 2 || strcmp(argv[1], "--image-to-tiles")) {
+		return false;
+	}
+#ifdef _WIN32
+	// The GUI subsystem has no console, so write to the one that launched us, if any
+	if (AttachConsole(ATTACH_PARENT_PROCESS)) {
+		FILE *f;
+		freopen_s(&f, "CONOUT$", "w", stdout);
+		freopen_s(&f, "CONOUT$", "w", stderr);
+	}
+#endif
+	status = run_image_to_tiles(argc, argv, 2);
+	fflush(stdout);
+	return true;
+}
@@ -0,0 +1,8 @@
+#ifndef CLI_H
+#define CLI_H
+
+// Runs a headless command-line mode if the arguments ask for one,
+// setting its exit status; returns false to start the GUI instead
+bool run_command_line(int argc, char **argv, int &status);
+
+#endif
@@ -0,0 +1,162 @@
+#include <cstdarg>
+
+#pragma warning(push, 0)
+#include <FL/fl_utf8.h>
+#include <FL/filename.H>
+#pragma warning(pop)
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "file-sink.h"
+
+#define TEMP_FILE_EXT ".tmp"
+
+// Two-character digit pairs, so numbers are formatted two digits per lookup
+struct Digit_Pairs {
+	char hex[256][2];
+	char dec[100][2];
+	constexpr Digit_Pairs() : hex(), dec() {
+		const char digits[] = "0123456789abcdef";
+		for (int i = 0; i < 256; i++) {
+			hex[i][0] = digits[i >> 4];
+			hex[i][1] = digits[i & 0xF];
+		}
+		for (int i = 0; i < 100; i++) {
+			dec[i][0] = digits[i / 10];
+			dec[i][1] = digits[i % 10];
+		}
+	}
+};
+
+static constexpr Digit_Pairs digit_pairs;
+
+File_Sink::File_Sink() : _file(NULL), _filename(), _temp_filename(), _buffer(), _length(0), _ok(false),
+	_finished(false) {}
+
+File_Sink::~File_Sink() {
+	discard();
+}
+
+void File_Sink::print(const char *fmt, ...) {
+	va_list ap;
+	for (int pass = 0; pass < 2; pass++) {
+		size_t space = _buffer.size() - _length;
+		va_start(ap, fmt);
+		int n = vsnprintf(_buffer.data() + _length, space, fmt, ap);
+		va_end(ap);
+		if (n < 0) { _ok = false; return; }
+		if ((size_t)n < space) {
+			_length += (size_t)n;
+			return;
+		}
+		flush();
+	}
+	va_start(ap, fmt);
+	if (vfprintf(_file, fmt, ap) < 0) { _ok = false; }
+	va_end(ap);
+}
+
+void File_Sink::hex(unsigned int v, int digits) {
+	char s[4];
+	size_t n = 0;
+	if (digits > 2) {
+		memcpy(s, digit_pairs.hex[(v >> 8) & 0xFF], 2);
+		n = 2;
+	}
+	memcpy(s + n, digit_pairs.hex[v & 0xFF], 2);
+	write(s, n + 2);
+}
+
+void File_Sink::dec(unsigned int v) {
+	char s[10];
+	char *p = s + sizeof(s);
+	for (; v >= 100; v /= 100) {
+		p -= 2;
+		memcpy(p, digit_pairs.dec[v % 100], 2);
+	}
+	if (v >= 10) {
+		p -= 2;
+		memcpy(p, digit_pairs.dec[v], 2);
+	}
+	else {
+		*--p = (char)('0' + v);
+	}
+	write(p, (size_t)(s + sizeof(s) - p));
+}
+
+bool File_Sink::open(const char *f) {
+	discard();
+	_filename = f;
+	_temp_filename = _filename + TEMP_FILE_EXT;
+	_file = fl_fopen(_temp_filename.c_str(), "wb");
+	if (!_file) { return false; }
+	_buffer.resize(FILE_SINK_BUFFER_SIZE);
+	_length = 0;
+	_ok = true;
+	return true;
+}
+
+static bool replace_file(const char *from, const char *to) {
+#ifdef _WIN32
+	wchar_t wfrom[FL_PATH_MAX] = {}, wto[FL_PATH_MAX] = {};
+	fl_utf8towc(from, (unsigned)strlen(from), wfrom, _countof(wfrom));
+	fl_utf8towc(to, (unsigned)strlen(to), wto, _countof(wto));
+	return !!MoveFileExW(wfrom, wto, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+	return !fl_rename(from, to);
+#endif
+}
+
+bool File_Sink::finish() {
+	if (!_file) { return _finished; }
+	flush();
+	bool ok = _ok && !fflush(_file) && !ferror(_file);
+	ok = !fclose(_file) && ok;
+	_file = NULL;
+	if (!ok) {
+		fl_unlink(_temp_filename.c_str());
+	}
+	std::vector<char>().swap(_buffer);
+	_length = 0;
+	_ok = false;
+	_finished = ok;
+	return ok;
+}
+
+bool File_Sink::commit() {
+	if (!finish()) { return false; }
+	_finished = false;
+	bool ok = replace_file(_temp_filename.c_str(), _filename.c_str());
+	if (!ok) {
+		fl_unlink(_temp_filename.c_str());
+	}
+	return ok;
+}
+
+void File_Sink::discard() {
+	if (_file) {
+		fclose(_file);
+		_file = NULL;
+		fl_unlink(_temp_filename.c_str());
+	}
+	else if (_finished) {
+		fl_unlink(_temp_filename.c_str());
+	}
+	std::vector<char>().swap(_buffer);
+	_length = 0;
+	_ok = false;
+	_finished = false;
+}
+
+void File_Sink::flush() {
+	if (_length) {
+		write_through(_buffer.data(), _length);
+		_length = 0;
+	}
+}
+
+void File_Sink::write_through(const void *data, size_t n) {
+	if (fwrite(data, 1, n, _file) != n) { _ok = false; }
+}
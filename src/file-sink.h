@@ -0,0 +1,56 @@
+#ifndef FILE_SINK_H
+#define FILE_SINK_H
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "utils.h"
+
+#define FILE_SINK_BUFFER_SIZE (64 * 1024)
+
+// A buffered output file that is written under a temporary name and only
+// replaces the destination when committed, so a failed save never clobbers it
+class File_Sink {
+private:
+	FILE *_file;
+	std::string _filename, _temp_filename;
+	std::vector<char> _buffer;
+	size_t _length;
+	// Whether the temporary file is complete and closed, waiting to be committed
+	bool _ok, _finished;
+public:
+	File_Sink();
+	~File_Sink();
+	File_Sink(const File_Sink &) = delete;
+	File_Sink &operator=(const File_Sink &) = delete;
+	inline bool ok(void) const { return _file && _ok; }
+	inline void write(const void *data, size_t n) {
+		if (_length + n > _buffer.size()) {
+			flush();
+			if (n >= _buffer.size()) { write_through(data, n); return; }
+		}
+		memcpy(_buffer.data() + _length, data, n);
+		_length += n;
+	}
+	inline void put(char c) {
+		if (_length == _buffer.size()) { flush(); }
+		_buffer[_length++] = c;
+	}
+	inline void text(const char *s) { write(s, strlen(s)); }
+	void print(const char *fmt, ...);
+	// Lowercase hex with 2 or 4 digits, from a table of digit pairs
+	void hex(unsigned int v, int digits);
+	void dec(unsigned int v);
+	bool open(const char *f);
+	// Writes out and closes the temporary file, so committing only has to rename it
+	bool finish(void);
+	bool commit(void);
+	void discard(void);
+private:
+	void flush(void);
+	void write_through(const void *data, size_t n);
+};
+
+#endif
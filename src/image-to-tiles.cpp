@@ -1,15 +1,14 @@
 #include <string>
 #include <vector>
-#include <set>
-#include <map>
+#include <unordered_map>
 #include <iterator>
+#include <cstring>
 
 #pragma warning(push, 0)
 #include <FL/Fl.H>
 #include <FL/Fl_PNG_Image.H>
 #include <FL/Fl_GIF_Image.H>
 #include <FL/Fl_BMP_Image.H>
-#include <FL/Fl_Image_Surface.H>
 #pragma warning(pop)
 
 #include "utils.h"
@@ -18,6 +17,7 @@
 #include "tilemap.h"
 #include "tileset.h"
 #include "tile.h"
+#include "image-to-tiles.h"
 #include "main-window.h"
 
 // Avoid "warning C4458: declaration of 'i' hides class member"
@@ -25,32 +25,126 @@
 #pragma warning(push)
 #pragma warning(disable : 4458)
 
-typedef std::set<Fl_Color> Color_Set;
+// A set of indexes into the colors an image's tiles use, one bit each
+class Color_Set {
+private:
+	std::vector<uint64_t> _words;
+	size_t _count;
+public:
+	inline Color_Set(size_t nc) : _words((nc + 63) / 64), _count(0) {}
+	inline size_t size(void) const { return _count; }
+	inline void clear(void) { std::fill(RANGE(_words), 0); _count = 0; }
+	inline bool operator==(const Color_Set &c) const { return _count == c._count && _words == c._words; }
+	inline bool operator!=(const Color_Set &c) const { return !(*this == c); }
+	inline bool has(size_t ci) const { return (_words[ci / 64] >> (ci % 64)) & 1; }
+	inline void insert(size_t ci) {
+		uint64_t &w = _words[ci / 64], bit = (uint64_t)1 << (ci % 64);
+		_count += !(w & bit);
+		w |= bit;
+	}
+	void insert(const Color_Set &c);
+	bool includes(const Color_Set &c) const;
+	size_t union_size(const Color_Set &c) const;
+	size_t hash(void) const;
+	template<typename F> void for_each(F f) const;
+};
+
+static inline size_t popcount64(uint64_t w) {
+#if defined(__GNUC__)
+	return (size_t)__builtin_popcountll(w);
+#else
+	w = w - ((w >> 1) & 0x5555555555555555ULL);
+	w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+	w = (w + (w >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return (size_t)((w * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+void Color_Set::insert(const Color_Set &c) {
+	size_t count = 0;
+	for (size_t i = 0; i < _words.size(); i++) {
+		_words[i] |= c._words[i];
+		count += popcount64(_words[i]);
+	}
+	_count = count;
+}
+
+bool Color_Set::includes(const Color_Set &c) const {
+	if (c._count > _count) { return false; }
+	for (size_t i = 0; i < _words.size(); i++) {
+		if (c._words[i] & ~_words[i]) { return false; }
+	}
+	return true;
+}
+
+size_t Color_Set::union_size(const Color_Set &c) const {
+	size_t count = 0;
+	for (size_t i = 0; i < _words.size(); i++) {
+		count += popcount64(_words[i] | c._words[i]);
+	}
+	return count;
+}
+
+size_t Color_Set::hash(void) const {
+	uint64_t h = 0xCBF29CE484222325ULL; // FNV-1a over the words
+	for (uint64_t w : _words) {
+		h = (h ^ w) * 0x100000001B3ULL;
+	}
+	return (size_t)h;
+}
 
-static bool build_tilemap(const Tile *tiles, size_t n, const std::vector<int> tile_palettes, Tilemap &tilemap,
+// Calls f(ci) for each index in ascending order
+template<typename F>
+void Color_Set::for_each(F f) const {
+	for (size_t i = 0; i < _words.size(); i++) {
+		for (uint64_t w = _words[i]; w; w &= w - 1) {
+#if defined(__GNUC__)
+			size_t b = (size_t)__builtin_ctzll(w);
+#else
+			size_t b = popcount64((w & (~w + 1)) - 1);
+#endif
+			f(i * 64 + b);
+		}
+	}
+}
+
+struct Color_Set_Hash {
+	inline size_t operator()(const Color_Set &c) const { return c.hash(); }
+};
+
+static bool build_tilemap(const Image_Tiles &tiles, size_t n, const std::vector<int> tile_palettes, Tilemap &tilemap,
 	std::vector<size_t> &tileset, Tilemap_Format fmt, uint16_t start_id, bool use_blank, uint16_t blank_id, Fl_Color blank_color) {
 	size_t mn = (size_t)format_tileset_size(fmt);
 	tilemap.resize(n, 1, 0, 0);
 	tileset.reserve(mn);
+	// Index the tileset by canonical hash, so each tile is only compared with likely matches;
+	// each bucket lists tileset positions in ascending order, preserving first-match results
+	std::unordered_map<uint64_t, std::vector<size_t>> tileset_index;
+	tileset_index.reserve(mn);
+	Tile_Orientations orientations;
 	size_t tc = 0;
 	for (size_t i = 0; i < n; i++) {
 		if (use_blank && start_id + tileset.size() == blank_id) {
 			size_t j = 0;
 			for (; j < n; j++) {
-				if (is_blank_tile(tiles[j], blank_color)) { break; }
+				if (tiles.is_blank_tile(j, blank_color)) { break; }
 			}
+			tileset_index[tiles.canonical_tile_hash(j, fmt)].push_back(tileset.size());
 			tileset.push_back(j);
 		}
-		const Tile &tile = tiles[i];
-		if (use_blank && is_blank_tile(tile, blank_color)) {
-			tilemap.tile(tc++, 0, new Tile_Tessera(0, 0, 0, 0, blank_id, false, false, false, false, tile_palettes[i]));
+		if (use_blank && tiles.is_blank_tile(i, blank_color)) {
+			tilemap.tile(tc++, 0, Tile_State(blank_id, false, false, false, false, tile_palettes[i]));
 			continue;
 		}
-		size_t ti = 0, nt = tileset.size();
+		size_t nt = tileset.size(), ti = nt;
 		bool x_flip = false, y_flip = false;
-		for (; ti < nt; ti++) {
-			size_t j = tileset[ti];
-			if (are_identical_tiles(tile, tiles[j], fmt, x_flip, y_flip)) {
+		std::vector<size_t> &candidates = tileset_index[tiles.canonical_tile_hash(i, fmt)];
+		if (!candidates.empty()) {
+			tiles.tile_orientations(i, fmt, orientations);
+		}
+		for (size_t tj : candidates) {
+			if (tiles.matches_tile(orientations, tileset[tj], x_flip, y_flip)) {
+				ti = tj;
 				break;
 			}
 		}
@@ -58,10 +152,11 @@ static bool build_tilemap(const Tile *tiles, size_t n, const std::vector<int> ti
 			if (nt + (size_t)start_id > mn) {
 				return false;
 			}
+			candidates.push_back(nt);
 			tileset.push_back(i);
 		}
 		uint16_t id = start_id + (uint16_t)ti;
-		tilemap.tile(tc++, 0, new Tile_Tessera(0, 0, 0, 0, id, x_flip, y_flip, false, false, tile_palettes[i]));
+		tilemap.tile(tc++, 0, Tile_State(id, x_flip, y_flip, false, false, tile_palettes[i]));
 	}
 	tilemap.resize(tc, 1, 0, 0);
 	return true;
@@ -79,54 +174,91 @@ static int fit_width(int nt, int dw) {
 	return w;
 }
 
-static Fl_RGB_Image *print_tileset(const Tile *tiles, const std::vector<size_t> &tileset, const Palettes &palettes,
-	const std::vector<int> &tile_palettes, size_t nc, int tw, Fl_Color blank_color, bool indexed, uint8_t start_index) {
+static inline uchar color_red(Fl_Color c) { return (uchar)(c >> 24); }
+static inline uchar color_green(Fl_Color c) { return (uchar)(c >> 16); }
+static inline uchar color_blue(Fl_Color c) { return (uchar)(c >> 8); }
+
+// Draws the tileset straight into a pixel buffer: one gray byte per pixel (the palette index or
+// its grayscale shade) if gray, or three RGB bytes otherwise, matching what Image::write_image reads
+static Fl_RGB_Image *print_tileset(const Image_Tiles &tiles, const std::vector<size_t> &tileset, const Palettes &palettes,
+	const std::vector<int> &tile_palettes, size_t nc, int tw, Fl_Color blank_color, bool indexed, bool gray,
+	uint8_t start_index) {
 	int nt = (int)tileset.size();
 	tw = std::min(nt, tw);
 	int th = (nt + tw - 1) / tw;
 
-	size_t np = palettes.size();
-	std::vector<std::map<Fl_Color, size_t>> reverse_palettes;
-	reverse_palettes.reserve(np);
-	for (const Palette &palette : palettes) {
-		std::map<Fl_Color, size_t> reverse_palette;
-		for (size_t i = 0; i < nc; i++) {
-			reverse_palette.emplace(palette[i], i);
+	// Map each of the image's colors to its first index in each palette, or 0 if it is missing
+	size_t np = palettes.size(), ni = tiles.num_colors();
+	std::vector<size_t> reverse_palettes(np * ni, 0);
+	for (size_t p = 0; p < np; p++) {
+		size_t *reverse_palette = reverse_palettes.data() + p * ni;
+		for (size_t i = nc; i-- > 0;) {
+			if (size_t ci = tiles.find_color(palettes[p][i]); ci < ni) {
+				reverse_palette[ci] = i;
+			}
 		}
-		reverse_palettes.push_back(reverse_palette);
 	}
 
-	Fl_Image_Surface *surface = new Fl_Image_Surface(tw * TILE_SIZE, th * TILE_SIZE);
-	surface->set_current();
-
+	// Precompute the output shade of every palette index
 	size_t ntp = tile_palettes.size();
 	size_t ps = indexed ? MAX_PALETTE_LENGTH : nc;
-	Fl_Color extra = indexed ? Image::get_indexed_grayscale(start_index * nc, ps) : blank_color;
-	fl_rectf(0, 0, tw * TILE_SIZE, th * TILE_SIZE, extra);
+	size_t offset = indexed ? start_index * nc : 0;
+	std::vector<uchar> shades(nc);
+	for (size_t i = 0; i < nc; i++) {
+		shades[i] = color_red(Image::get_indexed_grayscale(i + offset, ps));
+	}
+
+	int d = gray ? 1 : NUM_CHANNELS;
+	size_t iw = (size_t)tw * TILE_SIZE, ih = (size_t)th * TILE_SIZE, ld = iw * d;
+	uchar *bytes = new uchar[ld * ih];
+	Fl_Color extra = indexed ? Image::get_indexed_grayscale(offset, ps) : blank_color;
+	if (gray) {
+		memset(bytes, color_red(extra), ld * ih);
+	}
+	else {
+		for (size_t i = 0; i < iw * ih; i++) {
+			bytes[i * 3 + 0] = color_red(extra);
+			bytes[i * 3 + 1] = color_green(extra);
+			bytes[i * 3 + 2] = color_blue(extra);
+		}
+	}
+
 	for (int i = 0; i < nt; i++) {
 		size_t ti = tileset[i];
-		const Tile &tile = tiles[ti];
 		int p = ti < ntp ? tile_palettes[ti] : -1;
 		if (p == -1 && indexed) { continue; }
-		int x = i % tw, y = i / tw;
+		const size_t *reverse_palette = p > -1 ? reverse_palettes.data() + (np == 1 ? p - start_index : p) * ni : NULL;
+		size_t x = (size_t)(i % tw), y = (size_t)(i / tw);
 		for (int ty = 0; ty < TILE_SIZE; ty++) {
+			uchar *row = bytes + (y * TILE_SIZE + ty) * ld + x * TILE_SIZE * d;
 			for (int tx = 0; tx < TILE_SIZE; tx++) {
-				Fl_Color c = tile[ty * TILE_SIZE + tx];
-				if (p > -1) {
-					size_t pi = reverse_palettes[np == 1 ? p - start_index : p][c];
-					if (indexed) { pi += start_index * nc; }
-					c = Image::get_indexed_grayscale(pi, ps);
+				int tp = ty * TILE_SIZE + tx;
+				if (reverse_palette) {
+					uchar v = shades[reverse_palette[tiles.index(ti, tp)]];
+					if (gray) {
+						row[tx] = v;
+					}
+					else {
+						row[tx * 3 + 0] = row[tx * 3 + 1] = row[tx * 3 + 2] = v;
+					}
+				}
+				else {
+					Fl_Color c = tiles.pixel(ti, tp);
+					if (gray) {
+						row[tx] = color_red(c);
+					}
+					else {
+						row[tx * 3 + 0] = color_red(c);
+						row[tx * 3 + 1] = color_green(c);
+						row[tx * 3 + 2] = color_blue(c);
+					}
 				}
-				fl_color(c);
-				fl_point(x * TILE_SIZE + tx, y * TILE_SIZE + ty);
 			}
 		}
 	}
 
-	Fl_RGB_Image *img = surface->image();
-	delete surface;
-	Fl_Display_Device::display_device()->set_current();
-
+	Fl_RGB_Image *img = new Fl_RGB_Image(bytes, (int)iw, (int)ih, d);
+	img->alloc_array = 1;
 	return img;
 }
 
@@ -136,12 +268,10 @@ static double luminance(Fl_Color c) {
 	return 0.299 * (double)r + 0.587 * (double)g + 0.114 * (double)b;
 }
 
-Image_to_Tiles_Result Main_Window::image_to_tiles() {
-	Image_to_Tiles_Result output = {};
-
+bool image_to_tiles(const Image_to_Tiles_Options &options, std::string &message, size_t &width) {
 	// Open the input image
 
-	const char *image_filename = _image_to_tiles_dialog->image_filename();
+	const char *image_filename = options.image_filename;
 	const char *image_basename = fl_filename_name(image_filename);
 
 	Fl_RGB_Image *img = NULL;
@@ -161,42 +291,40 @@ Image_to_Tiles_Result Main_Window::image_to_tiles() {
 		delete img;
 		std::string msg = "Could not convert ";
 		msg = msg + image_basename + "!\n\nCannot open file.";
-		_error_dialog->message(msg);
-		_error_dialog->show(this);
-		return output;
+		message = msg;
+		return false;
 	}
 
 	// Read the input image tiles
 
-	Tilemap_Format fmt = _image_to_tiles_dialog->format();
+	Tilemap_Format fmt = options.fmt;
 	bool alt_norm = fmt == Tilemap_Format::NDS_4BPP || fmt == Tilemap_Format::NDS_8BPP; // Tinke expects 5-bit clean channels
 
-	bool use_color_zero = _image_to_tiles_dialog->color_zero();
-	Fl_Color color_zero = use_color_zero ? _image_to_tiles_dialog->fl_color_zero() : 0xFFFFFF00 /* white */;
+	bool use_color_zero = options.use_color_zero;
+	Fl_Color color_zero = use_color_zero ? options.color_zero : 0xFFFFFF00 /* white */;
 	if (alt_norm) { color_zero &= ALT_NORM_MASK; }
 
-	size_t n = 0, w = 0;
-	Tile *tiles = get_image_tiles(img, n, w, alt_norm, color_zero);
+	Image_Tiles tiles;
+	bool read = tiles.read_tiles(img, alt_norm, color_zero, options.max_workers);
 	delete img;
-	if (!tiles || !n) {
-		delete [] tiles;
+	size_t n = tiles.size(), w = tiles.width();
+	if (!read || !n) {
 		std::string msg = "Could not convert ";
 		msg = msg + image_basename + "!\n\nImage dimensions do not fit the "
 			STRINGIFY(TILE_SIZE) "x" STRINGIFY(TILE_SIZE) " tile grid.";
-		_error_dialog->message(msg);
-		_error_dialog->show(this);
-		return output;
+		message = msg;
+		return false;
 	}
 
 	// Build the palette
 
-	Palette_Format pal_fmt = _image_to_tiles_dialog->palette_format();
-	bool make_palette = _image_to_tiles_dialog->palette() && format_can_make_palettes(fmt);
+	Palette_Format pal_fmt = options.palette_format;
+	bool make_palette = options.make_palette && format_can_make_palettes(fmt);
 
 	Palettes palettes;
 	std::vector<int> tile_palettes(n + 1, make_palette ? 0 : -1);
 	size_t max_colors = (size_t)format_palette_size(fmt);
-	uint8_t start_index = _image_to_tiles_dialog->start_index();
+	uint8_t start_index = options.start_index;
 
 	if (make_palette) {
 		// Algorithm ported from superfamiconv
@@ -204,53 +332,80 @@ Image_to_Tiles_Result Main_Window::image_to_tiles() {
 
 		size_t max_palettes = (size_t)format_palettes_size(fmt);
 
-		// Get the color set of each tile
-		std::vector<Color_Set> cs_tiles;
-		cs_tiles.reserve(n);
+		// Count each tile's colors, marking each color with the last tile that used it
+		size_t nc = tiles.num_colors();
+		std::vector<size_t> last_use(nc, n);
+		size_t ci_zero = tiles.find_color(color_zero);
 		size_t qi = 0;
 		for (; qi < n; qi++) {
-			const Tile &tile = tiles[qi];
-			Color_Set s;
+			size_t count = 0;
 			if (use_color_zero) {
-				s.insert(color_zero);
+				last_use[ci_zero] = qi;
+				count++;
 			}
-			for (Fl_Color c : tile) {
-				s.insert(c);
+			for (int i = 0; i < NUM_TILE_PIXELS; i++) {
+				size_t ci = tiles.index(qi, i);
+				if (last_use[ci] != qi) {
+					last_use[ci] = qi;
+					count++;
+				}
 			}
-			if (s.size() > max_colors) {
+			if (count > max_colors) {
 				break;
 			}
-			cs_tiles.push_back(s);
 		}
 
 		// Check that all color sets fit within the color limit
 		if (qi < n) {
 			size_t qx = qi % w, qy = qi / w;
-			delete [] tiles;
 			std::string msg = "Could not convert ";
 			msg = msg + image_basename + "!\n\nThe tile at (" +
 				std::to_string(qx) + ", " + std::to_string(qy) +
 				") has more than " + std::to_string(max_colors) + " colors.";
-			_error_dialog->message(msg);
-			_error_dialog->show(this);
-			return output;
+			message = msg;
+			return false;
 		}
 
-		// Remove duplicate color sets
-		std::vector<Color_Set> cs_uniq(cs_tiles.size());
-		auto cs_uniq_last = std::copy_if(RANGE(cs_tiles), cs_uniq.begin(), [&](const Color_Set &s) {
-			return std::find(RANGE(cs_uniq), s) == cs_uniq.end();
-		});
-		cs_uniq.resize(std::distance(cs_uniq.begin(), cs_uniq_last));
+		// Color sets only index the colors the tiles use
+		std::vector<size_t> set_colors, set_index(nc);
+		for (size_t ci = 0; ci < nc; ci++) {
+			if (last_use[ci] != n) {
+				set_index[ci] = set_colors.size();
+				set_colors.push_back(ci);
+			}
+		}
+		size_t ns = set_colors.size();
+
+		// Get the unique color sets, and which one each tile has, so duplicates are never stored
+		std::vector<Color_Set> cs_uniq;
+		std::vector<size_t> tile_sets(n);
+		std::unordered_map<Color_Set, size_t, Color_Set_Hash> cs_seen;
+		Color_Set s(ns);
+		for (size_t i = 0; i < n; i++) {
+			s.clear();
+			if (use_color_zero) {
+				s.insert(set_index[ci_zero]);
+			}
+			for (int p = 0; p < NUM_TILE_PIXELS; p++) {
+				s.insert(set_index[tiles.index(i, p)]);
+			}
+			auto [it, inserted] = cs_seen.emplace(s, cs_uniq.size());
+			if (inserted) {
+				cs_uniq.push_back(s);
+			}
+			tile_sets[i] = it->second;
+		}
 
 		// Remove color sets that are proper subsets of other color sets
-		std::vector<Color_Set> cs_full(cs_uniq.size());
-		auto cs_full_last = std::copy_if(RANGE(cs_uniq), cs_full.begin(), [&](const Color_Set &s) {
-			return !std::any_of(RANGE(cs_uniq), [&](const Color_Set &c) {
-				return s != c && std::includes(RANGE(c), RANGE(s));
-			});
-		});
-		cs_full.resize(std::distance(cs_full.begin(), cs_full_last));
+		std::vector<Color_Set> cs_full;
+		cs_full.reserve(cs_uniq.size());
+		for (const Color_Set &s : cs_uniq) {
+			if (!std::any_of(RANGE(cs_uniq), [&](const Color_Set &c) {
+				return c.size() > s.size() && c.includes(s);
+			})) {
+				cs_full.push_back(s);
+			}
+		}
 
 		// Combine color sets as long as they fit within the color limit
 		std::vector<Color_Set> cs_opt;
@@ -258,14 +413,12 @@ Image_to_Tiles_Result Main_Window::image_to_tiles() {
 		for (Color_Set &s : cs_full) {
 			Color_Set *b = NULL;
 			for (Color_Set &c : cs_opt) {
-				Color_Set d;
-				std::set_difference(RANGE(s), RANGE(c), std::inserter(d, d.begin()));
-				if (c.size() + d.size() <= max_colors) {
+				if (c.union_size(s) <= max_colors) {
 					b = &c;
 				}
 			}
 			if (b) {
-				b->insert(RANGE(s));
+				b->insert(s);
 			}
 			else {
 				cs_opt.push_back(s);
@@ -280,7 +433,11 @@ Image_to_Tiles_Result Main_Window::image_to_tiles() {
 		// Sort each palette from brightest to darkest color, padded with black, keeping color 0 first
 		palettes.reserve(max_palettes);
 		for (Color_Set &s : cs_opt) {
-			Palette palette(RANGE(s));
+			Palette palette;
+			palette.reserve(s.size());
+			s.for_each([&](size_t si) {
+				palette.push_back(tiles.color(set_colors[si]));
+			});
 			std::sort(RANGE(palette), [use_color_zero, color_zero](Fl_Color a, Fl_Color b) {
 				if (use_color_zero) {
 					if (a == color_zero) { return true; }
@@ -311,52 +468,46 @@ Image_to_Tiles_Result Main_Window::image_to_tiles() {
 		}
 
 		// Create the palette file
-		const char *palette_filename = _image_to_tiles_dialog->palette_filename();
+		const char *palette_filename = options.palette_filename;
 		const char *palette_basename = fl_filename_name(palette_filename);
 		if (!write_palette(palette_filename, palettes, pal_fmt, max_colors)) {
-			delete [] tiles;
 			std::string msg = "Could not write to ";
 			msg = msg + palette_basename + "!";
-			_error_dialog->message(msg);
-			_error_dialog->show(this);
-			return output;
+			message = msg;
+			return false;
 		}
 
 		// Check that the palettes fit within the palette limit
 		size_t np = palettes.size();
 		if (np > max_palettes) {
-			delete [] tiles;
 			std::string msg = "Could not convert ";
 			msg = msg + image_basename + "!\n\nThe tiles need more than " +
 				std::to_string(max_palettes) + " palettes.\n\nAll " +
 				std::to_string(np) + " palettes were written to " + palette_basename + ".";
-			_error_dialog->message(msg);
-			_error_dialog->show(this);
-			return output;
+			message = msg;
+			return false;
 		}
 		else if (max_palettes == 1 && palettes[0].size() > max_colors) {
-			delete [] tiles;
 			std::string msg = "Could not convert ";
 			msg = msg + image_basename + "!\n\nThe tiles need more than " +
 				std::to_string(max_colors) + " colors.\n\nAll " +
 				std::to_string(np) + " palettes were written to " + palette_basename + ".";
-			_error_dialog->message(msg);
-			_error_dialog->show(this);
-			return output;
+			message = msg;
+			return false;
 		}
 
-		// Associate tiles with palettes
-		for (size_t i = 0; i < n; i++) {
-			int pal = 0;
-			const Color_Set &s = cs_tiles[i];
-			for (size_t j = 0; j < np; j++) {
-				const Color_Set &c = cs_opt[j];
-				if (std::includes(RANGE(c), RANGE(s))) {
-					pal = (int)j;
+		// Associate tiles with palettes, by way of their color sets
+		std::vector<int> set_palettes(cs_uniq.size(), 0);
+		for (size_t u = 0; u < cs_uniq.size(); u++) {
+			for (size_t j = 0; j < cs_opt.size(); j++) {
+				if (cs_opt[j].includes(cs_uniq[u])) {
+					set_palettes[u] = (int)j;
 					break;
 				}
 			}
-			tile_palettes[i] = start_index + pal;
+		}
+		for (size_t i = 0; i < n; i++) {
+			tile_palettes[i] = start_index + set_palettes[tile_sets[i]];
 		}
 		tile_palettes[n] = start_index; // Fail-safe blank tile at the end
 	}
@@ -366,90 +517,140 @@ Image_to_Tiles_Result Main_Window::image_to_tiles() {
 	Tilemap tilemap;
 	std::vector<size_t> tileset;
 
-	uint16_t start_id = _image_to_tiles_dialog->start_id();
-	bool use_blank = _image_to_tiles_dialog->use_blank();
-	uint16_t blank_id = _image_to_tiles_dialog->blank_id();
+	uint16_t start_id = options.start_id;
+	bool use_blank = options.use_blank;
+	uint16_t blank_id = options.blank_id;
 
 	if (!build_tilemap(tiles, n, tile_palettes, tilemap, tileset, fmt, start_id, use_blank, blank_id, color_zero)) {
-		delete [] tiles;
 		std::string msg = "Could not convert ";
 		msg = msg + image_basename + "!\n\nToo many unique tiles.";
-		_error_dialog->message(msg);
-		_error_dialog->show(this);
-		return output;
+		message = msg;
+		return false;
 	}
 
 	// Get the output filenames
 
-	const char *tileset_filename = _image_to_tiles_dialog->tileset_filename();
-	const char *tilemap_filename = _image_to_tiles_dialog->tilemap_filename();
-	const char *attrmap_filename = _image_to_tiles_dialog->attrmap_filename();
+	const char *tileset_filename = options.tileset_filename;
+	const char *tilemap_filename = options.tilemap_filename;
+	const char *attrmap_filename = options.attrmap_filename;
 	const char *tileset_basename = fl_filename_name(tileset_filename);
 	const char *tilemap_basename = fl_filename_name(tilemap_filename);
 
 	// Create the tilemap file
 
-	if (!tilemap.write_tiles(tilemap_filename, attrmap_filename, fmt)) {
-		delete [] tiles;
-		std::string msg = "Could not write to ";
-		msg = msg + tilemap_basename + "!";
-		_error_dialog->message(msg);
-		_error_dialog->show(this);
-		return output;
+	Tilemap::Write_Result written = tilemap.write_tiles(tilemap_filename, attrmap_filename, fmt);
+	if (written != Tilemap::Write_Result::WRITE_OK) {
+		message = Tilemap::write_error_message(written, tilemap_filename, attrmap_filename);
+		return false;
 	}
 
 	// Create the tilepal file
 
 	if (make_palette && format_has_per_tile_palettes(fmt)) {
-		const char *tilepal_filename = _image_to_tiles_dialog->tilepal_filename();
+		const char *tilepal_filename = options.tilepal_filename;
 		const char *tilepal_basename = fl_filename_name(tilepal_filename);
 		if (!write_tilepal(tilepal_filename, tileset, tile_palettes)) {
-			delete [] tiles;
 			std::string msg = "Could not write to ";
 			msg = msg + tilepal_basename + "!";
-			_error_dialog->message(msg);
-			_error_dialog->show(this);
-			return output;
+			message = msg;
+			return false;
 		}
 	}
 
 	// Create the tileset file
 
-	int tw = tileset_width();
-	if (_image_to_tiles_dialog->no_extra_blank_tiles()) { tw = fit_width((int)tileset.size(), tw); }
+	int tw = options.tileset_width;
+	if (options.no_extra_blank_tiles) { tw = fit_width((int)tileset.size(), tw); }
 	bool indexed = make_palette && pal_fmt == Palette_Format::INDEXED;
-	Fl_RGB_Image *timg = print_tileset(tiles, tileset, palettes, tile_palettes, max_colors, tw, color_zero, indexed, start_index);
+	int bpp = make_palette ? format_color_depth(fmt) : 0;
+	Fl_RGB_Image *timg = print_tileset(tiles, tileset, palettes, tile_palettes, max_colors, tw, color_zero, indexed,
+		indexed || bpp, start_index);
 	Image::Result result = indexed ? Image::write_image(tileset_filename, timg, 0, &palettes, max_colors) :
-		Image::write_image(tileset_filename, timg, make_palette ? format_color_depth(fmt) : 0);
+		Image::write_image(tileset_filename, timg, bpp);
 	delete timg;
 	if (result != Image::Result::IMAGE_OK) {
-		delete [] tiles;
 		std::string msg = "Could not write to ";
 		msg = msg + tileset_basename + "!\n\n" + Image::error_message(result);
+		message = msg;
+		return false;
+	}
+
+	// Describe the completed operation
+
+	std::string msg = "Converted ";
+	msg = msg + image_basename + " to\n" + tilemap_basename + " and " + tileset_basename + "!";
+	message = msg;
+
+	width = w;
+	return true;
+}
+
+Image_to_Tiles_Result Main_Window::image_to_tiles() {
+	Image_to_Tiles_Result output = {};
+
+	Image_to_Tiles_Options options = {};
+	options.image_filename = _image_to_tiles_dialog->image_filename();
+	options.tileset_filename = _image_to_tiles_dialog->tileset_filename();
+	options.tilemap_filename = _image_to_tiles_dialog->tilemap_filename();
+	options.attrmap_filename = _image_to_tiles_dialog->attrmap_filename();
+	options.palette_filename = _image_to_tiles_dialog->palette_filename();
+	options.tilepal_filename = _image_to_tiles_dialog->tilepal_filename();
+	options.fmt = _image_to_tiles_dialog->format();
+	options.make_palette = _image_to_tiles_dialog->palette();
+	options.palette_format = _image_to_tiles_dialog->palette_format();
+	options.use_color_zero = _image_to_tiles_dialog->color_zero();
+	options.color_zero = _image_to_tiles_dialog->fl_color_zero();
+	options.start_id = _image_to_tiles_dialog->start_id();
+	options.use_blank = _image_to_tiles_dialog->use_blank();
+	options.blank_id = _image_to_tiles_dialog->blank_id();
+	options.start_index = _image_to_tiles_dialog->start_index();
+	options.no_extra_blank_tiles = _image_to_tiles_dialog->no_extra_blank_tiles();
+	options.tileset_width = tileset_width();
+
+	std::string msg;
+	size_t width = 0;
+	if (!::image_to_tiles(options, msg, width)) {
 		_error_dialog->message(msg);
 		_error_dialog->show(this);
 		return output;
 	}
 
-	delete [] tiles;
-
 	// Alert the completed operation
 
-	std::string msg = "Converted ";
-	msg = msg + image_basename + " to\n" + tilemap_basename + " and " + tileset_basename + "!";
 	_success_dialog->message(msg);
 	_success_dialog->show(this);
 
 	// Return the output data
 
-	output.tileset_filename = tileset_filename;
-	output.tilemap_filename = tilemap_filename;
-	output.attrmap_filename = attrmap_filename;
-	output.fmt = fmt;
-	output.width = w;
-	output.start_id = start_id;
+	output.tileset_filename = options.tileset_filename;
+	output.tilemap_filename = options.tilemap_filename;
+	output.attrmap_filename = options.attrmap_filename;
+	output.fmt = options.fmt;
+	output.width = width;
+	output.start_id = options.start_id;
 	output.success = true;
 	return output;
 }
 
+Fl_Color parse_rgb_color(const char *s) {
+	char rgb[7] = {};
+	if (size_t n = strlen(s); n < 6) {
+		memset(rgb, '0', 6 - n);
+	}
+	strncat(rgb, s, 6);
+
+	char buffer[3] = {};
+	buffer[0] = rgb[0];
+	buffer[1] = rgb[1];
+	uchar r = (uchar)strtoul(buffer, NULL, 16);
+	buffer[0] = rgb[2];
+	buffer[1] = rgb[3];
+	uchar g = (uchar)strtoul(buffer, NULL, 16);
+	buffer[0] = rgb[4];
+	buffer[1] = rgb[5];
+	uchar b = (uchar)strtoul(buffer, NULL, 16);
+
+	return fl_rgb_color(NORMRGB(r), NORMRGB(g), NORMRGB(b));
+}
+
 #pragma warning(pop)
@@ -0,0 +1,42 @@
+#ifndef IMAGE_TO_TILES_H
+#define IMAGE_TO_TILES_H
+
+#include <string>
+
+#pragma warning(push, 0)
+#include <FL/Enumerations.H>
+#pragma warning(pop)
+
+#include "utils.h"
+#include "tilemap-format.h"
+#include "palette-format.h"
+
+struct Image_to_Tiles_Options {
+	const char *image_filename;
+	const char *tileset_filename;
+	const char *tilemap_filename;
+	const char *attrmap_filename;
+	const char *palette_filename;
+	const char *tilepal_filename;
+	Tilemap_Format fmt;
+	bool make_palette;
+	Palette_Format palette_format;
+	bool use_color_zero;
+	Fl_Color color_zero;
+	uint16_t start_id;
+	bool use_blank;
+	uint16_t blank_id;
+	uint8_t start_index;
+	bool no_extra_blank_tiles;
+	int tileset_width;
+	// Threads to read the image with, or 0 for one per core
+	size_t max_workers;
+};
+
+// Converts an image to a tilemap, tileset, and palette without any user interface;
+// the message describes the error or the success, and width is the tilemap width
+bool image_to_tiles(const Image_to_Tiles_Options &options, std::string &message, size_t &width);
+
+Fl_Color parse_rgb_color(const char *s);
+
+#endif
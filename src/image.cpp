@@ -126,8 +126,11 @@ Image::Result Image::write_bmp_image(const char *f, Fl_RGB_Image *img, int bpp,
 	if (data_pad == 4) { data_pad = 0; }
 	size_t image_size = data_size + data_pad;
 	size_t file_size = header_size + image_size;
-	float x_dpi, y_dpi;
-	Fl::screen_dpi(x_dpi, y_dpi);
+	// Querying the screen would open a display connection, so headless conversions assume 96 DPI
+	float x_dpi = 96.0f, y_dpi = 96.0f;
+	if (Fl::first_window()) {
+		Fl::screen_dpi(x_dpi, y_dpi);
+	}
 	size32_t x_ppm = (size32_t)(x_dpi * INCHES_PER_METER);
 	size32_t y_ppm = (size32_t)(y_dpi * INCHES_PER_METER);
 	uchar file_header[14] = {
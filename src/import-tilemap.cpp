@@ -1,50 +1,67 @@
 #include <cstdio>
 #include <cstring>
-#include <fstream>
-#include <sstream>
+#include <cctype>
 #include <vector>
-#include <regex>
 
 #pragma warning(push, 0)
 #include <FL/fl_utf8.h>
 #pragma warning(pop)
 
+#include "mapped-file.h"
 #include "tilemap.h"
 #include "version.h"
 
-static uchar get_number(FILE *file, int &c) {
-	bool hex = false;
-	int b = c;
-	if (b == '0') {
-		b = fgetc(file);
-		if (b == 'X' || b == 'x') {
-			hex = true;
-			b = fgetc(file);
-		}
+static inline bool is_digit(char c) {
+	return (unsigned int)(c - '0') < 10;
+}
+
+static inline unsigned int hex_digit_value(char c) {
+	return (unsigned int)(c - (c < 'A' ? '0' : c < 'a' ? 'A' - 0xA : 'a' - 0xA));
+}
+
+static void push_value(std::vector<uchar> &bytes, unsigned int v, bool words, bool big_endian) {
+	if (!words) {
+		bytes.push_back((uchar)v);
+	}
+	else if (big_endian) {
+		bytes.push_back((uchar)(v >> 8));
+		bytes.push_back((uchar)v);
 	}
-	uchar v = 0;
-	if (hex) {
-		while (isxdigit(b)) {
-			v = v * 16 + (uchar)(b - (b < 'A' ? '0' : b < 'a' ? 'A' - 0xA : 'a' - 0xA));
-			b = fgetc(file);
+	else {
+		bytes.push_back((uchar)v);
+		bytes.push_back((uchar)(v >> 8));
+	}
+}
+
+// Reads a decimal or 0x-prefixed hex number; fails without advancing if it is above max
+static bool get_number(const char *&p, const char *end, unsigned int max, unsigned int &v) {
+	const char *start = p;
+	v = 0;
+	if (end - p > 1 && p[0] == '0' && (p[1] == 'X' || p[1] == 'x')) {
+		for (p += 2; p < end && isxdigit((uchar)*p); p++) {
+			v = v * 16 + hex_digit_value(*p);
+			if (v > max) { p = start; return false; }
 		}
 	}
 	else {
-		while (isdigit(b)) {
-			v = v * 10 + (uchar)(b - '0');
-			b = fgetc(file);
+		for (; p < end && is_digit(*p); p++) {
+			v = v * 10 + (unsigned int)(*p - '0');
+			if (v > max) { p = start; return false; }
 		}
 	}
-	c = b;
-	return v;
+	return true;
 }
 
-static bool import_csv_tiles(FILE *file, std::vector<uchar> &bytes) {
+static bool import_csv_tiles(const char *p, const char *end, const Import_Options &options, std::vector<uchar> &bytes,
+	const char *&stop) {
+	unsigned int max = options.words ? 0xFFFF : 0xFF;
 	bool got_number = false;
-	for (int c = fgetc(file); c != EOF;) {
-		if (isdigit(c) && !got_number) {
-			uchar v = get_number(file, c);
-			bytes.push_back(v);
+	while (p < end) {
+		char c = *p;
+		if (is_digit(c) && !got_number) {
+			unsigned int v;
+			if (!get_number(p, end, max, v)) { stop = p; return false; }
+			push_value(bytes, v, options.words, options.big_endian);
 			got_number = true;
 			continue;
 		}
@@ -53,171 +70,214 @@ static bool import_csv_tiles(FILE *file, std::vector<uchar> &bytes) {
 				got_number = false;
 			}
 			else {
-				bytes.push_back(0);
+				push_value(bytes, 0, options.words, options.big_endian);
 			}
 		}
 		else if ((c == '\n' || c == '\r') && got_number) {
 			got_number = false;
 		}
-		else if (!isspace(c)) {
+		else if (!isspace((uchar)c)) {
+			stop = p;
 			return false;
 		}
-		c = fgetc(file);
+		p++;
 	}
 	return true;
 }
 
-static void skip_c_line_comment(FILE *file) {
-	for (int c = fgetc(file); c != '\r' && c != '\n' && c != EOF; c = fgetc(file));
-}
-
-static void skip_c_block_comment(FILE *file) {
-	for (int c = fgetc(file); c != EOF; c = fgetc(file)) {
-		while (c != '*' && c != EOF) { c = fgetc(file); }
-		while (c == '*') { c = fgetc(file); }
-		if (c == '/') { return; }
+// Skips a // or /* */ comment, if one starts at p
+static bool skip_c_comment(const char *&p, const char *end) {
+	if (end - p < 2 || p[0] != '/') { return false; }
+	if (p[1] == '/') {
+		for (p += 2; p < end && *p != '\n' && *p != '\r'; p++);
+		return true;
 	}
+	if (p[1] == '*') {
+		for (p += 2; p < end && !(*p == '*' && p + 1 < end && p[1] == '/'); p++);
+		p = p < end ? p + 2 : end;
+		return true;
+	}
+	return false;
 }
 
-static bool import_c_tiles(FILE *file, std::vector<uchar> &bytes) {
-	enum class State { PRELUDE, ARRAY, COMMA };
-	State state = State::PRELUDE;
-	for (int c = fgetc(file); c != EOF;) {
-		switch (state) {
-		case State::PRELUDE:
-			if (c == '{') {
-				state = State::ARRAY;
-			}
-			else if (c == '/') {
-			maybe_comment:
-				c = fgetc(file);
-				if (c == '*') {
-					skip_c_block_comment(file);
-				}
-				else if (c == '/') {
-					skip_c_line_comment(file);
-				}
-				else {
-					continue;
-				}
-			}
-			break;
-		case State::ARRAY:
-			if (isdigit(c)) {
-				uchar v = get_number(file, c);
-				bytes.push_back(v);
-				state = State::COMMA;
-			}
-			else {
-				goto not_number_or_comma_in_array;
-			}
-			[[fallthrough]];
-		case State::COMMA:
-			if (c == ',') {
-				state = State::ARRAY;
-			}
-			else {
-			not_number_or_comma_in_array:
-				if (c == '/') {
-					goto maybe_comment;
-				}
-				else if (c == '}') {
-					return true;
-				}
-				else if (!isspace(c)) {
-					return false;
-				}
-			}
-			break;
+// Reads the values of the first {...} array, skipping anything before it
+static bool import_c_tiles(const char *p, const char *end, const Import_Options &options, std::vector<uchar> &bytes,
+	const char *&stop) {
+	unsigned int max = options.words ? 0xFFFF : 0xFF;
+	while (p < end && *p != '{') {
+		if (!skip_c_comment(p, end)) { p++; }
+	}
+	if (p == end) {
+		stop = end;
+		return false;
+	}
+	bool got_number = false;
+	for (p++; p < end;) {
+		char c = *p;
+		if (is_digit(c) && !got_number) {
+			unsigned int v;
+			if (!get_number(p, end, max, v)) { stop = p; return false; }
+			push_value(bytes, v, options.words, options.big_endian);
+			got_number = true;
+			continue;
+		}
+		else if (c == ',' && got_number) {
+			got_number = false;
 		}
-		c = fgetc(file);
+		else if (c == '}') {
+			return true;
+		}
+		else if (c == '/') {
+			// A lone slash is ignored
+			if (!skip_c_comment(p, end)) { p++; }
+			continue;
+		}
+		else if (!isspace((uchar)c)) {
+			stop = p;
+			return false;
+		}
+		p++;
 	}
+	stop = end;
 	return false;
 }
 
-static uchar get_asm_number(const std::string &data, size_t &i) {
-	uchar v = 0;
-	size_t len = data.length();
-	char c = data[i];
-	if (c == '#') {
-		if (++i == len) { return v; }
-		c = data[i];
+static inline bool is_asm_word_char(char c) {
+	return isalnum((uchar)c) || c == '_';
+}
+
+static inline bool is_asm_label_char(char c) {
+	return is_asm_word_char(c) || c == '.' || c == '@' || c == '#' || c == '$';
+}
+
+enum class Asm_Directive { NONE, BYTES, WORDS, BIG_ENDIAN_WORDS };
+
+// Matches a data directive at p that ends at a word boundary, and sets q to its end:
+// db and dw (rgbasm), .db and .dw (wla-dx), .byte, .byt, .word, and big-endian .dbyt (ca65)
+static Asm_Directive get_asm_directive(const char *p, const char *end, const char *&q) {
+	static const struct { const char *name; Asm_Directive directive; } directives[] = {
+		{"db", Asm_Directive::BYTES}, {"byte", Asm_Directive::BYTES}, {"byt", Asm_Directive::BYTES},
+		{"dw", Asm_Directive::WORDS}, {"word", Asm_Directive::WORDS}, {"dbyt", Asm_Directive::BIG_ENDIAN_WORDS},
+	};
+	if (p < end && *p == '.') { p++; }
+	for (const auto &d : directives) {
+		const char *s = p, *name = d.name;
+		while (*name && s < end && tolower((uchar)*s) == *name) {
+			s++;
+			name++;
+		}
+		if (!*name && (s == end || !is_asm_word_char(*s))) {
+			q = s;
+			return d.directive;
+		}
 	}
+	return Asm_Directive::NONE;
+}
+
+static unsigned int get_asm_number(const char *&p, const char *end) {
+	unsigned int v = 0;
+	if (*p == '#' && ++p == end) { return v; }
+	char c = *p;
 	if (c == '$') {
-		while (++i < len) {
-			c = data[i];
-			if (!isxdigit(c)) { break; }
-			v = v * 16 + (uchar)(c - (c < 'A' ? '0' : c < 'a' ? 'A' - 0xA : 'a' - 0xA));
+		for (p++; p < end && isxdigit((uchar)(c = *p)); p++) {
+			v = v * 16 + hex_digit_value(c);
 		}
 	}
 	else if (c == '&') {
-		while (++i < len) {
-			c = data[i];
-			if (!isdigit(c) || c == '8' || c == '9') { break; }
-			v = v * 8 + (uchar)(c - '0');
+		for (p++; p < end && (c = *p) >= '0' && c <= '7'; p++) {
+			v = v * 8 + (unsigned int)(c - '0');
 		}
 	}
 	else if (c == '%') {
-		while (++i < len) {
-			c = data[i];
-			if (c != '0' && c != '1') { break; }
-			v = v * 2 + (uchar)(c - '0');
+		for (p++; p < end && ((c = *p) == '0' || c == '1'); p++) {
+			v = v * 2 + (unsigned int)(c - '0');
 		}
 	}
-	else if (isdigit(c)) {
-		do {
-			v = v * 10 + (uchar)(c - '0');
-			if (++i == len) { break; }
-			c = data[i];
-		} while (isdigit(c));
+	else {
+		for (; p < end && is_digit(c = *p); p++) {
+			v = v * 10 + (unsigned int)(c - '0');
+		}
 	}
 	return v;
 }
 
-static bool import_asm_tiles(std::ifstream &ifs, std::vector<uchar> &bytes) {
-	std::regex rx(
-		"^"
-		R"([ \t]*)" // space
-		R"((?:[A-Za-z0-9_\.@#\$]*(?:\b|[ \t:]+))?)" // label (alphanumeric or . @ # $ followed by colons)
-		R"((?:\.?(?:[Dd][Bb]|[Bb][Yy][Tt][Ee]?)\b([^;]*))?)" // db (rgbasm), .db (wla-dx), .byte or .byt (ca65)
-		R"((?:;.*)?)" // ; comment
-		"$"
-	);
-	while (ifs.good()) {
-		std::string line;
-		std::getline(ifs, line);
-		std::smatch sm;
-		std::regex_match(line, sm, rx);
-		size_t n = sm.size();
-		if (n != 2) { return false; }
-		const std::string &data = sm[1];
-		bool got_number = false;
-		size_t len = data.length();
-		for (size_t i = 0; i < len; i++) {
-			char c = data[i];
-			if ((isdigit(c) || c == '$' || c == '&' || c == '%' || c == '#') && !got_number) {
-				uchar v = get_asm_number(data, i);
-				i--;
-				bytes.push_back(v);
-				got_number = true;
-				continue;
-			}
-			else if (c == ',') {
-				if (got_number) {
-					got_number = false;
-				}
-				else {
-					bytes.push_back(0);
-				}
+// Parses comma-separated values up to a comment or the end of the line; empty values are 0
+static bool get_asm_values(const char *p, const char *end, Asm_Directive directive, bool big_endian,
+	std::vector<uchar> &bytes, const char *&stop) {
+	bool words = directive != Asm_Directive::BYTES;
+	big_endian = directive == Asm_Directive::BIG_ENDIAN_WORDS || (words && big_endian);
+	bool got_number = false;
+	while (p < end && *p != ';') {
+		char c = *p;
+		if ((is_digit(c) || c == '$' || c == '&' || c == '%' || c == '#') && !got_number) {
+			push_value(bytes, get_asm_number(p, end), words, big_endian);
+			got_number = true;
+			continue;
+		}
+		else if (c == ',') {
+			if (got_number) {
+				got_number = false;
 			}
-			else if (!isspace(c)) {
-				return false;
+			else {
+				push_value(bytes, 0, words, big_endian);
 			}
 		}
+		else if (!isspace((uchar)c)) {
+			stop = p;
+			return false;
+		}
+		p++;
 	}
 	return true;
 }
 
+// Matches what follows a line's label: an optional directive, whose values run up to
+// an optional comment, or else just the comment; trailing spaces are ignored
+static bool match_asm_statement(const char *p, const char *end, Asm_Directive &directive, const char *&values) {
+	directive = get_asm_directive(p, end, values);
+	if (directive != Asm_Directive::NONE) { return true; }
+	while (p < end && isspace((uchar)*p)) { p++; }
+	return p == end || *p == ';';
+}
+
+// A line is an optional label (alphanumeric or . @ # $, then a word boundary or colons),
+// an optional data directive with its values, and an optional ; comment
+static bool import_asm_line(const char *p, const char *end, bool big_endian, std::vector<uchar> &bytes,
+	const char *&stop) {
+	while (p < end && (*p == ' ' || *p == '\t')) { p++; }
+	size_t n = 0;
+	while (p + n < end && is_asm_label_char(p[n])) { n++; }
+	Asm_Directive directive = Asm_Directive::NONE;
+	const char *values = NULL;
+	bool matched = false;
+	// Prefer the longest label, ending at a word boundary before spaces and colons, as a regex would
+	for (size_t k = n + 1; k-- > 0 && !matched;) {
+		const char *q = p + k;
+		if ((k > 0 && is_asm_word_char(q[-1])) != (q < end && is_asm_word_char(*q))) {
+			matched = match_asm_statement(q, end, directive, values);
+		}
+		if (!matched && q < end && (*q == ' ' || *q == '\t' || *q == ':')) {
+			while (q < end && (*q == ' ' || *q == '\t' || *q == ':')) { q++; }
+			matched = match_asm_statement(q, end, directive, values);
+		}
+	}
+	if (!matched && !match_asm_statement(p, end, directive, values)) {
+		stop = p;
+		return false;
+	}
+	return directive == Asm_Directive::NONE || get_asm_values(values, end, directive, big_endian, bytes, stop);
+}
+
+static bool import_asm_tiles(const char *p, const char *end, const Import_Options &options, std::vector<uchar> &bytes,
+	const char *&stop) {
+	for (;;) {
+		const char *eol = (const char *)memchr(p, '\n', (size_t)(end - p));
+		if (!import_asm_line(p, eol ? eol : end, options.big_endian, bytes, stop)) { return false; }
+		if (!eol) { return true; }
+		p = eol + 1;
+	}
+}
+
 static bool import_rmp_tiles(FILE *file, std::vector<uchar> &bytes) {
 	size_t n = read_rmp_size(file);
 	if (n == 0) { return false; }
@@ -230,34 +290,65 @@ static bool import_rmp_tiles(FILE *file, std::vector<uchar> &bytes) {
 	return true;
 }
 
-static Tilemap::Result import_file_bytes(const char *f, std::vector<uchar> &bytes, bool attrmap) {
-	bool valid = false;
+// Finds the 1-based line and column of a position in a text file
+static void text_position(const char *begin, const char *p, size_t &line, size_t &column) {
+	const char *line_start = begin;
+	line = 1;
+	for (const char *q = begin; q < p; q++) {
+		if (*q == '\n') {
+			line++;
+			line_start = q + 1;
+		}
+	}
+	column = (size_t)(p - line_start) + 1;
+}
+
+static Tilemap::Result import_file_bytes(const char *f, std::vector<uchar> &bytes, bool attrmap,
+	const Import_Options &options, size_t &line, size_t &column) {
+	Tilemap::Result bad_file = attrmap ? Tilemap::Result::ATTRMAP_BAD_FILE : Tilemap::Result::TILEMAP_BAD_FILE;
+	Tilemap::Result invalid = attrmap ? Tilemap::Result::ATTRMAP_INVALID : Tilemap::Result::TILEMAP_INVALID;
+	if (ends_with_ignore_case(f, ".rmp")) {
+		FILE *file = fl_fopen(f, "rb");
+		if (!file) { return bad_file; }
+		bool valid = import_rmp_tiles(file, bytes);
+		fclose(file);
+		return valid ? Tilemap::Result::TILEMAP_OK : invalid;
+	}
+
+	Mapped_File file;
+	if (!file.open(f)) { return bad_file; }
+	const char *begin = (const char *)file.begin(), *end = (const char *)file.end(), *stop = end;
+	bytes.reserve(file.size() / 2);
+	bool valid;
 	if (ends_with_ignore_case(f, ".asm") || ends_with_ignore_case(f, ".s") || ends_with_ignore_case(f, ".inc") ||
 		ends_with_ignore_case(f, ".z80") || ends_with_ignore_case(f, ".sm83") || ends_with_ignore_case(f, ".gbz80")) {
-		std::ifstream ifs;
-		open_ifstream(ifs, f);
-		if (!ifs.good()) { return attrmap ? Tilemap::Result::ATTRMAP_BAD_FILE : Tilemap::Result::TILEMAP_BAD_FILE; }
-		valid = import_asm_tiles(ifs, bytes);
+		valid = import_asm_tiles(begin, end, options, bytes, stop);
+	}
+	else if (ends_with_ignore_case(f, ".csv")) {
+		valid = import_csv_tiles(begin, end, options, bytes, stop);
 	}
 	else {
-		FILE *file = fl_fopen(f, "rb");
-		if (!file) { return attrmap ? Tilemap::Result::ATTRMAP_BAD_FILE : Tilemap::Result::TILEMAP_BAD_FILE; }
-		valid = (ends_with_ignore_case(f, ".rmp") ? import_rmp_tiles : ends_with_ignore_case(f, ".csv") ? import_csv_tiles :
-			import_c_tiles)(file, bytes);
-		fclose(file);
+		valid = import_c_tiles(begin, end, options, bytes, stop);
+	}
+	if (!valid) {
+		text_position(begin, stop, line, column);
+		return invalid;
 	}
-	if (!valid) { return attrmap ? Tilemap::Result::ATTRMAP_INVALID : Tilemap::Result::TILEMAP_INVALID; }
 	return Tilemap::Result::TILEMAP_OK;
 }
 
-Tilemap::Result Tilemap::import_tiles(const char *tf, const char *af) {
+Tilemap::Result Tilemap::import_tiles(const char *tf, const char *af, const Import_Options &options) {
 	std::vector<uchar> tbytes, abytes;
-	Result result = import_file_bytes(tf, tbytes, false);
+	_error_line = _error_column = 0;
+	Result result = import_file_bytes(tf, tbytes, false, options, _error_line, _error_column);
 	if (result != Result::TILEMAP_OK) { return (_result = result); }
 	if (af && af[0]) {
-		result = import_file_bytes(af, abytes, true);
+		// Attrmaps always hold one byte per tile
+		Import_Options attr_options = options;
+		attr_options.words = false;
+		result = import_file_bytes(af, abytes, true, attr_options, _error_line, _error_column);
 		if (result != Result::TILEMAP_OK) { return (_result = result); }
 	}
 	_modified = true;
-	return (_result = make_tiles(tbytes, abytes));
+	return (_result = make_tiles(tbytes.data(), tbytes.size(), abytes.data(), abytes.size()));
 }
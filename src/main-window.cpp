@@ -1,6 +1,5 @@
 #include <cstdlib>
 #include <cwctype>
-#include <queue>
 #include <utility>
 
 #pragma warning(push, 0)
@@ -45,8 +44,8 @@
 #pragma warning(disable : 4458)
 
 Main_Window::Main_Window(int x, int y, int w, int h, const char *) : Fl_Overlay_Window(x, y, w, h, PROGRAM_NAME),
-	_tile_buttons(), _tilemap_file(), _attrmap_file(), _tilemap_basename(), _tileset_files(), _recent_tilemaps(),
-	_recent_tilesets(), _tilemap(), _tilesets(), _wx(x), _wy(y), _ww(w), _wh(h) {
+	_tilemap_file(), _attrmap_file(), _tilemap_basename(), _tileset_files(), _recent_tilemaps(), _recent_tilesets(),
+	_tilemap(), _tilesets(), _wx(x), _wy(y), _ww(w), _wh(h) {
 
 	Tile_State::tilesets(&_tilesets);
 
@@ -141,7 +140,7 @@ Main_Window::Main_Window(int x, int y, int w, int h, const char *) : Fl_Overlay_
 	new Spacer(0, 0, 2, 21);
 	_tilemap_format = new Label(0, 0, format_max_name_width() + 4, 21, "");
 	new Spacer(0, 0, 2, 21);
-	_hover_id = new Label(0, 0, text_width("ID: $A:AA", 4), 21, "");
+	_hover_id = new Label(0, 0, text_width("ID: $A:AA (99999 uses)", 4), 21, "");
 	new Spacer(0, 0, 2, 21);
 	_hover_xy = new Label(0, 0, text_width("X/Y (9999, 9999)", 4), 21, "");
 	new Spacer(0, 0, 2, 21);
@@ -166,14 +165,9 @@ Main_Window::Main_Window(int x, int y, int w, int h, const char *) : Fl_Overlay_
 	_tiles_scroll = new Workspace(gx+5, qy+5, gw-10, gh-10);
 	int ox = _tiles_scroll->x() + Fl::box_dx(_tiles_scroll->box());
 	int oy = _tiles_scroll->y() + Fl::box_dy(_tiles_scroll->box());
-	int tw = tileset_width();
-	for (int i = 0; i < MAX_NUM_TILES; i++) {
-		int col = i % tw, row = i / tw;
-		int tx = ox + col * TILE_SIZE_2X, ty = oy + row * TILE_SIZE_2X;
-		Tile_Button *tb = new Tile_Button(tx, ty, row, col, (uint16_t)i);
-		tb->callback((Fl_Callback *)select_tile_cb, this);
-		_tile_buttons[i] = tb;
-	}
+	_tileset_canvas = new Tileset_Canvas(ox, oy);
+	_tileset_canvas->tiles(tileset_width(), {{0x000, MAX_NUM_TILES}});
+	_tileset_canvas->callback((Fl_Callback *)select_tile_cb, this);
 	_tiles_scroll->end();
 	_tiles_scroll->type(Fl_Scroll::VERTICAL_ALWAYS);
 	_tiles_scroll->resizable(NULL);
@@ -228,6 +222,8 @@ Main_Window::Main_Window(int x, int y, int w, int h, const char *) : Fl_Overlay_
 	_tilemap_name = new Label(gx, gy, gw, wgt_h);
 	wy += _tilemap_name->h() + wgt_m; wh -= _tilemap_name->h() + wgt_m;
 	_tilemap_scroll = new Workspace(wx, wy, ww, wh);
+	_tilemap_canvas = new Tilemap_Canvas(wx + Fl::box_dx(_tilemap_scroll->box()), wy + Fl::box_dy(_tilemap_scroll->box()), 0, 0);
+	_tilemap_canvas->callback((Fl_Callback *)change_tile_cb, this);
 	_tilemap_scroll->end();
 	_tilemap_scroll->resizable(NULL);
 	_right_group->resizable(_tilemap_scroll);
@@ -254,6 +250,7 @@ Main_Window::Main_Window(int x, int y, int w, int h, const char *) : Fl_Overlay_
 	_shift_dialog = new Shift_Dialog("Shift Tilemap");
 	_shift_tileset_dialog = new Shift_Tileset_Dialog("Shift Tileset");
 	_reformat_dialog = new Reformat_Dialog("Reformat Tilemap");
+	_export_options_dialog = new Export_Options_Dialog("Export Options");
 	_add_tileset_dialog = new Add_Tileset_Dialog("Add Tileset");
 	_image_to_tiles_dialog = new Image_To_Tiles_Dialog("Image to Tiles");
 	_help_window = new Help_Window(48, 48, 700, 500, PROGRAM_NAME " Help");
@@ -730,6 +727,7 @@ Main_Window::~Main_Window() {
 	delete _shift_dialog;
 	delete _shift_tileset_dialog;
 	delete _reformat_dialog;
+	delete _export_options_dialog;
 	delete _image_to_tiles_dialog;
 	delete _help_window;
 }
@@ -827,17 +825,22 @@ void Main_Window::apply_transparency() {
 
 void Main_Window::draw_overlay() {
 	if (!visible()) { return; }
-	if (!_selection.from_tileset() || !Config::show_attributes()) {
-		_selection.draw_selection_border_at();
-	}
-	if (!_selection.selecting()) {
-		Fl_Widget *wgt = Fl::belowmouse();
-		if (wgt && wgt->type() == Tile_Tessera::TILE_TESSERA_TYPE) {
-			Tile_Tessera *tt = _tilemap.tile(0);
-			fl_push_clip(tt->x(), tt->y(), _tilemap.width() * tt->w(), _tilemap.height() * tt->h());
-			_selection.draw_selection_border_at((Tile_Tessera *)wgt);
-			fl_pop_clip();
-		}
+	int s = TILE_SIZE * Config::zoom();
+	if (!_selection.from_tileset()) {
+		int sx = _tilemap_canvas->x() + (int)_selection.left_col() * s, sy = _tilemap_canvas->y() + (int)_selection.top_row() * s;
+		_selection.draw_selection_border_at(sx, sy, s, _tilemap_scroll);
+	}
+	else if (!Config::show_attributes()) {
+		Tileset_Canvas *tc = _tileset_canvas;
+		int sx = tc->x() + (int)_selection.left_col() * TILE_SIZE_2X, sy = tc->y() + (int)_selection.top_row() * TILE_SIZE_2X;
+		_selection.draw_selection_border_at(sx, sy, TILE_SIZE_2X, _tiles_scroll);
+	}
+	if (!_selection.selecting() && Fl::belowmouse() == _tilemap_canvas && _tilemap_canvas->hovering()) {
+		Tilemap_Canvas *tc = _tilemap_canvas;
+		int hx = tc->x() + (int)tc->hover_col() * s, hy = tc->y() + (int)tc->hover_row() * s;
+		fl_push_clip(tc->x(), tc->y(), tc->w(), tc->h());
+		_selection.draw_selection_border_at(hx, hy, s, _tilemap_scroll);
+		fl_pop_clip();
 	}
 }
 
@@ -994,7 +997,6 @@ void Main_Window::update_zoom(int old_zoom) {
 		_zoom_in_tb->activate();
 	}
 	_menu_bar->update();
-	Tile_State::update_zoom();
 	int px = _tilemap_scroll->xposition(), py = _tilemap_scroll->yposition();
 	tilemap_width_tb_cb(NULL, this);
 	int sx = px * Config::zoom() / old_zoom, sy = py * Config::zoom() / old_zoom;
@@ -1035,7 +1037,7 @@ void Main_Window::update_selection_controls() {
 	_menu_bar->update();
 }
 
-void Main_Window::update_status(Tile_Tessera *tt) {
+void Main_Window::update_status(const Tile_State *ts, size_t tx, size_t ty) {
 	if (!_tilemap.size()) {
 		_tilemap_dimensions->label("");
 		_hover_id->label("");
@@ -1047,29 +1049,30 @@ void Main_Window::update_status(Tile_Tessera *tt) {
 	char buffer[64] = {};
 	sprintf(buffer, "Tilemap: %zu x %zu", _tilemap.width(), _tilemap.height());
 	_tilemap_dimensions->copy_label(buffer);
-	if (!tt) {
+	if (!ts) {
 		_hover_id->label("");
 		_hover_xy->label("");
 		_hover_landmark->label("");
 		_status_bar->redraw();
 		return;
 	}
-	int bank = (int)(tt->id() >> 8), offset = (int)(tt->id() & 0xFF);
-	sprintf(buffer, "ID: $%d:%02X", bank, offset);
+	int bank = (int)(ts->id() >> 8), offset = (int)(ts->id() & 0xFF);
+	size_t uses = _tilemap.usage().count(ts->id());
+	sprintf(buffer, "ID: $%d:%02X (%zu use%s)", bank, offset, uses, uses == 1 ? "" : "s");
 	_hover_id->copy_label(buffer);
-	sprintf(buffer, "X/Y (%zu, %zu)", tt->col(), tt->row());
+	sprintf(buffer, "X/Y (%zu, %zu)", tx, ty);
 	_hover_xy->copy_label(buffer);
 	if (_tilemap.width() == GAME_BOY_WIDTH && _tilemap.height() == GAME_BOY_HEIGHT) {
 		if (format_has_landmarks(Config::format())) {
-			size_t lx = tt->col() * TILE_SIZE + TILE_SIZE / 2;
-			size_t ly = tt->row() * TILE_SIZE + TILE_SIZE / 2;
+			size_t lx = tx * TILE_SIZE + TILE_SIZE / 2;
+			size_t ly = ty * TILE_SIZE + TILE_SIZE / 2;
 			sprintf(buffer, "Landmark (%zu, %zu)", lx, ly);
 			_hover_landmark->copy_label(buffer);
 		}
 		else if (format_has_emaps(Config::format()) &&
-			tt->col() >= 2 && tt->col() <= 0xF + 2 &&
-			tt->row() >= 1 && tt->row() <= 0xF + 1) {
-			size_t lx = tt->col() - 2, ly = tt->row() - 1;
+			tx >= 2 && tx <= 0xF + 2 &&
+			ty >= 1 && ty <= 0xF + 1) {
+			size_t lx = tx - 2, ly = ty - 1;
 			sprintf(buffer, "Map (%zu, %zu)", lx, ly);
 			_hover_landmark->copy_label(buffer);
 		}
@@ -1082,6 +1085,25 @@ void Main_Window::update_status(Tile_Tessera *tt) {
 	}
 }
 
+void Main_Window::update_tilemap_structure(size_t w, size_t n, Tilemap_Format fmt) {
+	// Undoing or redoing a resize, shift, transpose, or reformat changes more than the tiles
+	if (_tilemap.width() != w || _tilemap.size() != n) {
+		if (_selection.selected_multiple() && !_selection.from_tileset()) {
+			select_tile(_selection.id());
+		}
+		_tilemap_width->default_value(_tilemap.width());
+		tilemap_width_tb_cb(NULL, this);
+		update_status(NULL);
+	}
+	if (Config::format() != fmt) {
+		if (_selection.selected_multiple() && _selection.from_tileset()) {
+			select_tile(_selection.id());
+		}
+		_tiles_scroll->scroll_to(0, 0);
+		update_tilemap_metadata();
+	}
+}
+
 void Main_Window::update_tilemap_metadata() {
 	if (_tilemap.size()) {
 		if (_tilemap_file.empty()) {
@@ -1246,16 +1268,9 @@ void Main_Window::update_active_controls() {
 	int n = format_tileset_size(Config::format());
 #pragma warning(suppress: 26812)
 	_tiles_scroll->type((uchar)(tileset_width() > DEFAULT_TILES_PER_ROW ? Fl_Scroll::BOTH_ALWAYS : Fl_Scroll::VERTICAL_ALWAYS));
-	while (_tiles_scroll->children()) {
-		_tiles_scroll->remove(0);
-	}
-	for (int i = Config::format() == Tilemap_Format::SW_TOWN_MAP ? 0x01 : 0x00; i < n; i++) {
-		_tiles_scroll->add(_tile_buttons[i]);
-	}
-	_tiles_scroll->add(_tiles_scroll->scrollbar);
-	_tiles_scroll->add(_tiles_scroll->hscrollbar);
+	_tileset_canvas->tiles(tileset_width(), {{Config::format() == Tilemap_Format::SW_TOWN_MAP ? 0x01 : 0x00, n}});
 	_tiles_scroll->init_sizes();
-	int tw = tileset_width() * TILE_SIZE_2X, max_th = ((n + tileset_width() - 1) / tileset_width()) * TILE_SIZE_2X;
+	int tw = _tileset_canvas->w(), max_th = _tileset_canvas->h();
 	_tiles_scroll->contents(tw, max_th);
 	if (!Config::show_attributes() && tile_id() >= n) {
 		select_tile(0x000);
@@ -1321,15 +1336,7 @@ void Main_Window::update_active_controls() {
 
 void Main_Window::update_tileset_width(int tw) {
 	_tileset_width = tw;
-	int ox = _tiles_scroll->x() + Fl::box_dx(_tiles_scroll->box());
-	int oy = _tiles_scroll->y() + Fl::box_dy(_tiles_scroll->box());
-	for (int i = 0; i < MAX_NUM_TILES; i++) {
-		int col = i % tw, row = i / tw;
-		int tx = ox + col * TILE_SIZE_2X, ty = oy + row * TILE_SIZE_2X;
-		Tile_Button *tb = _tile_buttons[i];
-		tb->position(tx, ty);
-		tb->coords((size_t)row, (size_t)col);
-	}
+	_tileset_canvas->columns(tw);
 }
 
 void Main_Window::resize_tilemap(size_t w, size_t h, int px, int py) {
@@ -1342,15 +1349,6 @@ void Main_Window::resize_tilemap(size_t w, size_t h, int px, int py) {
 
 	_tilemap.resize(w, h, px, py);
 
-	while (_tilemap_scroll->children() > 2) { // keep scrollbars
-		_tilemap_scroll->remove(0);
-	}
-	for (size_t i = 0; i < n; i++) {
-		Tile_Tessera *tt = _tilemap.tile(i);
-		tt->callback((Fl_Callback *)change_tile_cb, this);
-		_tilemap_scroll->add(tt);
-	}
-
 	_tilemap_width->default_value(w);
 	tilemap_width_tb_cb(NULL, this);
 	update_status(NULL);
@@ -1366,19 +1364,8 @@ void Main_Window::shift_tilemap() {
 		select_tile(_selection.id());
 	}
 
-	_tilemap.remember();
 	_tilemap.shift(dx, dy);
 
-	while (_tilemap_scroll->children() > 2) { // keep scrollbars
-		_tilemap_scroll->remove(0);
-	}
-	size_t n = _tilemap.size();
-	for (size_t i = 0; i < n; i++) {
-		Tile_Tessera *tt = _tilemap.tile(i);
-		tt->callback((Fl_Callback *)change_tile_cb, this);
-		_tilemap_scroll->add(tt);
-	}
-
 	tilemap_width_tb_cb(NULL, this);
 	update_status(NULL);
 	update_active_controls();
@@ -1392,6 +1379,7 @@ void Main_Window::shift_tileset() {
 	for (Tileset &t : _tilesets) {
 		t.shift(dn);
 	}
+	Tile_State::update_tilesets();
 
 	redraw();
 }
@@ -1405,16 +1393,6 @@ void Main_Window::transpose_tilemap() {
 
 	_tilemap.transpose();
 
-	while (_tilemap_scroll->children() > 2) { // keep scrollbars
-		_tilemap_scroll->remove(0);
-	}
-	size_t n = _tilemap.size();
-	for (size_t i = 0; i < n; i++) {
-		Tile_Tessera *tt = _tilemap.tile(i);
-		tt->callback((Fl_Callback *)change_tile_cb, this);
-		_tilemap_scroll->add(tt);
-	}
-
 	_tilemap_width->default_value(_tilemap.width());
 	tilemap_width_tb_cb(NULL, this);
 	update_status(NULL);
@@ -1439,7 +1417,6 @@ void Main_Window::reformat_tilemap() {
 		select_tile(_selection.id());
 	}
 
-	Config::format(fmt);
 	_tilemap.limit_to_format(fmt);
 
 	_tiles_scroll->scroll_to(0, 0);
@@ -1454,173 +1431,184 @@ void Main_Window::reformat_tilemap() {
 	_success_dialog->show(this);
 }
 
-void Main_Window::edit_tile(Tile_Tessera *tt) {
+void Main_Window::edit_tile(size_t tx, size_t ty) {
 	if (!_selection.selected_multiple()) {
-		Tile_State fs = tt->state();
+		Tile_State fs = _tilemap.state(tx, ty);
 		Tile_State ts(tile_id(), x_flip(), y_flip(), priority(), obp1(), palette());
 		bool a = Config::show_attributes();
 		if (fs.same(ts, a)) { return; }
-		tt->assign(ts, a);
-		tt->damage(1);
+		fs.assign(ts, a);
+		_tilemap.tile(tx, ty, fs);
+		_tilemap_canvas->damage_tile(ty, tx);
 		return;
 	}
 	bool a = Config::show_attributes();
-	size_t tx = tt->col(), ty = tt->row();
 	size_t ow = _selection.width(), oh = _selection.height();
 	size_t ox = _selection.left_col(), oy = _selection.top_row();
-	size_t mx = std::min(ow, _tilemap.width() - tx), my = std::min(oh, _tilemap.height() - ty);
+	size_t tw = _tilemap.width();
+	size_t mx = std::min(ow, tw - tx), my = std::min(oh, _tilemap.height() - ty);
 	if (_selection.from_tileset()) {
-		uint16_t n = (uint16_t)format_tileset_size(Config::format());
-		size_t tw = (size_t)tileset_width();
+		int n = format_tileset_size(Config::format());
 		for (size_t iy = 0; iy < my; iy++) {
 			size_t dy = y_flip() ? oh - iy - 1 : iy;
 			for (size_t ix = 0; ix < mx; ix++) {
 				size_t dx = x_flip() ? ow - ix - 1 : ix;
-				uint16_t id = (uint16_t)((oy + dy) * tw + ox + dx);
-				Tile_Tessera *tti = _tilemap.tile(tx+ix, ty+iy);
-				if (tti && id < n) {
-					Tile_State ts(id, x_flip(), y_flip(), priority(), obp1(), palette());
-					tti->assign(ts, a);
-					tti->damage(1);
+				int id = _tileset_canvas->cell_id(oy + dy, ox + dx);
+				if (_tilemap.has_tile(tx+ix, ty+iy) && id >= 0 && id < n) {
+					Tile_State fs = _tilemap.state(tx+ix, ty+iy);
+					Tile_State ts((uint16_t)id, x_flip(), y_flip(), priority(), obp1(), palette());
+					fs.assign(ts, a);
+					_tilemap.tile(tx+ix, ty+iy, fs);
+					_tilemap_canvas->damage_tile(ty+iy, tx+ix);
 				}
 			}
 		}
 	}
 	else {
-		const Tilemap_State &tms = _tilemap.last_state();
 		size_t n = _tilemap.size();
-		size_t tw = _tilemap.width();
 		for (size_t iy = 0; iy < my; iy++) {
 			size_t dy = y_flip() ? oh - iy - 1 : iy;
 			for (size_t ix = 0; ix < mx; ix++) {
 				size_t dx = x_flip() ? ow - ix - 1 : ix;
 				size_t index = (oy + dy) * tw + ox + dx;
-				Tile_Tessera *tti = _tilemap.tile(tx+ix, ty+iy);
-				if (tti && index < n) {
-					const Tile_State &ps = tms.state(index);
-					Tile_State ts(ps.id, x_flip() != ps.x_flip, y_flip() != ps.y_flip, ps.priority, ps.obp1, ps.palette);
-					tti->replace(ts, a);
-					tti->damage(1);
+				if (_tilemap.has_tile(tx+ix, ty+iy) && index < n) {
+					// Copy from the tiles as they were before this edit, in case the paste overlaps them
+					const Tile_State &ps = _tilemap.previous_state(index);
+					Tile_State ts = ps;
+					ts.flip(flip_bits());
+					Tile_State fs = _tilemap.state(tx+ix, ty+iy);
+					fs.replace(ts, a);
+					_tilemap.tile(tx+ix, ty+iy, fs);
+					_tilemap_canvas->damage_tile(ty+iy, tx+ix);
 				}
 			}
 		}
 	}
 }
 
-void Main_Window::flood_fill(Tile_Tessera *tt) {
-	Tile_State fs = tt->state();
+void Main_Window::flood_fill(size_t tx, size_t ty) {
+	Tile_State fs = _tilemap.state(tx, ty);
 	Tile_State ts(tile_id(), x_flip(), y_flip(), priority(), obp1(), palette());
 	bool a = Config::show_attributes();
 	bool mf = _selection.selected_multiple() && !(a && _selection.from_tileset());
 	if (!mf && fs.same(ts, a)) { return; }
-	size_t w = _tilemap.width(), h = _tilemap.height(), n = _tilemap.size();
-	std::vector<bool> filled(n, false);
-	std::queue<size_t> queue;
-	size_t row = tt->row(), col = tt->col();
-	queue.push(row * w + col);
-	while (!queue.empty()) {
-		size_t i = queue.front();
-		queue.pop();
-		if (i >= n) { continue; }
-		Tile_Tessera *ff = _tilemap.tile(i);
-		size_t r = ff->row(), c = ff->col();
-		if (!ff->state().same(fs, a) || filled[i]) { continue; }
-		if (!mf) { ff->assign(ts, a); } // fill
-		filled[i] = true;
-		if (c > 0) { queue.push(i-1); } // left
-		if (c < w - 1) { queue.push(i+1); } // right
-		if (r > 0) { queue.push(i-w); } // up
-		if (r < h - 1) { queue.push(i+w); } // down
-	}
-	if (mf) {
-		bool fts = _selection.from_tileset();
-		size_t ow = _selection.width(), oh = _selection.height();
-		size_t ox = _selection.left_col(), oy = _selection.top_row();
-		size_t tw = fts ? (size_t)tileset_width() : _tilemap.width();
-		size_t tn = (size_t)format_tileset_size(Config::format());
-		const Tilemap_State &tms = _tilemap.last_state();
-		for (size_t i = 0; i < n; i++) {
-			if (!filled[i]) { continue; }
-			Tile_Tessera *tti = _tilemap.tile(i);
-			size_t ix = tti->col();
-			while (ix < col) { ix += ow; }
-			ix = (ix - col) % ow;
-			size_t iy = tti->row();
-			while (iy < row) { iy += oh; }
-			iy = (iy - row) % oh;
+	size_t w = _tilemap.width(), n = _tilemap.size();
+	bool fts = _selection.from_tileset();
+	size_t ow = _selection.width(), oh = _selection.height();
+	size_t ox = _selection.left_col(), oy = _selection.top_row();
+	int tn = format_tileset_size(Config::format());
+	// The pattern repeats from the clicked tile, so tile (x, y) uses column (x + px) % ow and row (y + py) % oh
+	size_t px = ow - tx % ow, py = oh - ty % oh;
+	auto fill = [&](size_t i) {
+		Tile_State ps = ts;
+		if (mf) {
+			size_t ix = (i % w + px) % ow, iy = (i / w + py) % oh;
 			size_t dx = x_flip() ? ow - ix - 1 : ix;
 			size_t dy = y_flip() ? oh - iy - 1 : iy;
-			size_t index = (oy + dy) * tw + ox + dx;
-			if (index >= (fts ? tn : n)) { continue; }
 			if (fts) {
-				ts.id = (uint16_t)index;
+				int id = _tileset_canvas->cell_id(oy + dy, ox + dx);
+				if (id < 0 || id >= tn) { return; }
+				ps.id((uint16_t)id);
 			}
 			else {
-				ts = tms.state(index);
+				size_t index = (oy + dy) * w + ox + dx;
+				if (index >= n) { return; }
+				ps = _tilemap.previous_state(index);
 				if (!a) {
-					if (x_flip()) { ts.x_flip = !ts.x_flip; }
-					if (y_flip()) { ts.y_flip = !ts.y_flip; }
+					ps.flip(flip_bits());
 				}
 				else {
-					if (priority()) { ts.priority = true; }
-					if (obp1()) { ts.obp1 = true; }
+					if (priority()) { ps.priority(true); }
+					if (obp1()) { ps.obp1(true); }
 				}
 			}
-			tti->assign(ts, a);
 		}
+		Tile_State ff = _tilemap.state(i);
+		ff.assign(ps, a);
+		_tilemap.tile(i, ff);
+	};
+	// Scanline fill: each seed grows into a horizontal span, which seeds the runs of matching tiles above and below it
+	std::vector<bool> filled(n, false);
+	auto fillable = [&](size_t i) { return !filled[i] && _tilemap.state(i).same(fs, a); };
+	std::vector<size_t> seeds;
+	auto seed_runs = [&](size_t l, size_t r) {
+		bool in_run = false;
+		for (size_t i = l; i < r; i++) {
+			bool f = fillable(i);
+			if (f && !in_run) { seeds.push_back(i); }
+			in_run = f;
+		}
+	};
+	seeds.push_back(ty * w + tx);
+	while (!seeds.empty()) {
+		size_t i = seeds.back();
+		seeds.pop_back();
+		if (!fillable(i)) { continue; }
+		size_t row_start = i - i % w, row_end = std::min(row_start + w, n);
+		size_t l = i, r = i + 1;
+		while (l > row_start && fillable(l - 1)) { l--; }
+		while (r < row_end && fillable(r)) { r++; }
+		for (size_t j = l; j < r; j++) {
+			filled[j] = true;
+			fill(j);
+		}
+		if (row_start > 0) { seed_runs(l - w, r - w); } // up
+		if (l + w < n) { seed_runs(l + w, std::min(r + w, n)); } // down
 	}
 }
 
-void Main_Window::substitute_tile(Tile_Tessera *tt) {
-	Tile_State fs = tt->state();
+void Main_Window::substitute_tile(size_t tx, size_t ty) {
+	Tile_State fs = _tilemap.state(tx, ty);
 	Tile_State ts(tile_id(), x_flip(), y_flip(), priority(), obp1(), palette());
 	bool a = Config::show_attributes();
-	size_t n = _tilemap.size();
-	for (size_t i = 0; i < n; i++) {
-		Tile_Tessera *ff = _tilemap.tile(i);
-		if (ff->state().same(fs, a)) {
-			ff->assign(ts, a);
-			ff->damage(1);
-		}
+	std::vector<uint32_t> indexes;
+	_tilemap.find_tiles(fs, a, indexes);
+	for (uint32_t i : indexes) {
+		Tile_State ff = _tilemap.state(i);
+		ff.assign(ts, a);
+		_tilemap.tile(i, ff);
 	}
 }
 
-void Main_Window::swap_tiles(Tile_Tessera *tt) {
-	Tile_State fs = tt->state();
+void Main_Window::swap_tiles(size_t tx, size_t ty) {
+	Tile_State fs = _tilemap.state(tx, ty);
 	Tile_State ts(tile_id(), x_flip(), y_flip(), priority(), obp1(), palette());
 	bool a = Config::show_attributes();
 	if (fs.same(ts, a)) { return; }
-	size_t n = _tilemap.size();
-	for (size_t i = 0; i < n; i++) {
-		Tile_Tessera *ff = _tilemap.tile(i);
-		if (ff->state().same(fs, a)) {
-			ff->assign(ts, a);
-			ff->damage(1);
-		}
-		else if (ff->state().same(ts, a)) {
-			ff->assign(fs, a);
-			ff->damage(1);
-		}
+	// Find both sets of tiles before changing either
+	std::vector<uint32_t> from_indexes, to_indexes;
+	_tilemap.find_tiles(fs, a, from_indexes);
+	_tilemap.find_tiles(ts, a, to_indexes);
+	for (uint32_t i : from_indexes) {
+		Tile_State ff = _tilemap.state(i);
+		ff.assign(ts, a);
+		_tilemap.tile(i, ff);
+	}
+	for (uint32_t i : to_indexes) {
+		Tile_State ff = _tilemap.state(i);
+		ff.assign(fs, a);
+		_tilemap.tile(i, ff);
 	}
 }
 
 void Main_Window::erase_selection() {
 	if (!_selection.selected_multiple() || _selection.from_tileset()) { return; }
 	Tile_State ts;
-	ts.palette = format_can_edit_palettes(Config::format()) ? 0 : -1;
+	ts.palette(format_can_edit_palettes(Config::format()) ? 0 : -1);
 	bool a = Config::show_attributes();
 	_tilemap.remember();
 	size_t ox = _selection.left_col(), oy = _selection.top_row();
 	size_t mx = ox + _selection.width(), my = oy + _selection.height();
 	for (size_t y = oy; y < my; y++) {
 		for (size_t x = ox; x < mx; x++) {
-			Tile_Tessera *tt = _tilemap.tile(x, y);
-			if (!tt) { continue; }
-			tt->replace(ts, a);
-			tt->damage(1);
+			if (!_tilemap.has_tile(x, y)) { continue; }
+			Tile_State fs = _tilemap.state(x, y);
+			fs.replace(ts, a);
+			_tilemap.tile(x, y, fs);
 		}
 	}
 	_tilemap.modified(true);
+	_tilemap_scroll->redraw();
 	update_active_controls();
 }
 
@@ -1633,21 +1621,22 @@ void Main_Window::x_flip_selection() {
 	size_t ow = _selection.width(), my = oy + _selection.height();
 	for (size_t y = oy; y < my; y++) {
 		for (size_t i = 0; i < (ow + 1) / 2; i++) {
-			Tile_Tessera *tt1 = _tilemap.tile(ox+i, y);
-			Tile_Tessera *tt2 = _tilemap.tile(ox+ow-i-1, y);
-			if (!tt1 || !tt2) { continue; }
-			Tile_State ts1 = tt1->state(), ts2 = tt2->state();
+			size_t x1 = ox+i, x2 = ox+ow-i-1;
+			if (!_tilemap.has_tile(x1, y) || !_tilemap.has_tile(x2, y)) { continue; }
+			Tile_State ts1 = _tilemap.state(x1, y), ts2 = _tilemap.state(x2, y);
+			Tile_State fs1 = ts1, fs2 = ts2;
 			if (f) {
-				ts1.x_flip = !ts1.x_flip;
-				ts2.x_flip = !ts2.x_flip;
+				fs1.flip(Tile_State::X_FLIP_BIT);
+				fs2.flip(Tile_State::X_FLIP_BIT);
 			}
-			tt1->replace(ts2, a);
-			tt2->replace(ts1, a);
-			tt1->damage(1);
-			tt2->damage(1);
+			ts1.replace(fs2, a);
+			ts2.replace(fs1, a);
+			_tilemap.tile(x1, y, ts1);
+			_tilemap.tile(x2, y, ts2);
 		}
 	}
 	_tilemap.modified(true);
+	_tilemap_scroll->redraw();
 	update_active_controls();
 }
 
@@ -1660,21 +1649,22 @@ void Main_Window::y_flip_selection() {
 	size_t mx = ox + _selection.width(), oh = _selection.height();
 	for (size_t x = ox; x < mx; x++) {
 		for (size_t i = 0; i < (oh + 1) / 2; i++) {
-			Tile_Tessera *tt1 = _tilemap.tile(x, oy+i);
-			Tile_Tessera *tt2 = _tilemap.tile(x, oy+oh-i-1);
-			if (!tt1 || !tt2) { continue; }
-			Tile_State ts1 = tt1->state(), ts2 = tt2->state();
+			size_t y1 = oy+i, y2 = oy+oh-i-1;
+			if (!_tilemap.has_tile(x, y1) || !_tilemap.has_tile(x, y2)) { continue; }
+			Tile_State ts1 = _tilemap.state(x, y1), ts2 = _tilemap.state(x, y2);
+			Tile_State fs1 = ts1, fs2 = ts2;
 			if (f) {
-				ts1.y_flip = !ts1.y_flip;
-				ts2.y_flip = !ts2.y_flip;
+				fs1.flip(Tile_State::Y_FLIP_BIT);
+				fs2.flip(Tile_State::Y_FLIP_BIT);
 			}
-			tt1->replace(ts2, a);
-			tt2->replace(ts1, a);
-			tt1->damage(1);
-			tt2->damage(1);
+			ts1.replace(fs2, a);
+			ts2.replace(fs1, a);
+			_tilemap.tile(x, y1, ts1);
+			_tilemap.tile(x, y2, ts2);
 		}
 	}
 	_tilemap.modified(true);
+	_tilemap_scroll->redraw();
 	update_active_controls();
 }
 
@@ -1685,10 +1675,12 @@ void Main_Window::copy_selection() const {
 	Fl_Copy_Surface *surface = new Fl_Copy_Surface(w * TILE_SIZE * z, h * TILE_SIZE * z);
 	surface->set_current();
 	size_t ox = _selection.left_col(), oy = _selection.top_row();
+	size_t tw = _tilemap.width(), n = _tilemap.size();
 	for (size_t dy = 0; dy < h; dy++) {
 		for (size_t dx = 0; dx < w; dx++) {
-			if (Tile_Tessera *tt = _tilemap.tile(ox + dx, oy + dy); tt) {
-				surface->draw(tt, dx * TILE_SIZE * z, dy * TILE_SIZE * z);
+			size_t tx = ox + dx, i = (oy + dy) * tw + tx;
+			if (tx < tw && i < n) {
+				_tilemap_canvas->draw_tile(_tilemap.state(i), (int)dx * TILE_SIZE * z, (int)dy * TILE_SIZE * z, false);
 			}
 		}
 	}
@@ -1697,12 +1689,12 @@ void Main_Window::copy_selection() const {
 }
 
 void Main_Window::select_all() {
-	Tile_Tessera *tt1 = _tilemap.tile(_tilemap.width() - 1, 0);
-	Tile_Tessera *tt2 = _tilemap.tile(0, _tilemap.height() - 1);
-	if (!tt1 || !tt2 || tt1 == tt2) { return; }
-	_selection.start_selecting(tt1);
-	_selection.continue_selecting(tt2);
+	size_t w = _tilemap.width(), h = _tilemap.height();
+	if (!w || (w == 1 && h == 1)) { return; }
+	_selection.start_selecting(0, w - 1, _tilemap.state(w - 1, 0).id(), false);
+	_selection.continue_selecting(h - 1, 0);
 	_selection.finish_selecting();
+	_tilemap_canvas->redraw();
 	update_selection_status();
 	update_selection_controls();
 	redraw_overlay();
@@ -1768,13 +1760,6 @@ void Main_Window::setup_tilemap(const char *basename, int old_tileset_size, cons
 		select_tile(_selection.id());
 	}
 
-	size_t n = _tilemap.size();
-	for (size_t i = 0; i < n; i++) {
-		Tile_Tessera *tt = _tilemap.tile(i);
-		tt->callback((Fl_Callback *)change_tile_cb, this);
-		_tilemap_scroll->add(tt);
-	}
-
 	_tilemap_width->default_value(_tilemap.width());
 	tilemap_width_tb_cb(NULL, this);
 
@@ -1820,9 +1805,9 @@ void Main_Window::save_tilemap(bool force) {
 	const char *basename = fl_filename_name(filename);
 
 	if (_tilemap.modified() || force) {
-		if (!_tilemap.write_tiles(filename, attrmap_filename, Config::format())) {
-			std::string msg = "Could not write to ";
-			msg = msg + basename + "!";
+		Tilemap::Write_Result written = _tilemap.write_tiles(filename, attrmap_filename, Config::format());
+		if (written != Tilemap::Write_Result::WRITE_OK) {
+			std::string msg = Tilemap::write_error_message(written, filename, attrmap_filename);
 			_error_dialog->message(msg);
 			_error_dialog->show(this);
 			return;
@@ -1876,12 +1861,17 @@ void Main_Window::import_tilemap(const char *filename) {
 	_tilemap_file.clear();
 	_attrmap_file.clear();
 
-	Tilemap::Result result = _tilemap.import_tiles(filename, attrmap_filename);
+	Import_Options options = {_tilemap_options_dialog->words(), _tilemap_options_dialog->big_endian()};
+	Tilemap::Result result = _tilemap.import_tiles(filename, attrmap_filename, options);
 	if (result != Tilemap::Result::TILEMAP_OK) {
 		_tilemap.clear();
 		std::string msg = "Error reading ";
 		msg = msg + (result >= Tilemap::Result::ATTRMAP_BAD_FILE ? attrmap_basename : basename);
 		msg = msg + "!\n\n" + Tilemap::error_message(result);
+		if (_tilemap.error_line()) {
+			msg = msg + "\n(Line " + std::to_string(_tilemap.error_line()) + ", column " +
+				std::to_string(_tilemap.error_column()) + ")";
+		}
 		_error_dialog->message(msg);
 		_error_dialog->show(this);
 		return;
@@ -1892,7 +1882,8 @@ void Main_Window::import_tilemap(const char *filename) {
 
 void Main_Window::export_tilemap(const char *filename) {
 	const char *basename = fl_filename_name(filename);
-	if (_tilemap.export_tiles(filename)) {
+	Export_Options options = {_export_options_dialog->words(), _export_options_dialog->values_per_line()};
+	if (_tilemap.export_tiles(filename, options)) {
 		std::string msg = "Exported ";
 		msg = msg + basename + "!";
 		_success_dialog->message(msg);
@@ -1923,6 +1914,7 @@ void Main_Window::add_tileset(const char *filename, int start, int offset, int l
 	}
 	_tilesets.push_back(tileset);
 	_tileset_files.push_back(filename);
+	Tile_State::update_tilesets();
 	store_recent_tileset();
 	update_tileset_metadata();
 	update_active_controls();
@@ -2038,10 +2030,13 @@ void Main_Window::drag_and_drop_tilemap(const char *filename) {
 }
 
 void Main_Window::select_tile(uint16_t id) {
-	_selection.select_single(_tile_buttons[id]);
+	size_t row = 0, col = 0;
+	_tileset_canvas->id_cell(id, row, col);
+	_selection.select_single(row, col, id);
+	_tileset_canvas->selected_id(id);
 	_current_tile->id(id);
 
-	int ds = (int)(id / tileset_width()) * TILE_SIZE_2X;
+	int ds = (int)row * TILE_SIZE_2X;
 	if (ds >= _tiles_scroll->yposition() + _tiles_scroll->h() - TILE_SIZE_2X / 2) {
 		_tiles_scroll->scroll_to(0, ds + TILE_SIZE_2X - _tiles_scroll->h() + Fl::box_dh(_tiles_scroll->box()));
 	}
@@ -2057,14 +2052,31 @@ void Main_Window::select_tile(uint16_t id) {
 }
 
 void Main_Window::highlight_tile(uint16_t id) {
-	Config::highlight_id(Config::highlight_id() != id ? id : (uint16_t)-1);
-	_tilemap_scroll->redraw();
+	uint16_t old_id = Config::highlight_id();
+	Config::highlight_id(old_id != id ? id : (uint16_t)-1);
+	// Only the tiles gaining or losing the highlight need drawing, unless there are too many to track
+	const Tile_Usage &usage = _tilemap.usage();
+	size_t n = usage.count(id) + (old_id != id ? usage.count(old_id) : 0);
+	if (n > MAX_HIGHLIGHT_DAMAGE) {
+		_tilemap_scroll->redraw();
+	}
+	else {
+		size_t w = _tilemap.width();
+		for (uint32_t i : usage.uses(id)) { _tilemap_canvas->damage_tile(i / w, i % w); }
+		if (old_id != id) {
+			for (uint32_t i : usage.uses(old_id)) { _tilemap_canvas->damage_tile(i / w, i % w); }
+		}
+	}
 	_tiles_tab->redraw();
 }
 
 void Main_Window::select_palette(int palette) {
 	if (!_selection.from_tileset()) {
-		_selection.select_single(_tile_buttons[tile_id()]);
+		uint16_t id = tile_id();
+		size_t row = 0, col = 0;
+		_tileset_canvas->id_cell(id, row, col);
+		_selection.select_single(row, col, id);
+		_tileset_canvas->selected_id(id);
 	}
 
 	if (_selected_palette) {
@@ -2181,7 +2193,7 @@ void Main_Window::close_cb(Fl_Widget *, Main_Window *mw) {
 		mw->select_tile(mw->_selection.id());
 	}
 	mw->_tilemap.clear();
-	mw->_tilemap_scroll->clear();
+	mw->_tilemap_canvas->size(0, 0);
 	mw->_tilemap_scroll->scroll_to(0, 0);
 	mw->_tilemap_scroll->contents(0, 0);
 	mw->_tiles_scroll->scroll_to(0, 0);
@@ -2281,6 +2293,10 @@ void Main_Window::export_cb(Fl_Widget *, Main_Window *mw) {
 		return;
 	}
 
+	mw->_export_options_dialog->limit_options(Config::format());
+	mw->_export_options_dialog->show(mw);
+	if (mw->_export_options_dialog->canceled()) { return; }
+
 	mw->export_tilemap(filename);
 }
 
@@ -2341,11 +2357,14 @@ void Main_Window::reload_tilesets_cb(Fl_Widget *, Main_Window *mw) {
 	std::vector<std::string> tileset_files(mw->_tileset_files);
 	mw->_tilesets.clear();
 	mw->_tileset_files.clear();
+	Tile_State::update_tilesets();
 	size_t n = tilesets.size();
 	for (size_t i = 0; i < n; i++) {
 		const char *filename = tileset_files[i].c_str();
 		Tileset &t = tilesets[i];
-		mw->add_tileset(filename, t.start_id(), t.offset(), t.length());
+		int start = t.start_id(), offset = t.offset(), length = t.length();
+		t.clear();
+		mw->add_tileset(filename, start, offset, length);
 	}
 }
 
@@ -2528,14 +2547,20 @@ void Main_Window::exit_cb(Fl_Widget *, Main_Window *mw) {
 
 void Main_Window::undo_cb(Fl_Widget *, Main_Window *mw) {
 	if (!mw->_tilemap.size()) { return; }
+	size_t w = mw->_tilemap.width(), n = mw->_tilemap.size();
+	Tilemap_Format fmt = Config::format();
 	mw->_tilemap.undo();
+	mw->update_tilemap_structure(w, n, fmt);
 	mw->update_active_controls();
 	mw->redraw();
 }
 
 void Main_Window::redo_cb(Fl_Widget *, Main_Window *mw) {
 	if (!mw->_tilemap.size()) { return; }
+	size_t w = mw->_tilemap.width(), n = mw->_tilemap.size();
+	Tilemap_Format fmt = Config::format();
 	mw->_tilemap.redo();
+	mw->update_tilemap_structure(w, n, fmt);
 	mw->update_active_controls();
 	mw->redraw();
 }
@@ -2747,10 +2772,6 @@ void Main_Window::tilemap_width_cb(Fl_Menu_ *, Main_Window *mw) {
 
 void Main_Window::crop_to_selection_cb(Fl_Menu_ *, Main_Window *mw) {
 	if (!mw->_selection.selected_multiple() || mw->_selection.from_tileset()) { return; }
-	mw->_unsaved_dialog->message("Resizing the tilemap cannot be undone!\n\nCrop to selection anyway?");
-	mw->_unsaved_dialog->show(mw);
-	if (mw->_unsaved_dialog->canceled()) { return; }
-
 	size_t rw = mw->_selection.width(), rh = mw->_selection.height();
 	int px = 0 - mw->_selection.left_col(), py = 0 - mw->_selection.top_row();
 
@@ -2803,9 +2824,6 @@ void Main_Window::shift_cb(Fl_Menu_ *, Main_Window *mw) {
 
 void Main_Window::transpose_cb(Fl_Menu_ *, Main_Window *mw) {
 	if (!mw->_tilemap.size()) { return; }
-	mw->_unsaved_dialog->message("Transposing the tilemap cannot be undone!\n\nTranspose it anyway?");
-	mw->_unsaved_dialog->show(mw);
-	if (mw->_unsaved_dialog->canceled()) { return; }
 	mw->transpose_tilemap();
 }
 
@@ -2887,7 +2905,7 @@ void Main_Window::tilemap_width_tb_cb(OS_Spinner *, Main_Window *mw) {
 	int ch = (int)mw->_tilemap.height() * TILE_SIZE * Config::zoom();
 	mw->_tilemap_scroll->contents(cw, ch);
 	mw->_tilemap_scroll->scroll_to(0, 0);
-	mw->_tilemap.reposition_tiles(sx, sy);
+	mw->_tilemap_canvas->resize(sx, sy, cw, ch);
 	mw->_tilemap_scroll->redraw();
 	if (mw->_tilemap.is_rectangular()) {
 		mw->_shift_mi->activate();
@@ -2934,14 +2952,14 @@ void Main_Window::change_tab_cb(OS_Tabs *, Main_Window *mw) {
 	mw->redraw();
 }
 
-void Main_Window::select_tile_cb(Tile_Button *tb, Main_Window *mw) {
+void Main_Window::select_tile_cb(Tileset_Canvas *tc, Main_Window *mw) {
 	if (Fl::event_button() == FL_LEFT_MOUSE) {
 		// Left-click to select
-		mw->select_tile(tb->id());
+		mw->select_tile(tc->id());
 	}
 	else if (Fl::event_button() == FL_RIGHT_MOUSE) {
 		// Right-click to highlight
-		mw->highlight_tile(tb->id());
+		mw->highlight_tile(tc->id());
 	}
 }
 
@@ -2952,7 +2970,8 @@ void Main_Window::select_palette_cb(Palette_Button *pb, Main_Window *mw) {
 	}
 }
 
-void Main_Window::change_tile_cb(Tile_Tessera *tt, Main_Window *mw) {
+void Main_Window::change_tile_cb(Tilemap_Canvas *tc, Main_Window *mw) {
+	size_t tx = tc->col(), ty = tc->row();
 	if (!mw->_map_editable) { return; }
 	if (Fl::event_button() == FL_LEFT_MOUSE) {
 		if (!mw->_selection.selected()) { return; }
@@ -2962,50 +2981,51 @@ void Main_Window::change_tile_cb(Tile_Tessera *tt, Main_Window *mw) {
 		}
 		if (Fl::event_shift()) {
 			// Shift+left-click to flood fill
-			mw->flood_fill(tt);
+			mw->flood_fill(tx, ty);
 			mw->_tilemap_scroll->redraw();
 		}
 		else if (Fl::event_ctrl()) {
 			// Ctrl+left-click to replace
-			mw->substitute_tile(tt);
+			mw->substitute_tile(tx, ty);
 			mw->_tilemap_scroll->redraw();
 		}
 		else if (Fl::event_alt()) {
 			// Alt+click to swap
-			mw->swap_tiles(tt);
+			mw->swap_tiles(tx, ty);
 			mw->_tilemap_scroll->redraw();
 		}
 		else {
 			// Left-click/drag to edit
-			mw->edit_tile(tt);
+			mw->edit_tile(tx, ty);
 		}
 		mw->_tilemap.modified(true);
 	}
 	else if (Fl::event_button() == FL_RIGHT_MOUSE) {
 		// Right-click to select
+		const Tile_State &ts = mw->_tilemap.state(tx, ty);
 		if (Config::show_attributes()) {
-			mw->_priority_tb->value(tt->priority());
+			mw->_priority_tb->value(ts.priority());
 			mw->_priority_tb->do_callback();
-			mw->_obp1_tb->value(tt->obp1());
+			mw->_obp1_tb->value(ts.obp1());
 			mw->_obp1_tb->do_callback();
 			mw->_priority_tb->redraw();
 			mw->_obp1_tb->redraw();
-			mw->select_tile(tt->id());
-			mw->select_palette(tt->palette());
+			mw->select_tile(ts.id());
+			mw->select_palette(ts.palette());
 		}
 		else {
-			mw->_x_flip_tb->value(tt->x_flip());
+			mw->_x_flip_tb->value(ts.x_flip());
 			mw->_x_flip_tb->do_callback();
-			mw->_y_flip_tb->value(tt->y_flip());
+			mw->_y_flip_tb->value(ts.y_flip());
 			mw->_y_flip_tb->do_callback();
 			mw->_x_flip_tb->redraw();
 			mw->_y_flip_tb->redraw();
 			if (mw->_palettes_tab->active()) {
-				mw->select_palette(tt->palette());
+				mw->select_palette(ts.palette());
 			}
-			mw->select_tile(tt->id());
+			mw->select_tile(ts.id());
 		}
-		tt->redraw();
+		tc->damage_tile(ty, tx);
 	}
 }
 
@@ -26,6 +26,8 @@
 
 #define NUM_RECENT 10
 
+#define MAX_HIGHLIGHT_DAMAGE 1024
+
 struct Image_to_Tiles_Result {
 	const char *tilemap_filename;
 	const char *attrmap_filename;
@@ -46,8 +48,10 @@ private:
 	OS_Tabs *_left_tabs;
 	OS_Tab *_tiles_tab, *_palettes_tab;
 	Workspace *_tiles_scroll;
+	Tileset_Canvas *_tileset_canvas;
 	Workpane *_palettes_pane;
 	Workspace *_tilemap_scroll;
+	Tilemap_Canvas *_tilemap_canvas;
 	Toolbar *_status_bar;
 	// GUI inputs
 	DnD_Receiver *_tilemap_dnd_receiver, *_tileset_dnd_receiver;
@@ -65,7 +69,6 @@ private:
 	Toolbar_Button *_tileset_width_tb, *_shift_tileset_tb;
 	Toolbar_Button *_image_to_tiles_tb;
 	Toolbar_Toggle_Button *_x_flip_tb, *_y_flip_tb, *_priority_tb, *_obp1_tb;
-	Tile_Button *_tile_buttons[MAX_NUM_TILES];
 	Palette_Button *_palette_buttons[MAX_NUM_PALETTES];
 	Default_Slider *_transparency;
 	// GUI outputs
@@ -94,6 +97,7 @@ private:
 	Shift_Dialog *_shift_dialog;
 	Shift_Tileset_Dialog *_shift_tileset_dialog;
 	Reformat_Dialog *_reformat_dialog;
+	Export_Options_Dialog *_export_options_dialog;
 	Add_Tileset_Dialog *_add_tileset_dialog;
 	Image_To_Tiles_Dialog *_image_to_tiles_dialog;
 	Help_Window *_help_window;
@@ -127,11 +131,15 @@ public:
 	inline uint16_t tile_id(void) const { return _selection.selected() ? _selection.id() : 0x000; }
 	inline bool x_flip(void) const { return _x_flip_tb->active() && !!_x_flip_tb->value(); }
 	inline bool y_flip(void) const { return _y_flip_tb->active() && !!_y_flip_tb->value(); }
+	inline uint32_t flip_bits(void) const {
+		return (x_flip() ? Tile_State::X_FLIP_BIT : 0) | (y_flip() ? Tile_State::Y_FLIP_BIT : 0);
+	}
 	inline int palette(void) const { return _selected_palette && Config::show_attributes() ? (int)_selected_palette->palette() : -1; }
 	inline bool priority(void) const { return _priority_tb->visible() && !!_priority_tb->value(); }
 	inline bool obp1(void) const { return _obp1_tb->visible() && !!_obp1_tb->value(); }
 	inline int tileset_width(void) const { return _tileset_width; }
 	inline Tile_Selection &selection(void) { return _selection; }
+	inline const Tilemap &tilemap(void) const { return _tilemap; }
 	inline const char *modified_filename(void) const {
 		return unsaved() ? _tilemap_file.empty() ? _tilemap_basename.c_str() : fl_filename_name(_tilemap_file.c_str()) : "";
 	}
@@ -145,11 +153,11 @@ public:
 	void update_zoom(int old_zoom);
 	void update_selection_status(void);
 	void update_selection_controls(void);
-	void update_status(Tile_Tessera *tt);
-	void edit_tile(Tile_Tessera *tt);
-	void flood_fill(Tile_Tessera *tt);
-	void substitute_tile(Tile_Tessera *tt);
-	void swap_tiles(Tile_Tessera *tt);
+	void update_status(const Tile_State *ts, size_t tx = 0, size_t ty = 0);
+	void edit_tile(size_t tx, size_t ty);
+	void flood_fill(size_t tx, size_t ty);
+	void substitute_tile(size_t tx, size_t ty);
+	void swap_tiles(size_t tx, size_t ty);
 	void erase_selection(void);
 	void x_flip_selection(void);
 	void y_flip_selection(void);
@@ -162,7 +170,8 @@ public:
 		unload_tilesets_cb(NULL, this); add_tileset(filename, 0x000, 0, 0, warn);
 	}
 	inline void unload_tilesets(void) {
-		for (Tileset &t : _tilesets) { t.clear(); } _tilesets.clear(); _tileset_files.clear(); update_tileset_metadata();
+		for (Tileset &t : _tilesets) { t.clear(); } _tilesets.clear(); _tileset_files.clear();
+		Tile_State::update_tilesets(); update_tileset_metadata();
 	}
 	void add_tileset(const char *filename, int start = 0x000, int offset = 0, int length = 0, bool quiet = false);
 	void load_recent_tileset(int n);
@@ -176,6 +185,7 @@ private:
 	void store_recent_tileset(void);
 	void update_recent_tilesets(void);
 	void update_tilemap_metadata(void);
+	void update_tilemap_structure(size_t w, size_t n, Tilemap_Format fmt);
 	void update_tileset_metadata(void);
 	void update_active_controls(void);
 	void update_tileset_width(int tw);
@@ -272,10 +282,10 @@ private:
 	static void transparency_cb(Default_Slider *ds, Main_Window *mw);
 	// Tileset
 	static void change_tab_cb(OS_Tabs *ts, Main_Window *mw);
-	static void select_tile_cb(Tile_Button *tb, Main_Window *mw);
+	static void select_tile_cb(Tileset_Canvas *tc, Main_Window *mw);
 	static void select_palette_cb(Palette_Button *pb, Main_Window *mw);
 	// Tilemap
-	static void change_tile_cb(Tile_Tessera *tt, Main_Window *mw);
+	static void change_tile_cb(Tilemap_Canvas *tc, Main_Window *mw);
 };
 
 #endif
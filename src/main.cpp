@@ -11,6 +11,7 @@
 #include "preferences.h"
 #include "themes.h"
 #include "main-window.h"
+#include "cli.h"
 
 #ifdef _WIN32
 
@@ -76,6 +77,12 @@ static void use_theme(OS::Theme theme) {
 int main(int argc, char **argv) {
 	Preferences::initialize(argv[0]);
 	std::ios::sync_with_stdio(false);
+
+	// Command-line modes run before any window is created
+	if (int status; run_command_line(argc, argv, status)) {
+		return status;
+	}
+
 #ifdef _WIN32
 	SetCurrentProcessExplicitAppUserModelID(MAKE_WSTR(PROGRAM_AUTHOR) L"." MAKE_WSTR(PROGRAM_NAME));
 #endif
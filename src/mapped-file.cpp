@@ -0,0 +1,92 @@
+#include <cstring>
+
+#pragma warning(push, 0)
+#include <FL/fl_utf8.h>
+#include <FL/filename.H>
+#pragma warning(pop)
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include "mapped-file.h"
+
+#ifdef _WIN32
+Mapped_File::Mapped_File() : _data(NULL), _size(0), _buffer(), _mapped(false), _mapping(NULL) {}
+#else
+Mapped_File::Mapped_File() : _data(NULL), _size(0), _buffer(), _mapped(false) {}
+#endif
+
+Mapped_File::~Mapped_File() {
+	close();
+}
+
+bool Mapped_File::open(const char *f) {
+	close();
+	size_t n = file_size(f);
+	if (n >= MIN_MAPPED_FILE_SIZE && map(f, n)) { return true; }
+	return read(f, n);
+}
+
+void Mapped_File::close() {
+	if (_mapped) {
+#ifdef _WIN32
+		UnmapViewOfFile(_data);
+		CloseHandle((HANDLE)_mapping);
+		_mapping = NULL;
+#else
+		munmap((void *)_data, _size);
+#endif
+		_mapped = false;
+	}
+	_data = NULL;
+	_size = 0;
+	std::vector<uchar>().swap(_buffer);
+}
+
+bool Mapped_File::map(const char *f, size_t n) {
+#ifdef _WIN32
+	wchar_t wf[FL_PATH_MAX] = {};
+	fl_utf8towc(f, (unsigned)strlen(f), wf, _countof(wf));
+	HANDLE file = CreateFileW(wf, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) { return false; }
+	HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (!mapping) { return false; }
+	const void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, n);
+	if (!data) { CloseHandle(mapping); return false; }
+	_mapping = mapping;
+#else
+	int fd = fl_open(f, O_RDONLY);
+	if (fd < 0) { return false; }
+	void *data = mmap(NULL, n, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (data == MAP_FAILED) { return false; }
+#ifdef MADV_SEQUENTIAL
+	madvise(data, n, MADV_SEQUENTIAL);
+#endif
+#endif
+	_data = (const uchar *)data;
+	_size = n;
+	_mapped = true;
+	return true;
+}
+
+bool Mapped_File::read(const char *f, size_t n) {
+	FILE *file = fl_fopen(f, "rb");
+	if (!file) { return false; }
+	_buffer.resize(n);
+	size_t r = n ? fread(_buffer.data(), 1, n, file) : 0;
+	fclose(file);
+	if (r != n) {
+		std::vector<uchar>().swap(_buffer);
+		return false;
+	}
+	_data = _buffer.data();
+	_size = n;
+	return true;
+}
@@ -0,0 +1,38 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <vector>
+
+#include "utils.h"
+
+// Files at least this large are memory-mapped; smaller ones are cheaper to read in one call
+#define MIN_MAPPED_FILE_SIZE (64 * 1024)
+
+// The bytes of a whole file, read-only, valid until the file is closed
+class Mapped_File {
+private:
+	const uchar *_data;
+	size_t _size;
+	std::vector<uchar> _buffer;
+	bool _mapped;
+#ifdef _WIN32
+	void *_mapping;
+#endif
+public:
+	Mapped_File();
+	~Mapped_File();
+	Mapped_File(const Mapped_File &) = delete;
+	Mapped_File &operator=(const Mapped_File &) = delete;
+	inline const uchar *data(void) const { return _data; }
+	inline size_t size(void) const { return _size; }
+	inline bool empty(void) const { return !_size; }
+	inline const uchar *begin(void) const { return _data; }
+	inline const uchar *end(void) const { return _data + _size; }
+	bool open(const char *f);
+	void close(void);
+private:
+	bool map(const char *f, size_t n);
+	bool read(const char *f, size_t n);
+};
+
+#endif
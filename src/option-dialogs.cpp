@@ -16,6 +16,7 @@
 #include "icons.h"
 #include "image.h"
 #include "tile.h"
+#include "image-to-tiles.h"
 
 Option_Dialog::Option_Dialog(int w, const char *t) : _width(w), _title(t), _canceled(false),
 	_dialog(NULL), _content(NULL), _ok_button(NULL), _cancel_button(NULL) {}
@@ -95,7 +96,8 @@ void Option_Dialog::cancel_cb(Fl_Widget *, Option_Dialog *od) {
 }
 
 Tilemap_Options_Dialog::Tilemap_Options_Dialog(const char *t) : Option_Dialog(280, t), _tilemap_header(NULL),
-	_format(NULL), _attrmap_heading(NULL), _attrmap(NULL), _attrmap_name(NULL), _attrmap_chooser(NULL),
+	_format(NULL), _attrmap_heading(NULL), _attrmap(NULL), _attrmap_name(NULL), _words(NULL), _big_endian(NULL),
+	_attrmap_chooser(NULL),
 	_attrmap_import_chooser(NULL), _attrmap_filename(), _importing(false) {}
 
 Tilemap_Options_Dialog::~Tilemap_Options_Dialog() {
@@ -104,6 +106,8 @@ Tilemap_Options_Dialog::~Tilemap_Options_Dialog() {
 	delete _attrmap_heading;
 	delete _attrmap;
 	delete _attrmap_name;
+	delete _words;
+	delete _big_endian;
 	delete _attrmap_chooser;
 	delete _attrmap_import_chooser;
 }
@@ -138,10 +142,20 @@ void Tilemap_Options_Dialog::use_tilemap(const char *filename) {
 		_attrmap_name->deactivate();
 		_attrmap_name->copy_label(NO_FILE_SELECTED_LABEL);
 	}
+	update_words();
 
 	_ok_button->activate();
 }
 
+void Tilemap_Options_Dialog::update_words() {
+	if (format_can_export_words(format())) {
+		_words->activate();
+	}
+	else {
+		_words->deactivate();
+	}
+}
+
 void Tilemap_Options_Dialog::initialize_content() {
 	// Populate content group
 	_tilemap_header = new Label(0, 0, 0, 0);
@@ -149,6 +163,8 @@ void Tilemap_Options_Dialog::initialize_content() {
 	_attrmap_heading = new Label(0, 0, 0, 0, "Attrmap:");
 	_attrmap = new Toolbar_Button(0, 0, 0, 0);
 	_attrmap_name = new Label_Button(0, 0, 0, 0, NO_FILE_SELECTED_LABEL);
+	_words = new OS_Check_Button(0, 0, 0, 0, "16-bit values (CSV and C)");
+	_big_endian = new OS_Check_Button(0, 0, 0, 0, "Big-endian words");
 	_attrmap_chooser = new Fl_Native_File_Chooser(Fl_Native_File_Chooser::BROWSE_FILE);
 	_attrmap_import_chooser = new Fl_Native_File_Chooser(Fl_Native_File_Chooser::BROWSE_FILE);
 	// Initialize content group's children
@@ -167,7 +183,7 @@ void Tilemap_Options_Dialog::initialize_content() {
 
 int Tilemap_Options_Dialog::refresh_content(int ww, int dy) {
 	int wgt_h = 22, win_m = 10, wgt_m = 4;
-	int ch = (wgt_h + wgt_m) * 2 + wgt_h;
+	int ch = (wgt_h + wgt_m) * (_importing ? 4 : 2) + wgt_h;
 	_content->resize(win_m, dy, ww, ch);
 
 	_tilemap_header->resize(win_m, dy, ww, wgt_h);
@@ -183,6 +199,18 @@ int Tilemap_Options_Dialog::refresh_content(int ww, int dy) {
 	_attrmap->resize(wgt_off, dy, wgt_h, wgt_h);
 	wgt_off += _attrmap->w();
 	_attrmap_name->resize(wgt_off, dy, ww-wgt_w-wgt_h, wgt_h);
+	if (_importing) {
+		dy += wgt_h + wgt_m;
+		_words->resize(win_m, dy, ww, wgt_h);
+		_words->show();
+		dy += wgt_h + wgt_m;
+		_big_endian->resize(win_m, dy, ww, wgt_h);
+		_big_endian->show();
+	}
+	else {
+		_words->hide();
+		_big_endian->hide();
+	}
 
 	return ch;
 }
@@ -213,6 +241,7 @@ void Tilemap_Options_Dialog::format_cb(Dropdown *, Tilemap_Options_Dialog *tod)
 		tod->_attrmap_name->copy_label(NO_FILE_SELECTED_LABEL);
 		tod->_ok_button->activate();
 	}
+	tod->update_words();
 	tod->_dialog->redraw();
 }
 
@@ -697,6 +726,49 @@ int Group_Width_Dialog::refresh_content(int ww, int dy) {
 	return wgt_h;
 }
 
+Export_Options_Dialog::Export_Options_Dialog(const char *t) : Option_Dialog(260, t), _words(NULL),
+	_values_per_line(NULL) {}
+
+Export_Options_Dialog::~Export_Options_Dialog() {
+	delete _words;
+	delete _values_per_line;
+}
+
+void Export_Options_Dialog::limit_options(Tilemap_Format fmt) {
+	initialize();
+	if (format_can_export_words(fmt)) {
+		_words->activate();
+	}
+	else {
+		_words->deactivate();
+	}
+}
+
+void Export_Options_Dialog::initialize_content() {
+	// Populate content group
+	_words = new OS_Check_Button(0, 0, 0, 0, "Export 16-bit words (dw)");
+	_values_per_line = new Default_Spinner(0, 0, 0, 0, "Values per line:");
+	// Initialize content group's children
+	_values_per_line->align(FL_ALIGN_LEFT);
+	_values_per_line->range(0, 1024);
+	_values_per_line->default_value(0);
+	_values_per_line->tooltip("0 uses the default layout");
+}
+
+int Export_Options_Dialog::refresh_content(int ww, int dy) {
+	int wgt_h = 22, win_m = 10, wgt_m = 4;
+	int ch = wgt_h + wgt_m + wgt_h;
+	_content->resize(win_m, dy, ww, ch);
+
+	_words->resize(win_m, dy, ww, wgt_h);
+	dy += wgt_h + wgt_m;
+	int wgt_off = win_m + text_width(_values_per_line->label(), 2);
+	int wgt_w = text_width("9999", 2) + wgt_h / 2 + 4;
+	_values_per_line->resize(wgt_off, dy, wgt_w, wgt_h);
+
+	return ch;
+}
+
 Add_Tileset_Dialog::Add_Tileset_Dialog(const char *t) : Option_Dialog(270, t), _tileset_header(NULL), _start_id(NULL),
 	_offset(NULL), _length(NULL) {}
 
@@ -794,25 +866,7 @@ Image_To_Tiles_Dialog::~Image_To_Tiles_Dialog() {
 }
 
 Fl_Color Image_To_Tiles_Dialog::fl_color_zero() const {
-	const char *s = _color_zero_rgb->value();
-	char rgb[7] = {};
-	if (size_t n = strlen(s); n < 6) {
-		memset(rgb, '0', 6 - n);
-	}
-	strncat(rgb, s, 6);
-
-	char buffer[3] = {};
-	buffer[0] = rgb[0];
-	buffer[1] = rgb[1];
-	uchar r = (uchar)strtoul(buffer, NULL, 16);
-	buffer[0] = rgb[2];
-	buffer[1] = rgb[3];
-	uchar g = (uchar)strtoul(buffer, NULL, 16);
-	buffer[0] = rgb[4];
-	buffer[1] = rgb[5];
-	uchar b = (uchar)strtoul(buffer, NULL, 16);
-
-	return fl_rgb_color(NORMRGB(r), NORMRGB(g), NORMRGB(b));
+	return parse_rgb_color(_color_zero_rgb->value());
 }
 
 void Image_To_Tiles_Dialog::update_image_name() {
@@ -55,6 +55,7 @@ private:
 	Label *_attrmap_heading;
 	Toolbar_Button *_attrmap;
 	Label_Button *_attrmap_name;
+	OS_Check_Button *_words, *_big_endian;
 	Fl_Native_File_Chooser *_attrmap_chooser, *_attrmap_import_chooser;
 	std::string _attrmap_filename;
 	bool _importing;
@@ -65,12 +66,15 @@ public:
 	inline void format(Tilemap_Format fmt) { initialize(); _format->value((int)fmt); }
 	inline const char *attrmap_filename(void) const { return _attrmap_filename.c_str(); }
 	inline void importing(bool b) { _importing = b; }
+	inline bool words(void) const { return _importing && _words->active() && !!_words->value(); }
+	inline bool big_endian(void) const { return _importing && !!_big_endian->value(); }
 	void update_icons(void);
 	void use_tilemap(const char *filename);
 protected:
 	void initialize_content(void);
 	int refresh_content(int ww, int dy);
 private:
+	void update_words(void);
 	static void format_cb(Dropdown *d, Tilemap_Options_Dialog *tod);
 	static void attrmap_cb(Fl_Widget *w, Tilemap_Options_Dialog *tod);
 };
@@ -228,6 +232,21 @@ protected:
 	int refresh_content(int ww, int dy);
 };
 
+class Export_Options_Dialog : public Option_Dialog {
+private:
+	OS_Check_Button *_words;
+	Default_Spinner *_values_per_line;
+public:
+	Export_Options_Dialog(const char *t);
+	~Export_Options_Dialog();
+	inline bool words(void) const { return _words->active() && !!_words->value(); }
+	inline size_t values_per_line(void) const { return (size_t)_values_per_line->value(); }
+	void limit_options(Tilemap_Format fmt);
+protected:
+	void initialize_content(void);
+	int refresh_content(int ww, int dy);
+};
+
 class Add_Tileset_Dialog : public Option_Dialog {
 private:
 	Label *_tileset_header;
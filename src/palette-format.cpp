@@ -3,7 +3,6 @@
 
 #pragma warning(push, 0)
 #include <FL/Fl.H>
-#include <FL/Fl_Image_Surface.H>
 #pragma warning(pop)
 
 #include "image.h"
@@ -57,25 +56,24 @@ const char *palette_extension(Palette_Format pal_fmt) {
 static bool write_graphic_palette(const char *f, const Palettes &palettes, size_t nc) {
 	int w = (int)nc, h = (int)palettes.size();
 	if (w % 16 == 0) { w /= 16; h *= 16; }
-	Fl_Image_Surface *surface = new Fl_Image_Surface(w, h);
-	surface->set_current();
+	size_t n = (size_t)w * (size_t)h;
+	uchar *bytes = new uchar[n * NUM_CHANNELS](); // black
 
-	fl_rectf(0, 0, w, h, FL_BLACK);
 	int i = 0;
 	for (const Palette &palette : palettes) {
 		int j = 0;
 		for (Fl_Color c : palette) {
-			fl_color(c);
-			fl_point(j % w, i + j / w);
+			size_t px = (size_t)(i + j / w) * w + j % w;
+			if (px < n) {
+				Fl::get_color(c, bytes[px * 3], bytes[px * 3 + 1], bytes[px * 3 + 2]);
+			}
 			j++;
 		}
 		i++;
 	}
 
-	Fl_RGB_Image *img = surface->image();
-	delete surface;
-	Fl_Display_Device::display_device()->set_current();
-
+	Fl_RGB_Image *img = new Fl_RGB_Image(bytes, w, h, NUM_CHANNELS);
+	img->alloc_array = 1;
 	Image::Result result = Image::write_image(f, img);
 	delete img;
 
@@ -130,6 +130,8 @@ void draw_selection_border(int x, int y, int w, int h, Fl_Color c, bool zoom) {
 
 std::vector<Tileset> *Tile_State::_tilesets = NULL;
 
+std::vector<std::pair<int, int>> Tile_State::_tileset_tiles;
+
 Fl_PNG_Image *Tile_State::_palette_bgs_image = NULL;
 
 void Tile_State::alpha(uchar alfa) {
@@ -170,28 +172,42 @@ void Tile_State::alpha(uchar alfa) {
 	_palette_bgs_image = new Fl_PNG_Image(NULL, palette_bgs_png_buffer, sizeof(palette_bgs_png_buffer));
 }
 
-void Tile_State::update_zoom() {
+void Tile_State::update_tilesets() {
+	_tileset_tiles.clear();
 	if (!_tilesets) { return; }
-	for (Tileset &t : *_tilesets) {
-		t.update_zoom();
+	// Later tilesets are drawn over earlier ones, so they overwrite the IDs they share
+	int n = (int)_tilesets->size();
+	for (int i = 0; i < n; i++) {
+		const Tileset &t = (*_tilesets)[i];
+		int first = std::max(t.start_id(), 0), end = std::min(t.end_id(), (int)ID_MASK + 1);
+		if (first >= end) { continue; }
+		if ((size_t)end > _tileset_tiles.size()) { _tileset_tiles.resize((size_t)end, {-1, -1}); }
+		for (int id = first; id < end; id++) {
+			_tileset_tiles[id] = {i, t.tile_index((uint16_t)id)};
+		}
 	}
 }
 
+const Tileset *Tile_State::tileset(int &index) const {
+	if (id() >= _tileset_tiles.size()) { return NULL; }
+	auto [i, t] = _tileset_tiles[id()];
+	if (i < 0 || (size_t)i >= _tilesets->size()) { return NULL; }
+	index = t;
+	return &(*_tilesets)[i];
+}
+
 static Fl_Font tile_fonts[4] = {FL_COURIER, FL_COURIER_ITALIC, FL_COURIER_BOLD, FL_COURIER_BOLD_ITALIC};
 
-void Tile_State::draw_tile(int x, int y, int z, bool active, bool selected) {
+void Tile_State::draw_tile(int x, int y, int z, bool active, bool selected) const {
 	if (z == 1) {
 		draw_tile_1x(x, y, active, selected);
 		return;
 	}
-	if (_tilesets) {
-		for (std::vector<Tileset>::reverse_iterator it = _tilesets->rbegin(); it != _tilesets->rend(); ++it) {
-			if (it->draw_tile(this, x, y, z, active)) {
-				return;
-			}
-		}
+	int index;
+	if (const Tileset *t = tileset(index); t && t->draw_tile(index, this, x, y, z, active)) {
+		return;
 	}
-	uint16_t hi = HI_NYB(id), lo = LO_NYB(id), bank = (id & 0x300) >> 8;
+	uint16_t hi = HI_NYB(id()), lo = LO_NYB(id()), bank = (id() & 0x300) >> 8;
 	char l1 = (char)(hi > 9 ? 'A' + hi - 10 : '0' + hi), l2 = (char)(lo > 9 ? 'A' + lo - 10 : '0' + lo);
 	const char buffer[] = {l1, l2, '\0'};
 	bool r = Config::rainbow_tiles();
@@ -200,31 +216,31 @@ void Tile_State::draw_tile(int x, int y, int z, bool active, bool selected) {
 	fl_rectf(x, y, s, s, bg);
 	int f = (OS::is_consolas() ? 11 : 10) + z * 2 - 4;
 	fl_font(tile_fonts[bank], f);
-	Fl_Color fg = selected ? FL_YELLOW : x_flip ? y_flip ? FL_YELLOW : FL_MAGENTA : y_flip ? FL_CYAN : rainbow_fg_colors[r ? hi : 0];
+	Fl_Color fg = selected ? FL_YELLOW : x_flip() ? y_flip() ? FL_YELLOW : FL_MAGENTA : y_flip() ? FL_CYAN : rainbow_fg_colors[r ? hi : 0];
 	fl_color(fg);
 	fl_draw(buffer, x, y, s, s, FL_ALIGN_CENTER);
 }
 
-void Tile_State::draw_attributes(int x, int y, int z, int style, bool active) {
+void Tile_State::draw_attributes(int x, int y, int z, int style, bool active) const {
 	int s = TILE_SIZE * z;
 	if (!active) {
 		fl_rectf(x, y, s, s, FL_INACTIVE_COLOR);
 	}
-	else if (palette > -1) {
+	else if (palette() > -1) {
 		if (style > 0) {
-			_palette_bgs_image->draw(x, y, s, s, TILE_SIZE * MAX_ZOOM * palette, 0);
+			_palette_bgs_image->draw(x, y, s, s, TILE_SIZE * MAX_ZOOM * palette(), 0);
 		}
 		else if (style < 0) {
-			fl_rectf(x, y, s, s, palette_colors[palette]);
+			fl_rectf(x, y, s, s, palette_colors[palette()]);
 		}
 		int dy = z > 1 || !Config::grid();
-		palette_digits_image.draw(x+1, y+dy, 5, 7, 5 * palette, 0);
+		palette_digits_image.draw(x+1, y+dy, 5, 7, 5 * palette(), 0);
 	}
 	if (z > 1) {
-		if (priority) {
+		if (priority()) {
 			priority_image.draw(x+8, y+8);
 		}
-		if (obp1) {
+		if (obp1()) {
 			obp1_image.draw(x+8, y+1);
 		}
 	}
@@ -259,7 +275,7 @@ static void print_digit(int x, int y, uchar d) {
 	}
 }
 
-void Tile_State::draw(int x, int y, int z, bool tile, bool attr, int style, bool active, bool selected) {
+void Tile_State::draw(int x, int y, int z, bool tile, bool attr, int style, bool active, bool selected) const {
 	int s = TILE_SIZE * z;
 	if (tile) {
 		draw_tile(x, y, z, active, selected);
@@ -272,40 +288,30 @@ void Tile_State::draw(int x, int y, int z, bool tile, bool attr, int style, bool
 	}
 }
 
-void Tile_State::draw_tile_1x(int x, int y, bool active, bool selected) {
-	if (_tilesets) {
-		for (std::vector<Tileset>::reverse_iterator it = _tilesets->rbegin(); it != _tilesets->rend(); ++it) {
-			if (it->print_tile(this, x, y, active)) {
-				return;
-			}
-		}
+void Tile_State::draw_tile_1x(int x, int y, bool active, bool selected) const {
+	int index;
+	if (const Tileset *t = tileset(index); t && t->print_tile(index, this, x, y, active)) {
+		return;
 	}
-	uchar hi = HI_NYB(id), lo = LO_NYB(id);
+	uchar hi = HI_NYB(id()), lo = LO_NYB(id());
 	bool r = Config::rainbow_tiles();
 	Fl_Color bg = rainbow_bg_colors[r ? lo : 0];
 	fl_rectf(x, y, TILE_SIZE, TILE_SIZE, bg);
-	Fl_Color fg = selected ? FL_YELLOW : x_flip ? y_flip ? FL_YELLOW : FL_MAGENTA : y_flip ? FL_CYAN : rainbow_fg_colors[r ? hi : 0];
+	Fl_Color fg = selected ? FL_YELLOW : x_flip() ? y_flip() ? FL_YELLOW : FL_MAGENTA : y_flip() ? FL_CYAN : rainbow_fg_colors[r ? hi : 0];
 	fl_color(fg);
 	print_digit(x, y+1, hi);
 	print_digit(x+4, y+2, lo);
 }
 
-void Tile_State::print(int x, int y, bool active, bool selected, int palette_) {
-	bool drawn = false;
-	if (_tilesets) {
-		for (std::vector<Tileset>::reverse_iterator it = _tilesets->rbegin(); it != _tilesets->rend(); ++it) {
-			if (it->print_tile(this, x, y, active)) {
-				drawn = true;
-				break;
-			}
-		}
-	}
-	if (!drawn) {
-		uchar hi = HI_NYB(id), lo = LO_NYB(id);
+void Tile_State::print(int x, int y, bool active, bool selected, int palette_) const {
+	int index;
+	const Tileset *t = tileset(index);
+	if (!t || !t->print_tile(index, this, x, y, active)) {
+		uchar hi = HI_NYB(id()), lo = LO_NYB(id());
 		bool r = Config::print_rainbow_tiles();
 		Fl_Color bg = rainbow_bg_colors[r ? lo : 0];
 		fl_rectf(x, y, TILE_SIZE, TILE_SIZE, bg);
-		Fl_Color fg = selected ? FL_YELLOW : x_flip ? y_flip ? FL_YELLOW : FL_MAGENTA : y_flip ? FL_CYAN : rainbow_fg_colors[r ? hi : 0];
+		Fl_Color fg = selected ? FL_YELLOW : x_flip() ? y_flip() ? FL_YELLOW : FL_MAGENTA : y_flip() ? FL_CYAN : rainbow_fg_colors[r ? hi : 0];
 		fl_color(fg);
 		print_digit(x, y+1, hi);
 		print_digit(x+4, y+2, lo);
@@ -337,68 +343,138 @@ void Tile_Swatch::draw() {
 	_state.draw(ox, oy, DEFAULT_ZOOM, !_attributes, _attributes, (int)Config::bold_palettes(), !!active(), false);
 }
 
-Tile_Tessera::Tile_Tessera(int x, int y, size_t row, size_t col, uint16_t id, bool x_flip, bool y_flip,
-	bool priority, bool obp1, int palette) : Groupable(x, y, row, col, id, x_flip, y_flip, priority, obp1, palette) {
+Tilemap_Canvas::Tilemap_Canvas(int x, int y, int w, int h) : Fl_Box(x, y, w, h), _row(0), _col(0), _hover_row(0),
+	_hover_col(0), _hovering(false) {
 	user_data(NULL);
 	box(FL_NO_BOX);
 	labeltype(FL_NO_LABEL);
-	type(TILE_TESSERA_TYPE);
 }
 
-void Tile_Tessera::draw() {
-	Main_Window *mw = (Main_Window *)user_data();
-	int X = x(), Y = y(), Z = Config::zoom();
-	_state.draw(X, Y, Z, true, Config::show_attributes(), (int)Config::bold_palettes(), !!active(), false);
+void Tilemap_Canvas::damage_tile(size_t row, size_t col) {
+	int s = TILE_SIZE * Config::zoom();
+	damage(FL_DAMAGE_USER1, x() + (int)col * s, y() + (int)row * s, s, s);
+}
+
+void Tilemap_Canvas::draw_tile(const Tile_State &ts, int x, int y, bool hovered) const {
+	int z = Config::zoom();
+	ts.draw(x, y, z, true, Config::show_attributes(), (int)Config::bold_palettes(), !!active(), false);
 	if (Config::grid()) {
-		draw_grid(X, Y, Z);
+		draw_grid(x, y, z);
+	}
+	if (ts.highlighted()) {
+		draw_highlight(x, y, z);
 	}
-	if (_state.highlighted()) {
-		draw_highlight(X, Y, Z);
+	if (hovered) {
+		draw_selection_border(x, y, z, ts.highlighted());
 	}
-	if (this == Fl::belowmouse() && !mw->selection().selected_multiple()) {
-		draw_selection_border(X, Y, Z, _state.highlighted());
+}
+
+void Tilemap_Canvas::draw() {
+	int X, Y, W, H;
+	fl_clip_box(x(), y(), w(), h(), X, Y, W, H);
+	if (W <= 0 || H <= 0) { return; }
+	Main_Window *mw = (Main_Window *)user_data();
+	const Tilemap &tilemap = mw->tilemap();
+	size_t n = tilemap.size(), tw = tilemap.width(), th = tilemap.height();
+	if (!n) { return; }
+	int s = TILE_SIZE * Config::zoom();
+	size_t c0 = (size_t)((X - x()) / s), c1 = std::min((size_t)((X + W - x() + s - 1) / s), tw);
+	size_t r0 = (size_t)((Y - y()) / s), r1 = std::min((size_t)((Y + H - y() + s - 1) / s), th);
+	bool hover = _hovering && !mw->selection().selected_multiple();
+	for (size_t r = r0; r < r1; r++) {
+		int ty = y() + (int)r * s;
+		for (size_t c = c0; c < c1; c++) {
+			int tx = x() + (int)c * s;
+			size_t i = r * tw + c;
+			if (i >= n) {
+				fl_rectf(tx, ty, (int)(c1 - c) * s, s, parent()->color());
+				break;
+			}
+			draw_tile(tilemap.state(i), tx, ty, hover && r == _hover_row && c == _hover_col);
+		}
 	}
 }
 
 static bool pushed_in_tileset = false;
 
-int Tile_Tessera::handle(int event) {
+bool Tilemap_Canvas::event_tile(size_t &row, size_t &col) const {
+	Workspace *p = (Workspace *)parent();
+	int px = p->x() + Fl::box_dx(p->box()), py = p->y() + Fl::box_dy(p->box());
+	int pw = p->w() - Fl::box_dw(p->box()) - (p->has_y_scroll() ? Fl::scrollbar_size() : 0);
+	int ph = p->h() - Fl::box_dh(p->box()) - (p->has_x_scroll() ? Fl::scrollbar_size() : 0);
+	if (!Fl::event_inside(this) || !Fl::event_inside(px, py, pw, ph)) { return false; }
+	Main_Window *mw = (Main_Window *)user_data();
+	const Tilemap &tilemap = mw->tilemap();
+	int s = TILE_SIZE * Config::zoom();
+	row = (size_t)((Fl::event_y() - y()) / s);
+	col = (size_t)((Fl::event_x() - x()) / s);
+	return col < tilemap.width() && row * tilemap.width() + col < tilemap.size();
+}
+
+void Tilemap_Canvas::hover(bool inside, size_t row, size_t col) {
+	if (inside == _hovering && (!inside || (row == _hover_row && col == _hover_col))) { return; }
+	Main_Window *mw = (Main_Window *)user_data();
+	Tile_Selection &ts = mw->selection();
+	if (_hovering) {
+		damage_tile(_hover_row, _hover_col);
+	}
+	_hovering = inside;
+	_hover_row = row;
+	_hover_col = col;
+	if (!inside) {
+		if (ts.selecting() && !pushed_in_tileset) {
+			ts.continue_selecting();
+		}
+		mw->update_status(NULL);
+		mw->redraw_overlay();
+		return;
+	}
+	damage_tile(row, col);
+	if (ts.selecting() && !ts.from_tileset()) {
+		if (Fl::event_button3()) {
+			ts.continue_selecting(row, col);
+			mw->update_selection_status();
+		}
+		else {
+			ts.finish_selecting();
+			mw->update_selection_controls();
+			redraw();
+		}
+	}
+	if (Fl::event_button1() && !ts.selecting() && Fl::pushed() == this) {
+		// Left-drag to keep editing
+		_row = row;
+		_col = col;
+		do_callback();
+	}
+	mw->update_status(&mw->tilemap().state(col, row), col, row);
+	mw->redraw_overlay();
+}
+
+int Tilemap_Canvas::handle(int event) {
 	Main_Window *mw = (Main_Window *)user_data();
 	Tile_Selection &ts = mw->selection();
+	size_t row = 0, col = 0;
+	bool inside = event_tile(row, col);
 	switch (event) {
 	case FL_ENTER:
-		if (ts.selecting() && !ts.from_tileset()) {
-			if (Fl::event_button3()) {
-				ts.continue_selecting(this);
-				mw->update_selection_status();
-				mw->redraw_overlay();
-			}
-			else {
-				ts.finish_selecting();
-				mw->update_selection_controls();
-			}
-		}
 		if ((Fl::event_button1() || Fl::event_button3()) && !Fl::pushed()) {
 			Fl::pushed(this);
-			if (Fl::event_button1() && !ts.selecting()) {
-				do_callback();
-			}
 		}
-		mw->update_status(this);
-		redraw();
-		return 1;
-	case FL_LEAVE:
-		if (ts.selecting() && !pushed_in_tileset) {
-			ts.continue_selecting(NULL);
-		}
-		mw->update_status(NULL);
-		redraw();
+		hover(inside, row, col);
 		return 1;
 	case FL_MOVE:
+		hover(inside, row, col);
+		return 1;
+	case FL_LEAVE:
+		hover(false, 0, 0);
 		return 1;
 	case FL_PUSH:
 		pushed_in_tileset = false;
+		if (!inside) { return 1; }
 		mw->map_editable(true);
+		_row = row;
+		_col = col;
 		do_callback();
 		return 1;
 	case FL_RELEASE:
@@ -410,148 +486,170 @@ int Tile_Tessera::handle(int event) {
 			}
 			mw->update_selection_status();
 			mw->update_selection_controls();
+			redraw();
 		}
 		return 1;
 	case FL_DRAG:
-		if (!Fl::event_inside(x(), y(), w(), h())) {
+		if (!Fl::event_inside(this)) {
 			Fl::pushed(NULL);
 		}
-		if (Fl::event_button3() && !ts.selecting() && !pushed_in_tileset) {
-			ts.start_selecting(this);
+		if (Fl::event_button3() && !ts.selecting() && !pushed_in_tileset && inside) {
+			ts.start_selecting(row, col, mw->tilemap().state(col, row).id(), false);
+			damage_tile(row, col);
 			mw->redraw_overlay();
 		}
+		hover(inside, row, col);
 		return 1;
 	}
 	return 0;
 }
 
-Tile_Button::Tile_Button(int x, int y, size_t row, size_t col, uint16_t id) : Groupable(x, y, row, col, id),
-	_value(), _old_value() {
+Tileset_Canvas::Tileset_Canvas(int x, int y) : Fl_Box(x, y, 0, 0), _ranges(), _columns(1), _rows(0), _row(0), _col(0),
+	_selected_id(0x000) {
 	user_data(NULL);
 	box(FL_NO_BOX);
 	labeltype(FL_NO_LABEL);
-	type(FL_RADIO_BUTTON);
 }
 
-int Tile_Button::value(char v) {
-	// Based on Fl_Radio_Button::value()
-	_old_value = v ? 1 : 0;
-	clear_changed();
-	if (_value != _old_value) {
-		_value = _old_value;
-		redraw();
-		return 1;
+void Tileset_Canvas::tiles(int columns, const std::vector<std::pair<int, int>> &ranges) {
+	_ranges.clear();
+	for (const auto &[first_id, end_id] : ranges) {
+		if (first_id < end_id) {
+			_ranges.push_back({first_id, end_id, 0});
+		}
 	}
-	return 0;
+	this->columns(columns);
 }
 
-void Tile_Button::setonly() {
-	// Based on Fl_Radio_Button::setonly()
-	set();
-	Fl_Group *g = parent();
-	Fl_Widget * const *a = g->array();
-	for (int i = g->children(); i--;) {
-		Fl_Widget *o = *a++;
-		if (o != this && o->type() == FL_RADIO_BUTTON) {
-			((Tile_Button *)o)->clear();
-		}
+void Tileset_Canvas::columns(int columns) {
+	_columns = columns;
+	_rows = 0;
+	for (Tile_Range &r : _ranges) {
+		r.row = _rows;
+		_rows += (size_t)((r.end_id - 1) / columns - r.first_id / columns + 1);
 	}
+	size(columns * TILE_SIZE_2X, (int)_rows * TILE_SIZE_2X);
+}
+
+int Tileset_Canvas::cell_id(size_t row, size_t col) const {
+	if (col >= (size_t)_columns || row >= _rows) { return -1; }
+	auto it = std::upper_bound(RANGE(_ranges), row, [](size_t r, const Tile_Range &t) { return r < t.row; });
+	if (it == _ranges.begin()) { return -1; }
+	--it;
+	int id = (it->first_id / _columns + (int)(row - it->row)) * _columns + (int)col;
+	return id >= it->first_id && id < it->end_id ? id : -1;
 }
 
-void Tile_Button::draw() {
+bool Tileset_Canvas::id_cell(int id, size_t &row, size_t &col) const {
+	auto it = std::upper_bound(RANGE(_ranges), id, [](int i, const Tile_Range &t) { return i < t.end_id; });
+	if (it == _ranges.end() || id < it->first_id) { return false; }
+	row = it->row + (size_t)(id / _columns - it->first_id / _columns);
+	col = (size_t)(id % _columns);
+	return true;
+}
+
+void Tileset_Canvas::draw() {
+	int X, Y, W, H;
+	fl_clip_box(x(), y(), w(), h(), X, Y, W, H);
+	if (W <= 0 || H <= 0) { return; }
 	Main_Window *mw = (Main_Window *)user_data();
-	int X = x(), Y = y();
 	bool multi = mw->selection().selected_multiple();
-	_state.draw(X, Y, DEFAULT_ZOOM, true, Config::show_attributes(), (int)Config::bold_palettes(), !!active(), !!value() && !multi);
-	if (Config::grid()) {
-		draw_grid(X, Y);
-	}
-	if (_state.highlighted()) {
-		draw_highlight(X, Y);
-	}
-	if (value() && !multi) {
-		draw_selection_border(X, Y, DEFAULT_ZOOM, _state.highlighted());
+	bool attr = Config::show_attributes();
+	int style = (int)Config::bold_palettes(), s = TILE_SIZE_2X;
+	int c0 = (X - x()) / s, c1 = std::min((X + W - x() + s - 1) / s, _columns);
+	int r0 = (Y - y()) / s, r1 = std::min((Y + H - y() + s - 1) / s, (int)_rows);
+	for (int r = r0; r < r1; r++) {
+		int ty = y() + r * s;
+		for (int c = c0; c < c1; c++) {
+			int tx = x() + c * s;
+			int id = cell_id((size_t)r, (size_t)c);
+			if (id < 0) {
+				fl_rectf(tx, ty, s, s, parent()->color());
+				continue;
+			}
+			Tile_State ts((uint16_t)id);
+			bool selected = id == _selected_id && !multi;
+			ts.draw(tx, ty, DEFAULT_ZOOM, true, attr, style, !!active(), selected);
+			if (Config::grid()) {
+				draw_grid(tx, ty);
+			}
+			if (ts.highlighted()) {
+				draw_highlight(tx, ty);
+			}
+			if (selected) {
+				draw_selection_border(tx, ty, DEFAULT_ZOOM, ts.highlighted());
+			}
+		}
 	}
 }
 
-int Tile_Button::handle(int event) {
-	// Based on Fl_Button::handle()
-	char new_value;
+bool Tileset_Canvas::event_tile(size_t &row, size_t &col) const {
+	Workspace *p = (Workspace *)parent();
+	int px = p->x() + Fl::box_dx(p->box()), py = p->y() + Fl::box_dy(p->box());
+	int pw = p->w() - Fl::box_dw(p->box()) - (p->has_y_scroll() ? Fl::scrollbar_size() : 0);
+	int ph = p->h() - Fl::box_dh(p->box()) - (p->has_x_scroll() ? Fl::scrollbar_size() : 0);
+	if (!Fl::event_inside(this) || !Fl::event_inside(px, py, pw, ph)) { return false; }
+	row = (size_t)((Fl::event_y() - y()) / TILE_SIZE_2X);
+	col = (size_t)((Fl::event_x() - x()) / TILE_SIZE_2X);
+	return cell_id(row, col) >= 0;
+}
+
+int Tileset_Canvas::handle(int event) {
 	Main_Window *mw = (Main_Window *)user_data();
 	Tile_Selection &ts = mw->selection();
+	size_t row = 0, col = 0;
+	bool inside = event_tile(row, col);
 	switch (event) {
 	case FL_ENTER:
 		// Don't interfere with dragging onto the parent Droppable|Workspace
 		if (mw->dropping()) { return 0; }
-		if (ts.selecting() && ts.from_tileset()) {
-			if (Fl::event_button1()) {
-				ts.continue_selecting(this);
-				mw->update_selection_status();
-				mw->redraw_overlay();
-			}
-			else {
-				ts.finish_selecting();
-				mw->update_selection_controls();
-			}
-		}
-		if ((Fl::event_button1() || Fl::event_button3()) && !Fl::pushed()) {
-			Fl::pushed(this);
-		}
 		return 1;
 	case FL_LEAVE:
-		if (ts.selecting() && pushed_in_tileset) {
-			ts.continue_selecting(NULL);
-		}
-		redraw();
-		return 1;
 	case FL_MOVE:
 		return 1;
 	case FL_PUSH:
-		pushed_in_tileset = true;
-		// Don't change the value on right-click
-		if (Fl::event_button() == FL_RIGHT_MOUSE) {
-			return 1;
-		}
-		if (Fl::event_inside(this)) {
-			new_value = 1;
-		}
-		else {
-			clear_changed();
-			new_value = _old_value;
-		}
-		if (new_value != _value) {
-			_value = new_value;
-			set_changed();
-			redraw();
+		pushed_in_tileset = inside;
+		if (!inside) { return 1; }
+		_row = row;
+		_col = col;
+		// Left-click selects right away; right-click highlights when released
+		if (Fl::event_button() == FL_LEFT_MOUSE) {
 			do_callback();
 		}
 		return 1;
 	case FL_RELEASE:
-		if (_value != _old_value) {
-			set_changed();
-			setonly();
-		}
-		if (!ts.selecting()) {
-			do_callback();
-		}
 		if (ts.selecting() && ts.from_tileset()) {
 			ts.finish_selecting();
 			mw->update_selection_status();
 			mw->update_selection_controls();
+			redraw();
+		}
+		else if (inside) {
+			_row = row;
+			_col = col;
+			do_callback();
 		}
 		return 1;
 	case FL_DRAG:
-		if (!Fl::event_inside(x(), y(), w(), h())) {
-			Fl::pushed(NULL);
+		if (!Fl::event_button1() || !pushed_in_tileset) { return 1; }
+		if (!ts.selecting()) {
+			ts.start_selecting(_row, _col, id(), true);
+			mw->redraw_overlay();
 		}
-		if (Fl::event_button1() && !ts.selecting() && pushed_in_tileset) {
-			ts.start_selecting(this);
+		else if (ts.from_tileset()) {
+			// Dragging outside the tiles shrinks the selection to its first tile until it comes back
+			if (inside) {
+				ts.continue_selecting(row, col);
+			}
+			else {
+				ts.continue_selecting();
+			}
+			mw->update_selection_status();
 			mw->redraw_overlay();
 		}
 		return 1;
-	default:
-		return 0;
 	}
+	return 0;
 }
 
 Palette_Button::Palette_Button(int x, int y, int p) : Tile_Thing(0x000, false, false, false, false, p),
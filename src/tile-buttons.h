@@ -1,6 +1,7 @@
 #ifndef TILE_BUTTON_H
 #define TILE_BUTTON_H
 
+#include <utility>
 #include <vector>
 
 #pragma warning(push, 0)
@@ -21,40 +22,86 @@ class Tileset;
 
 void draw_selection_border(int x, int y, int w, int h, Fl_Color c, bool zoom);
 
+// A tile packed into one 32-bit word, so tilemaps and their history can compare and rewrite tiles
+// with masks instead of field by field
 struct Tile_State {
+public:
+	// IDs keep 16 bits, more than the 10 that MAX_NUM_TILES needs, so it can grow without repacking
+	static constexpr uint32_t ID_MASK = 0x0000FFFF;
+	static constexpr uint32_t X_FLIP_BIT = 0x00010000;
+	static constexpr uint32_t Y_FLIP_BIT = 0x00020000;
+	static constexpr uint32_t PRIORITY_BIT = 0x00040000;
+	static constexpr uint32_t OBP1_BIT = 0x00080000;
+	static constexpr int PALETTE_SHIFT = 20;
+	static constexpr uint32_t PALETTE_MASK = 0x00F00000;
+	static constexpr uint32_t NO_PALETTE_BIT = 0x01000000;
+	static constexpr uint32_t TILE_MASK = ID_MASK | X_FLIP_BIT | Y_FLIP_BIT;
+	static constexpr uint32_t ATTRIBUTES_MASK = PRIORITY_BIT | OBP1_BIT | PALETTE_MASK | NO_PALETTE_BIT;
 private:
 	static std::vector<Tileset> *_tilesets;
+	// For each ID, which tileset draws it and the tile's index in that tileset, or -1 if none does
+	static std::vector<std::pair<int, int>> _tileset_tiles;
 	static Fl_PNG_Image *_palette_bgs_image;
 public:
-	inline static void tilesets(std::vector<Tileset> *ts) { _tilesets = ts; }
+	inline static void tilesets(std::vector<Tileset> *ts) { _tilesets = ts; update_tilesets(); }
+	static void update_tilesets(void);
 	static void alpha(uchar alfa);
-	static void update_zoom(void);
-public:
-	uint16_t id;
-	bool x_flip, y_flip, priority, obp1;
-	int palette;
+	inline static constexpr uint32_t palette_bits(int p) {
+		return p < 0 ? NO_PALETTE_BIT : ((uint32_t)p << PALETTE_SHIFT) & PALETTE_MASK;
+	}
+private:
+	uint32_t _bits;
 public:
 	inline Tile_State(uint16_t id_ = 0x000, bool x_flip_ = false, bool y_flip_ = false, bool priority_ = false,
-		bool obp1_ = false, int palette_ = -1) : id(id_), x_flip(x_flip_), y_flip(y_flip_), priority(priority_),
-		obp1(obp1_), palette(palette_) {}
-	inline bool same_tiles(const Tile_State &other) const {
-		return id == other.id && x_flip == other.x_flip && y_flip == other.y_flip;
-	}
-	inline bool same_attributes(const Tile_State &other) const {
-		return priority == other.priority && obp1 == other.obp1 && palette == other.palette;
+		bool obp1_ = false, int palette_ = -1) : _bits(id_ | (x_flip_ ? X_FLIP_BIT : 0) | (y_flip_ ? Y_FLIP_BIT : 0) |
+		(priority_ ? PRIORITY_BIT : 0) | (obp1_ ? OBP1_BIT : 0) | palette_bits(palette_)) {}
+	inline static Tile_State from_bits(uint32_t bits) { Tile_State ts; ts._bits = bits; return ts; }
+	inline uint32_t bits(void) const { return _bits; }
+	inline uint16_t id(void) const { return (uint16_t)(_bits & ID_MASK); }
+	inline void id(uint16_t id) { _bits = (_bits & ~ID_MASK) | id; }
+	inline bool x_flip(void) const { return !!(_bits & X_FLIP_BIT); }
+	inline void x_flip(bool f) { flag(X_FLIP_BIT, f); }
+	inline bool y_flip(void) const { return !!(_bits & Y_FLIP_BIT); }
+	inline void y_flip(bool f) { flag(Y_FLIP_BIT, f); }
+	inline bool priority(void) const { return !!(_bits & PRIORITY_BIT); }
+	inline void priority(bool p) { flag(PRIORITY_BIT, p); }
+	inline bool obp1(void) const { return !!(_bits & OBP1_BIT); }
+	inline void obp1(bool o) { flag(OBP1_BIT, o); }
+	inline int palette(void) const {
+		return _bits & NO_PALETTE_BIT ? -1 : (int)((_bits & PALETTE_MASK) >> PALETTE_SHIFT);
 	}
+	inline void palette(int p) { _bits = (_bits & ~(PALETTE_MASK | NO_PALETTE_BIT)) | palette_bits(p); }
+	inline void flip(uint32_t flip_bits) { _bits ^= flip_bits & (X_FLIP_BIT | Y_FLIP_BIT); }
+	inline bool same_tiles(const Tile_State &other) const { return !((_bits ^ other._bits) & TILE_MASK); }
+	inline bool same_attributes(const Tile_State &other) const { return !((_bits ^ other._bits) & ATTRIBUTES_MASK); }
 	inline bool same(const Tile_State &other, bool attr) const {
 		return attr ? same_attributes(other) : same_tiles(other);
 	}
-	inline bool highlighted(void) const { return id == Config::highlight_id(); }
-	void draw(int x, int y, int z, bool tile, bool attr, int style, bool active, bool selected);
-	void print(int x, int y, bool active, bool selected, int palette_ = -1);
+	inline bool operator==(const Tile_State &other) const { return _bits == other._bits; }
+	inline bool operator!=(const Tile_State &other) const { return _bits != other._bits; }
+	inline void tile(const Tile_State &other) { _bits = (_bits & ~TILE_MASK) | (other._bits & TILE_MASK); }
+	inline void attributes(const Tile_State &other) {
+		_bits = (_bits & ~ATTRIBUTES_MASK) | (other._bits & ATTRIBUTES_MASK);
+	}
+	inline void assign(const Tile_State &other, bool attr) {
+		if (attr) { attributes(other); } else { tile(other); }
+	}
+	inline void replace(const Tile_State &other, bool attr) {
+		attributes(other); if (!attr) { tile(other); }
+	}
+	inline bool highlighted(void) const { return id() == Config::highlight_id(); }
+	void draw(int x, int y, int z, bool tile, bool attr, int style, bool active, bool selected) const;
+	void print(int x, int y, bool active, bool selected, int palette_ = -1) const;
 private:
-	void draw_tile(int x, int y, int z, bool active, bool selected);
-	void draw_tile_1x(int x, int y, bool active, bool selected);
-	void draw_attributes(int x, int y, int z, int style, bool active);
+	inline void flag(uint32_t bit, bool v) { _bits = v ? _bits | bit : _bits & ~bit; }
+	const Tileset *tileset(int &index) const;
+	void draw_tile(int x, int y, int z, bool active, bool selected) const;
+	void draw_tile_1x(int x, int y, bool active, bool selected) const;
+	void draw_attributes(int x, int y, int z, int style, bool active) const;
 };
 
+static_assert(sizeof(Tile_State) == sizeof(uint32_t));
+
 class Tile_Thing {
 protected:
 	Tile_State _state;
@@ -63,30 +110,20 @@ public:
 		bool obp1_ = false, int palette_ = -1) : _state(id_, x_flip_, y_flip_, priority_, obp1_, palette_) {}
 	inline Tile_State state(void) const { return _state; }
 	inline void state(const Tile_State &state) { _state = state; }
-	inline void tile(Tile_State state) {
-		_state.id = state.id; _state.x_flip = state.x_flip; _state.y_flip = state.y_flip;
-	}
-	inline void attributes(const Tile_State &state) {
-		_state.palette = state.palette; _state.priority = state.priority; _state.obp1 = state.obp1;
-	}
-	inline void assign(const Tile_State &state, bool attr) {
-		if (attr) { attributes(state); } else { tile(state); }
-	}
-	inline void replace(const Tile_State &state, bool attr) {
-		attributes(state); if (!attr) { tile(state); }
-	}
-	inline uint16_t id(void) const { return _state.id; }
-	inline void id(uint16_t id) { _state.id = id; }
-	inline bool x_flip(void) const { return _state.x_flip; }
-	inline void x_flip(bool x_flip) { _state.x_flip = x_flip; }
-	inline bool y_flip(void) const { return _state.y_flip; }
-	inline void y_flip(bool y_flip) { _state.y_flip = y_flip; }
-	inline bool priority(void) const { return _state.priority; }
-	inline void priority(bool priority) { _state.priority = priority; }
-	inline bool obp1(void) const { return _state.obp1; }
-	inline void obp1(bool obp1) { _state.obp1 = obp1; }
-	inline int palette(void) const { return _state.palette; }
-	inline void palette(int palette) { _state.palette = palette; }
+	inline void assign(const Tile_State &state, bool attr) { _state.assign(state, attr); }
+	inline void replace(const Tile_State &state, bool attr) { _state.replace(state, attr); }
+	inline uint16_t id(void) const { return _state.id(); }
+	inline void id(uint16_t id) { _state.id(id); }
+	inline bool x_flip(void) const { return _state.x_flip(); }
+	inline void x_flip(bool x_flip) { _state.x_flip(x_flip); }
+	inline bool y_flip(void) const { return _state.y_flip(); }
+	inline void y_flip(bool y_flip) { _state.y_flip(y_flip); }
+	inline bool priority(void) const { return _state.priority(); }
+	inline void priority(bool priority) { _state.priority(priority); }
+	inline bool obp1(void) const { return _state.obp1(); }
+	inline void obp1(bool obp1) { _state.obp1(obp1); }
+	inline int palette(void) const { return _state.palette(); }
+	inline void palette(int palette) { _state.palette(palette); }
 };
 
 class Tile_Swatch : public Tile_Thing, public Fl_Box {
@@ -99,42 +136,61 @@ public:
 	inline void attributes(bool a) { _attributes = a; }
 };
 
-class Groupable : public Tile_Thing, public Fl_Box {
+// Draws the main window's tilemap as one widget, sized to the whole map inside a scrolling
+// workspace; only the tiles within the visible clip region are drawn
+class Tilemap_Canvas : public Fl_Box {
 private:
-	size_t _row, _col;
+	size_t _row, _col, _hover_row, _hover_col;
+	bool _hovering;
 public:
-	inline Groupable(int x = 0, int y = 0, size_t row = 0, size_t col = 0, uint16_t id = 0x000,
-		bool x_flip = false, bool y_flip = false, bool priority = false, bool obp1 = false, int palette = -1) :
-		Tile_Thing(id, x_flip, y_flip, priority, obp1, palette), Fl_Box(x, y, TILE_SIZE_2X, TILE_SIZE_2X),
-		_row(row), _col(col) {}
+	Tilemap_Canvas(int x, int y, int w, int h);
 	inline size_t row(void) const { return _row; }
 	inline size_t col(void) const { return _col; }
-	inline void coords(size_t row, size_t col) { _row = row; _col = col; }
-};
-
-class Tile_Tessera : public Groupable {
-public:
-	static const uchar TILE_TESSERA_TYPE = 0x42;
-public:
-	Tile_Tessera(int x = 0, int y = 0, size_t row = 0, size_t col = 0, uint16_t id = 0x000,
-		bool x_flip = false, bool y_flip = false, bool priority = false, bool obp1 = false, int palette = -1);
-	inline void print(int dx, int dy, bool active, bool selected) { _state.print(dx, dy, active, selected, palette()); }
+	inline bool hovering(void) const { return _hovering; }
+	inline size_t hover_row(void) const { return _hover_row; }
+	inline size_t hover_col(void) const { return _hover_col; }
+	void damage_tile(size_t row, size_t col);
+	void draw_tile(const Tile_State &ts, int x, int y, bool hovered) const;
 	void draw(void);
 	int handle(int event);
+private:
+	bool event_tile(size_t &row, size_t &col) const;
+	void hover(bool inside, size_t row, size_t col);
 };
 
-class Tile_Button : public Groupable {
+// Draws the tileset's tiles as one widget, sized to the whole grid inside a scrolling workspace;
+// only the tiles within the visible clip region are drawn, and events find their tile by position
+class Tileset_Canvas : public Fl_Box {
 private:
-	char _value, _old_value;
+	// Tiles from first_id up to but not including end_id, shown from row onward in their IDs' columns
+	struct Tile_Range {
+		int first_id, end_id;
+		size_t row;
+	};
+	// Each range starts on a new row, so IDs between ranges take no space
+	std::vector<Tile_Range> _ranges;
+	int _columns;
+	size_t _rows, _row, _col;
+	uint16_t _selected_id;
 public:
-	Tile_Button(int x, int y, size_t row = 0, size_t col = 0, uint16_t id = 0x000);
-	inline char value(void) const { return _value; }
-	int value(char v);
-	inline int set(void) { return value(1); }
-	inline int clear(void) { return value(0); }
-	void setonly(void);
+	Tileset_Canvas(int x, int y);
+	inline int columns(void) const { return _columns; }
+	inline size_t rows(void) const { return _rows; }
+	inline size_t row(void) const { return _row; }
+	inline size_t col(void) const { return _col; }
+	inline uint16_t id(void) const { return (uint16_t)cell_id(_row, _col); }
+	inline uint16_t selected_id(void) const { return _selected_id; }
+	inline void selected_id(uint16_t id) { _selected_id = id; }
+	// Shows ascending, non-overlapping [first, end) ranges of IDs
+	void tiles(int columns, const std::vector<std::pair<int, int>> &ranges);
+	void columns(int columns);
+	// The ID shown at a cell, or -1 if the cell is empty
+	int cell_id(size_t row, size_t col) const;
+	bool id_cell(int id, size_t &row, size_t &col) const;
 	void draw(void);
 	int handle(int event);
+private:
+	bool event_tile(size_t &row, size_t &col) const;
 };
 
 class Palette_Button : public Tile_Thing, public Fl_Radio_Button {
@@ -0,0 +1,135 @@
+#include "tile.h"
+#include "tile-cache.h"
+
+Tile_Cache::Entries Tile_Cache::_entries;
+std::unordered_map<Tile_Cache::Key, Tile_Cache::Entries::iterator, Tile_Cache::Key_Hash> Tile_Cache::_index;
+size_t Tile_Cache::_bytes = 0;
+size_t Tile_Cache::_max_bytes = DEFAULT_TILE_CACHE_BYTES;
+
+Fl_RGB_Image *Tile_Cache::tile(const Fl_RGB_Image *source, int index, int z, bool x_flip, bool y_flip) {
+	if (!source || index < 0 || z < 1) { return NULL; }
+	Key key = {source, (uint32_t)index << 8 | (uint32_t)z << 2 | (uint32_t)x_flip << 1 | (uint32_t)y_flip};
+	if (Fl_RGB_Image *img = cached(key)) { return img; }
+	Fl_RGB_Image *img = make_tile(source, index, z, x_flip, y_flip);
+	if (img) { insert(key, img); }
+	return img;
+}
+
+Fl_RGB_Image *Tile_Cache::flipped(const Fl_RGB_Image *source, bool x_flip, bool y_flip) {
+	if (!source) { return NULL; }
+	Key key = {source, (uint32_t)x_flip << 1 | (uint32_t)y_flip};
+	if (Fl_RGB_Image *img = cached(key)) { return img; }
+	Fl_RGB_Image *img = make_flipped(source, x_flip, y_flip);
+	if (img) { insert(key, img); }
+	return img;
+}
+
+Fl_RGB_Image *Tile_Cache::cached(const Key &key) {
+	auto it = _index.find(key);
+	if (it == _index.end()) { return NULL; }
+	_entries.splice(_entries.begin(), _entries, it->second);
+	return it->second->image;
+}
+
+void Tile_Cache::insert(const Key &key, Fl_RGB_Image *img) {
+	size_t bytes = sizeof(Fl_RGB_Image) + (size_t)img->w() * img->h() * img->d();
+	_entries.push_front({key, img, bytes});
+	_index[key] = _entries.begin();
+	_bytes += bytes;
+	evict(1);
+}
+
+void Tile_Cache::purge(const Fl_RGB_Image *source) {
+	for (auto it = _entries.begin(); it != _entries.end();) {
+		if (it->key.source == source) {
+			_bytes -= it->bytes;
+			_index.erase(it->key);
+			delete it->image;
+			it = _entries.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+}
+
+void Tile_Cache::clear() {
+	for (Entry &e : _entries) {
+		delete e.image;
+	}
+	_entries.clear();
+	_index.clear();
+	_bytes = 0;
+}
+
+void Tile_Cache::max_bytes(size_t m) {
+	_max_bytes = m;
+	evict(0);
+}
+
+Fl_RGB_Image *Tile_Cache::make_tile(const Fl_RGB_Image *source, int index, int z, bool x_flip, bool y_flip) {
+	int wt = source->w() / TILE_SIZE;
+	if (!wt || index >= wt * (source->h() / TILE_SIZE)) { return NULL; }
+	int tx = index % wt * TILE_SIZE, ty = index / wt * TILE_SIZE;
+
+	const uchar *data = (const uchar *)source->data()[0];
+	int d = source->d(), ld = source->ld();
+	if (!ld) { ld = source->w() * d; }
+
+	// Nearest-neighbor scaling, flipped while copying
+	int s = TILE_SIZE * z;
+	uchar *bytes = new uchar[s * s * d];
+	uchar *dst = bytes;
+	for (int oy = 0; oy < s; oy++) {
+		int sy = ty + (y_flip ? s - 1 - oy : oy) / z;
+		const uchar *row = data + sy * ld;
+		for (int ox = 0; ox < s; ox++) {
+			int sx = tx + (x_flip ? s - 1 - ox : ox) / z;
+			const uchar *px = row + sx * d;
+			for (int k = 0; k < d; k++) {
+				*dst++ = px[k];
+			}
+		}
+	}
+
+	Fl_RGB_Image *img = new Fl_RGB_Image(bytes, s, s, d);
+	img->alloc_array = 1;
+	return img;
+}
+
+// Flips each tile within its own place, so tiles keep the same coordinates as in the source
+Fl_RGB_Image *Tile_Cache::make_flipped(const Fl_RGB_Image *source, bool x_flip, bool y_flip) {
+	int w = source->w(), h = source->h(), d = source->d(), ld = source->ld();
+	if (w < TILE_SIZE || h < TILE_SIZE) { return NULL; }
+	if (!ld) { ld = w * d; }
+	const uchar *data = (const uchar *)source->data()[0];
+
+	uchar *bytes = new uchar[w * h * d];
+	uchar *dst = bytes;
+	int fx = TILE_SIZE - 1, mw = w / TILE_SIZE * TILE_SIZE, mh = h / TILE_SIZE * TILE_SIZE;
+	for (int y = 0; y < h; y++) {
+		int sy = y < mh && y_flip ? y - y % TILE_SIZE + fx - y % TILE_SIZE : y;
+		const uchar *row = data + sy * ld;
+		for (int x = 0; x < w; x++) {
+			int sx = x < mw && x_flip ? x - x % TILE_SIZE + fx - x % TILE_SIZE : x;
+			const uchar *px = row + sx * d;
+			for (int k = 0; k < d; k++) {
+				*dst++ = px[k];
+			}
+		}
+	}
+
+	Fl_RGB_Image *img = new Fl_RGB_Image(bytes, w, h, d);
+	img->alloc_array = 1;
+	return img;
+}
+
+void Tile_Cache::evict(size_t keep) {
+	while (_bytes > _max_bytes && _entries.size() > keep) {
+		Entry &e = _entries.back();
+		_bytes -= e.bytes;
+		_index.erase(e.key);
+		delete e.image;
+		_entries.pop_back();
+	}
+}
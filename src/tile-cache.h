@@ -0,0 +1,54 @@
+#ifndef TILE_CACHE_H
+#define TILE_CACHE_H
+
+#include <list>
+#include <unordered_map>
+
+#pragma warning(push, 0)
+#include <FL/Fl_RGB_Image.H>
+#pragma warning(pop)
+
+#include "utils.h"
+
+#define DEFAULT_TILE_CACHE_BYTES (32 * 1024 * 1024)
+
+// Zoomed and flipped copies of single tiles, and flipped copies of whole 1x tilesets, made when first
+// drawn and evicted least recently used first
+class Tile_Cache {
+private:
+	struct Key {
+		const Fl_RGB_Image *source;
+		uint32_t tile; // index, zoom, and flips; zoom 0 is a whole flipped tileset
+		inline bool operator==(const Key &k) const { return source == k.source && tile == k.tile; }
+	};
+	struct Key_Hash {
+		inline size_t operator()(const Key &k) const {
+			return std::hash<const void *>()(k.source) ^ (size_t)((uint64_t)k.tile * 0x9E3779B97F4A7C15ULL);
+		}
+	};
+	struct Entry {
+		Key key;
+		Fl_RGB_Image *image;
+		size_t bytes;
+	};
+	typedef std::list<Entry> Entries;
+	static Entries _entries; // most recently used first
+	static std::unordered_map<Key, Entries::iterator, Key_Hash> _index;
+	static size_t _bytes, _max_bytes;
+public:
+	static Fl_RGB_Image *tile(const Fl_RGB_Image *source, int index, int z, bool x_flip, bool y_flip);
+	static Fl_RGB_Image *flipped(const Fl_RGB_Image *source, bool x_flip, bool y_flip);
+	static void purge(const Fl_RGB_Image *source);
+	static void clear(void);
+	inline static size_t bytes(void) { return _bytes; }
+	inline static size_t max_bytes(void) { return _max_bytes; }
+	static void max_bytes(size_t m);
+private:
+	static Fl_RGB_Image *cached(const Key &key);
+	static void insert(const Key &key, Fl_RGB_Image *img);
+	static Fl_RGB_Image *make_tile(const Fl_RGB_Image *source, int index, int z, bool x_flip, bool y_flip);
+	static Fl_RGB_Image *make_flipped(const Fl_RGB_Image *source, bool x_flip, bool y_flip);
+	static void evict(size_t keep);
+};
+
+#endif
@@ -4,32 +4,35 @@
 #include "utils.h"
 #include "tile-buttons.h"
 
+class Workspace;
+
 class Tile_Selection {
 private:
-	Groupable *_tile1, *_tile2;
-	bool _dragging, _from_tileset;
+	size_t _row1, _col1, _row2, _col2;
+	uint16_t _id;
+	bool _selected, _extended, _dragging, _from_tileset;
 public:
-	inline Tile_Selection() : _tile1(NULL), _tile2(NULL), _dragging(false), _from_tileset(false) {}
-	inline bool selected(void) const { return !!_tile1; }
-	inline bool selected_multiple(void) const { return _tile1 && _tile2; }
+	inline Tile_Selection() : _row1(0), _col1(0), _row2(0), _col2(0), _id(0x000), _selected(false), _extended(false),
+		_dragging(false), _from_tileset(false) {}
+	inline bool selected(void) const { return _selected; }
+	inline bool selected_multiple(void) const { return _selected && _extended; }
 	inline bool selecting(void) const { return _dragging; }
 	inline bool from_tileset(void) const { return _from_tileset; }
-	inline uint16_t id(void) const { return _tile1->id(); }
-	inline size_t top_row(void) const { return _tile2 ? std::min(_tile1->row(), _tile2->row()) : _tile1->row(); }
-	inline size_t left_col(void) const { return _tile2 ? std::min(_tile1->col(), _tile2->col()) : _tile1->col(); }
-	void select_single(Tile_Button *tb);
-	void start_selecting(Tile_Tessera *tt);
-	void start_selecting(Tile_Button *tb);
-	inline void continue_selecting(Groupable *t) { _tile2 = t; }
+	inline uint16_t id(void) const { return _id; }
+	inline size_t top_row(void) const { return _extended ? std::min(_row1, _row2) : _row1; }
+	inline size_t left_col(void) const { return _extended ? std::min(_col1, _col2) : _col1; }
+	void select_single(size_t row, size_t col, uint16_t id);
+	void start_selecting(size_t row, size_t col, uint16_t id, bool from_tileset);
+	inline void continue_selecting(size_t row, size_t col) { _row2 = row; _col2 = col; _extended = true; }
+	inline void continue_selecting(void) { _extended = false; }
 	void finish_selecting(void);
 	inline size_t width(void) const {
-		return 1 + (_tile2 ? _tile1->col() > _tile2->col() ? _tile1->col() - _tile2->col() : _tile2->col() - _tile1->col() : 0);
+		return 1 + (_extended ? _col1 > _col2 ? _col1 - _col2 : _col2 - _col1 : 0);
 	}
 	inline size_t height(void) const {
-		return 1 + (_tile2 ? _tile1->row() > _tile2->row() ? _tile1->row() - _tile2->row() : _tile2->row() - _tile1->row() : 0);
+		return 1 + (_extended ? _row1 > _row2 ? _row1 - _row2 : _row2 - _row1 : 0);
 	}
-	inline void draw_selection_border_at(void) const { draw_selection_border_at(_tile1); }
-	void draw_selection_border_at(Groupable *t) const;
+	void draw_selection_border_at(int x, int y, int s, Workspace *p) const;
 };
 
 #endif
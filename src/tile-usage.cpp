@@ -0,0 +1,64 @@
+#include "tile-usage.h"
+
+static const std::vector<uint32_t> no_uses;
+
+static void insert_use(std::vector<std::vector<uint32_t>> &buckets, std::vector<uint32_t> &slots, size_t key,
+	uint32_t i) {
+	if (key >= buckets.size()) { buckets.resize(key + 1); }
+	std::vector<uint32_t> &bucket = buckets[key];
+	slots[i] = (uint32_t)bucket.size();
+	bucket.push_back(i);
+}
+
+// Moves the bucket's last tile into the removed tile's place
+static void erase_use(std::vector<std::vector<uint32_t>> &buckets, std::vector<uint32_t> &slots, size_t key,
+	uint32_t i) {
+	std::vector<uint32_t> &bucket = buckets[key];
+	uint32_t slot = slots[i], last = bucket.back();
+	bucket[slot] = last;
+	slots[last] = slot;
+	bucket.pop_back();
+}
+
+Tile_Usage::Tile_Usage() : _ids(), _attributes(), _id_slots(), _attribute_slots() {}
+
+void Tile_Usage::clear() {
+	std::vector<std::vector<uint32_t>>().swap(_ids);
+	std::vector<std::vector<uint32_t>>().swap(_attributes);
+	std::vector<uint32_t>().swap(_id_slots);
+	std::vector<uint32_t>().swap(_attribute_slots);
+}
+
+void Tile_Usage::build(const std::vector<Tile_State> &states) {
+	for (std::vector<uint32_t> &bucket : _ids) { bucket.clear(); }
+	for (std::vector<uint32_t> &bucket : _attributes) { bucket.clear(); }
+	_attributes.resize(NUM_ATTRIBUTE_KEYS);
+	size_t n = states.size();
+	_id_slots.resize(n);
+	_attribute_slots.resize(n);
+	for (size_t i = 0; i < n; i++) {
+		insert_use(_ids, _id_slots, states[i].id(), (uint32_t)i);
+		insert_use(_attributes, _attribute_slots, attribute_key(states[i]), (uint32_t)i);
+	}
+}
+
+void Tile_Usage::update(uint32_t i, const Tile_State &before, const Tile_State &after) {
+	if (before.id() != after.id()) {
+		erase_use(_ids, _id_slots, before.id(), i);
+		insert_use(_ids, _id_slots, after.id(), i);
+	}
+	size_t bk = attribute_key(before), ak = attribute_key(after);
+	if (bk != ak) {
+		erase_use(_attributes, _attribute_slots, bk, i);
+		insert_use(_attributes, _attribute_slots, ak, i);
+	}
+}
+
+const std::vector<uint32_t> &Tile_Usage::uses(uint16_t id) const {
+	return id < _ids.size() ? _ids[id] : no_uses;
+}
+
+const std::vector<uint32_t> &Tile_Usage::attribute_uses(const Tile_State &ts) const {
+	size_t key = attribute_key(ts);
+	return key < _attributes.size() ? _attributes[key] : no_uses;
+}
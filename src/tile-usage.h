@@ -0,0 +1,34 @@
+#ifndef TILE_USAGE_H
+#define TILE_USAGE_H
+
+#include <vector>
+
+#include "tile-buttons.h"
+
+// Which tiles of a tilemap use each tile ID and each combination of attributes, kept up to date
+// as tiles change, so a tile's uses can be found without scanning the whole tilemap
+class Tile_Usage {
+public:
+	static constexpr int ATTRIBUTES_SHIFT = 18;
+	static constexpr size_t NUM_ATTRIBUTE_KEYS = (Tile_State::ATTRIBUTES_MASK >> ATTRIBUTES_SHIFT) + 1;
+private:
+	// Each bucket lists tile indexes in no particular order, and each tile remembers its place in its buckets
+	std::vector<std::vector<uint32_t>> _ids, _attributes;
+	std::vector<uint32_t> _id_slots, _attribute_slots;
+public:
+	Tile_Usage();
+	void clear(void);
+	void build(const std::vector<Tile_State> &states);
+	void update(uint32_t i, const Tile_State &before, const Tile_State &after);
+	const std::vector<uint32_t> &uses(uint16_t id) const;
+	const std::vector<uint32_t> &attribute_uses(const Tile_State &ts) const;
+	inline size_t count(uint16_t id) const { return uses(id).size(); }
+private:
+	inline static size_t attribute_key(const Tile_State &ts) {
+		return (ts.bits() & Tile_State::ATTRIBUTES_MASK) >> ATTRIBUTES_SHIFT;
+	}
+};
+
+static_assert(!(Tile_State::ATTRIBUTES_MASK & ((1 << Tile_Usage::ATTRIBUTES_SHIFT) - 1)));
+
+#endif
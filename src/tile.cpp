@@ -1,92 +1,310 @@
 #include <algorithm>
+#include <cstring>
 
 #include "tile.h"
 #include "utils.h"
 
-bool is_blank_tile(const Tile &tile, Fl_Color blank_color) {
-	return std::all_of(RANGE(tile), [&](const Fl_Color &c) {
-		return c == blank_color;
-	});
+// 5-bit channel keys sort the same way as the normalized colors they stand for
+
+static inline size_t color_key(uchar r, uchar g, uchar b) {
+	return (size_t)(r >> 3) << 10 | (size_t)(g >> 3) << 5 | (size_t)(b >> 3);
 }
 
-bool are_identical_tiles(const Tile &t1, const Tile &t2, Tilemap_Format fmt, bool &x_flip, bool &y_flip) {
-	for (int i = 0; i < NUM_TILE_PIXELS; i++) {
-		if (t1[i] != t2[i]) {
-			goto not_identical;
-		}
-	}
-	return true;
-not_identical:
-	if (format_can_flip(fmt)) {
-		for (int y = 0; y < TILE_SIZE; y++) {
-			for (int x = 0; x < TILE_SIZE; x++) {
-				if (t1[y*TILE_SIZE+x] != t2[y*TILE_SIZE+TILE_SIZE-x-1]) {
-					goto not_x_flipped;
+static inline size_t color_key(Fl_Color c) {
+	return color_key((uchar)(c >> 24), (uchar)(c >> 16), (uchar)(c >> 8));
+}
+
+static inline Fl_Color key_color(size_t k, bool alt_norm) {
+	uchar r = (uchar)((k >> 10 & 0x1F) << 3), g = (uchar)((k >> 5 & 0x1F) << 3), b = (uchar)((k & 0x1F) << 3);
+	Fl_Color c = fl_rgb_color(NORMRGB(r), NORMRGB(g), NORMRGB(b));
+	if (alt_norm) { c &= ALT_NORM_MASK; }
+	return c;
+}
+
+// Only split images across threads when each thread gets enough rows of tiles to be worth it
+#define MIN_TILE_ROWS_PER_WORKER 16
+
+template<typename T>
+static void write_tile_indexes(T *indexes, const uchar *data, int w, int y0, int y1, int d, int ld, const std::vector<T> &lut) {
+	int dp = d > 1;
+	for (int y = y0; y < y1; y++) {
+		for (int x = 0; x < w; x++) {
+			T *tile = indexes + (size_t)(y * w + x) * NUM_TILE_PIXELS;
+			for (int ty = 0; ty < TILE_SIZE; ty++) {
+				const uchar *px = data + (y * TILE_SIZE + ty) * ld + x * TILE_SIZE * d;
+				for (int tx = 0; tx < TILE_SIZE; tx++, px += d) {
+					*tile++ = lut[color_key(px[0], px[dp], px[dp+dp])];
 				}
 			}
 		}
-		x_flip = true;
-		return true;
-not_x_flipped:
-		for (int y = 0; y < TILE_SIZE; y++) {
-			for (int x = 0; x < TILE_SIZE; x++) {
-				if (t1[y*TILE_SIZE+x] != t2[(TILE_SIZE-y-1)*TILE_SIZE+x]) {
-					goto not_y_flipped;
-				}
-			}
+	}
+}
+
+// Tile comparison kernels, selected at runtime by CPU support; n is a multiple of 32
+
+static bool equal_tiles_portable(const uchar *a, const uchar *b, size_t n) {
+	return !memcmp(a, b, n);
+}
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TILE_COMPARE_SSE2
+#endif
+
+#if defined(TILE_COMPARE_SSE2) && (defined(__GNUC__) || defined(_MSC_VER))
+#define TILE_COMPARE_AVX2
+#endif
+
+#ifdef TILE_COMPARE_SSE2
+#include <emmintrin.h>
+
+static bool equal_tiles_sse2(const uchar *a, const uchar *b, size_t n) {
+	__m128i diff = _mm_setzero_si128();
+	for (size_t i = 0; i < n; i += 16) {
+		__m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+		__m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+		diff = _mm_or_si128(diff, _mm_xor_si128(va, vb));
+	}
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) == 0xFFFF;
+}
+#endif
+
+#ifdef TILE_COMPARE_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+TARGET_AVX2 static bool equal_tiles_avx2(const uchar *a, const uchar *b, size_t n) {
+	__m256i diff = _mm256_setzero_si256();
+	for (size_t i = 0; i < n; i += 32) {
+		__m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+		__m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+		diff = _mm256_or_si256(diff, _mm256_xor_si256(va, vb));
+	}
+	return _mm256_testz_si256(diff, diff) != 0;
+}
+
+static bool cpu_has_avx2() {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) { return false; }
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0, avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) { return false; }
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+static Equal_Tiles_Fn select_equal_tiles() {
+#ifdef TILE_COMPARE_AVX2
+	if (cpu_has_avx2()) { return equal_tiles_avx2; }
+#endif
+#ifdef TILE_COMPARE_SSE2
+	return equal_tiles_sse2;
+#else
+	return equal_tiles_portable;
+#endif
+}
+
+static inline bool equal_tiles(const uchar *a, const uchar *b, size_t n) {
+	static const Equal_Tiles_Fn fn = select_equal_tiles();
+	return fn(a, b, n);
+}
+
+std::vector<Tile_Compare_Kernel> tile_compare_kernels() {
+	std::vector<Tile_Compare_Kernel> kernels;
+#ifdef TILE_COMPARE_AVX2
+	if (cpu_has_avx2()) { kernels.push_back({"avx2", equal_tiles_avx2}); }
+#endif
+#ifdef TILE_COMPARE_SSE2
+	kernels.push_back({"sse2", equal_tiles_sse2});
+#endif
+	kernels.push_back({"portable", equal_tiles_portable});
+	return kernels;
+}
+
+template<typename T>
+static void flip_tile(const T *src, T *dst, bool x_flip, bool y_flip) {
+	for (int y = 0; y < TILE_SIZE; y++) {
+		int sy = y_flip ? TILE_SIZE - y - 1 : y;
+		for (int x = 0; x < TILE_SIZE; x++) {
+			int sx = x_flip ? TILE_SIZE - x - 1 : x;
+			dst[y*TILE_SIZE+x] = src[sy*TILE_SIZE+sx];
 		}
-		y_flip = true;
-		return true;
-not_y_flipped:
-		for (int y = 0; y < TILE_SIZE; y++) {
-			for (int x = 0; x < TILE_SIZE; x++) {
-				if (t1[y*TILE_SIZE+x] != t2[(TILE_SIZE-y-1)*TILE_SIZE+TILE_SIZE-x-1]) {
-					goto not_xy_flipped;
-				}
+	}
+}
+
+template<typename T>
+static void orient_tile(const T *tile, bool can_flip, Tile_Orientations &to) {
+	// Flipping is its own inverse, so comparing a flipped form of this tile with another tile
+	// is the same as comparing this tile with that flipped form of the other tile
+	to.bytes = NUM_TILE_PIXELS * sizeof(T);
+	to.count = can_flip ? 4 : 1;
+	memcpy(to.data[0], tile, to.bytes);
+	if (can_flip) {
+		flip_tile(tile, reinterpret_cast<T *>(to.data[1]), true, false);
+		flip_tile(tile, reinterpret_cast<T *>(to.data[2]), false, true);
+		flip_tile(tile, reinterpret_cast<T *>(to.data[3]), true, true);
+	}
+}
+
+static inline uint64_t hash_index(uint64_t h, size_t c) {
+	// FNV-1a over whole color indexes
+	return (h ^ (uint64_t)c) * 0x100000001B3ULL;
+}
+
+template<typename T>
+static uint64_t canonical_hash(const T *tile, bool can_flip) {
+	// Tiles that are flips of each other (when the format allows flipping) get the same hash
+	uint64_t h = 0xCBF29CE484222325ULL, hx = h, hy = h, hxy = h;
+	for (int y = 0; y < TILE_SIZE; y++) {
+		for (int x = 0; x < TILE_SIZE; x++) {
+			h = hash_index(h, tile[y*TILE_SIZE+x]);
+			if (can_flip) {
+				hx = hash_index(hx, tile[y*TILE_SIZE+TILE_SIZE-x-1]);
+				hy = hash_index(hy, tile[(TILE_SIZE-y-1)*TILE_SIZE+x]);
+				hxy = hash_index(hxy, tile[(TILE_SIZE-y-1)*TILE_SIZE+TILE_SIZE-x-1]);
 			}
 		}
-		x_flip = y_flip = true;
-		return true;
 	}
-not_xy_flipped:
-	return false;
+	return can_flip ? std::min({h, hx, hy, hxy}) : h;
 }
 
-Tile *get_image_tiles(Fl_RGB_Image *img, size_t &n, size_t &iw, bool alt_norm, Fl_Color blank_color) {
-	if (!img) { return NULL; }
+Image_Tiles::Image_Tiles() : _colors(), _indexes(), _size(0), _width(0), _wide(false) {}
+
+size_t Image_Tiles::find_color(Fl_Color c) const {
+	auto it = std::lower_bound(RANGE(_colors), c);
+	return it != _colors.end() && *it == c ? (size_t)std::distance(_colors.begin(), it) : _colors.size();
+}
+
+bool Image_Tiles::read_tiles(Fl_RGB_Image *img, bool alt_norm, Fl_Color blank_color, size_t max_workers) {
+	_colors.clear();
+	_indexes.clear();
+	_size = _width = 0;
+	_wide = false;
+
+	if (!img) { return false; }
 
 	int w = img->w(), h = img->h();
-	if (w % TILE_SIZE || h % TILE_SIZE) { return NULL; }
+	if (w % TILE_SIZE || h % TILE_SIZE) { return false; }
 	w /= TILE_SIZE;
 	h /= TILE_SIZE;
-	n = (size_t)(w * h);
-	iw = (size_t)w;
 
 	const uchar *data = (const uchar *)img->data()[0];
 	int d = img->d(), ld = img->ld();
 	if (!ld) { ld = img->w() * d; }
 	int dp = d > 1;
 
-	Tile *tiles = new Tile[n + 1]();
-	for (int y = 0; y < h; y++) {
-		for (int x = 0; x < w; x++) {
-			int i = y * w + x;
-			for (int ty = 0; ty < TILE_SIZE; ty++) {
-				int oy = (y * TILE_SIZE + ty) * ld;
-				for (int tx = 0; tx < TILE_SIZE; tx++) {
-					int ox = (x * TILE_SIZE + tx) * d;
-					const uchar *px = data + oy + ox;
-					// Round color channels to 5 bits
-					uchar r = NORMRGB(px[0]), g = NORMRGB(px[dp]), b = NORMRGB(px[dp+dp]);
-					Fl_Color c = fl_rgb_color(r, g, b);
-					if (alt_norm) { c &= ALT_NORM_MASK; }
-					int ti = ty * TILE_SIZE + tx;
-					tiles[i][ti] = c;
-				}
+	// Each worker handles a band of tile rows, so the output is the same for any number of workers
+	size_t nw = num_workers((size_t)h, MIN_TILE_ROWS_PER_WORKER, max_workers);
+
+	// Find which normalized colors are used, including the blank color
+	std::vector<std::vector<uchar>> used(nw, std::vector<uchar>(NUM_NORM_COLORS, 0));
+	used[0][color_key(blank_color)] = 1;
+	parallel_for(nw, (size_t)h, [&](size_t wi, size_t y0, size_t y1) {
+		uchar *wused = used[wi].data();
+		for (int y = (int)y0 * TILE_SIZE; y < (int)y1 * TILE_SIZE; y++) {
+			const uchar *px = data + y * ld;
+			for (int x = 0; x < img->w(); x++, px += d) {
+				wused[color_key(px[0], px[dp], px[dp+dp])] = 1;
 			}
 		}
+	});
+	for (size_t wi = 1; wi < nw; wi++) {
+		for (size_t k = 0; k < NUM_NORM_COLORS; k++) {
+			used[0][k] |= used[wi][k];
+		}
+	}
+
+	// Intern the used colors in ascending order
+	std::vector<uint16_t> lut(NUM_NORM_COLORS, 0);
+	for (size_t k = 0; k < NUM_NORM_COLORS; k++) {
+		if (used[0][k]) {
+			lut[k] = (uint16_t)_colors.size();
+			_colors.push_back(key_color(k, alt_norm));
+		}
+	}
+
+	_size = (size_t)(w * h);
+	_width = (size_t)w;
+	_wide = _colors.size() > 0x100;
+
+	size_t np = (_size + 1) * NUM_TILE_PIXELS;
+	uint16_t bi = lut[color_key(blank_color)];
+	if (_wide) {
+		_indexes.resize(np * sizeof(uint16_t));
+		uint16_t *indexes = reinterpret_cast<uint16_t *>(_indexes.data());
+		parallel_for(nw, (size_t)h, [&](size_t, size_t y0, size_t y1) {
+			write_tile_indexes(indexes, data, w, (int)y0, (int)y1, d, ld, lut);
+		});
+		std::fill(indexes + np - NUM_TILE_PIXELS, indexes + np, bi); // Fail-safe blank tile at the end
+	}
+	else {
+		std::vector<uchar> lut8(RANGE(lut));
+		_indexes.resize(np);
+		uchar *indexes = _indexes.data();
+		parallel_for(nw, (size_t)h, [&](size_t, size_t y0, size_t y1) {
+			write_tile_indexes(indexes, data, w, (int)y0, (int)y1, d, ld, lut8);
+		});
+		std::fill(indexes + np - NUM_TILE_PIXELS, indexes + np, (uchar)bi); // Fail-safe blank tile at the end
+	}
+
+	return true;
+}
+
+bool Image_Tiles::is_blank_tile(size_t t, Fl_Color blank_color) const {
+	size_t bi = find_color(blank_color);
+	for (int i = 0; i < NUM_TILE_PIXELS; i++) {
+		if (index(t, i) != bi) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool Image_Tiles::are_identical_tiles(size_t t1, size_t t2, Tilemap_Format fmt, bool &x_flip, bool &y_flip) const {
+	Tile_Orientations to;
+	tile_orientations(t1, fmt, to);
+	return matches_tile(to, t2, x_flip, y_flip);
+}
+
+void Image_Tiles::tile_orientations(size_t t, Tilemap_Format fmt, Tile_Orientations &to) const {
+	bool can_flip = format_can_flip(fmt);
+	if (_wide) {
+		const uint16_t *indexes = reinterpret_cast<const uint16_t *>(_indexes.data());
+		orient_tile(indexes + t * NUM_TILE_PIXELS, can_flip, to);
+	}
+	else {
+		orient_tile(_indexes.data() + t * NUM_TILE_PIXELS, can_flip, to);
+	}
+}
+
+bool Image_Tiles::matches_tile(const Tile_Orientations &to, size_t t, bool &x_flip, bool &y_flip) const {
+	const uchar *tile = _indexes.data() + t * to.bytes;
+	for (int i = 0; i < to.count; i++) {
+		if (equal_tiles(to.data[i], tile, to.bytes)) {
+			x_flip = (i & 1) != 0;
+			y_flip = (i & 2) != 0;
+			return true;
+		}
 	}
-	std::fill(RANGE(tiles[n]), blank_color); // Fail-safe blank tile at the end
+	return false;
+}
 
-	return tiles;
+uint64_t Image_Tiles::canonical_tile_hash(size_t t, Tilemap_Format fmt) const {
+	bool can_flip = format_can_flip(fmt);
+	if (_wide) {
+		const uint16_t *indexes = reinterpret_cast<const uint16_t *>(_indexes.data());
+		return canonical_hash(indexes + t * NUM_TILE_PIXELS, can_flip);
+	}
+	return canonical_hash(_indexes.data() + t * NUM_TILE_PIXELS, can_flip);
 }
@@ -1,6 +1,8 @@
 #ifndef TILE_H
 #define TILE_H
 
+#include <vector>
+
 #pragma warning(push, 0)
 #include <FL/Fl_RGB_Image.H>
 #pragma warning(pop)
@@ -14,10 +16,55 @@
 #define NORMRGB(c) (uchar)(((c) & 0xF8) | (((c) & 0xF8) >> 5))
 #define ALT_NORM_MASK 0xF8F8F800 // clear the low 3 bits of each color channel
 
-typedef Fl_Color Tile[NUM_TILE_PIXELS];
+// Normalized colors only keep 5 bits per channel
+#define NUM_NORM_COLORS (1 << 15)
+
+// A tile and its x-, y- and xy-flipped forms, for comparing against many other tiles
+struct Tile_Orientations {
+	uchar data[4][NUM_TILE_PIXELS * sizeof(uint16_t)];
+	size_t bytes;
+	int count;
+};
+
+typedef bool (*Equal_Tiles_Fn)(const uchar *a, const uchar *b, size_t n);
+
+// A tile comparison kernel, named for benchmarks
+struct Tile_Compare_Kernel {
+	const char *name;
+	Equal_Tiles_Fn equal;
+};
+
+// The kernels this CPU can run, starting with the one used for comparing tiles
+std::vector<Tile_Compare_Kernel> tile_compare_kernels(void);
 
-bool is_blank_tile(const Tile &tile, Fl_Color blank_color);
-bool are_identical_tiles(const Tile &t1, const Tile &t2, Tilemap_Format fmt, bool &x_flip, bool &y_flip);
-Tile *get_image_tiles(Fl_RGB_Image *img, size_t &n, size_t &iw, bool alt_norm, Fl_Color blank_color);
+// The tiles of an image, with each pixel stored as an index into the image's unique colors
+class Image_Tiles {
+private:
+	// Unique colors in ascending order, so index order matches color order
+	std::vector<Fl_Color> _colors;
+	// (size + 1) * NUM_TILE_PIXELS indexes, one byte each or two if wide; the last tile is blank
+	std::vector<uchar> _indexes;
+	size_t _size, _width;
+	bool _wide;
+public:
+	Image_Tiles();
+	inline size_t size(void) const { return _size; }
+	inline size_t width(void) const { return _width; }
+	inline size_t num_colors(void) const { return _colors.size(); }
+	inline Fl_Color color(size_t ci) const { return _colors[ci]; }
+	inline bool wide(void) const { return _wide; }
+	inline size_t index(size_t t, int p) const {
+		size_t i = t * NUM_TILE_PIXELS + (size_t)p;
+		return _wide ? (size_t)reinterpret_cast<const uint16_t *>(_indexes.data())[i] : (size_t)_indexes[i];
+	}
+	inline Fl_Color pixel(size_t t, int p) const { return _colors[index(t, p)]; }
+	size_t find_color(Fl_Color c) const;
+	bool read_tiles(Fl_RGB_Image *img, bool alt_norm, Fl_Color blank_color, size_t max_workers = 0);
+	bool is_blank_tile(size_t t, Fl_Color blank_color) const;
+	bool are_identical_tiles(size_t t1, size_t t2, Tilemap_Format fmt, bool &x_flip, bool &y_flip) const;
+	void tile_orientations(size_t t, Tilemap_Format fmt, Tile_Orientations &to) const;
+	bool matches_tile(const Tile_Orientations &to, size_t t, bool &x_flip, bool &y_flip) const;
+	uint64_t canonical_tile_hash(size_t t, Tilemap_Format fmt) const;
+};
 
 #endif
@@ -1,4 +1,7 @@
 #include <cstring>
+#include <algorithm>
+#include <array>
+#include <utility>
 
 #pragma warning(push, 0)
 #include <FL/filename.H>
@@ -225,144 +228,137 @@ Tilemap_Format guess_format(const char *filename) {
 	return Tilemap_Format::PLAIN;
 }
 
-std::vector<uchar> make_tilemap_bytes(const std::vector<Tile_Tessera *> &tiles, Tilemap_Format fmt, size_t width, size_t height) {
-	std::vector<uchar> bytes;
-	size_t n = tiles.size();
+static_assert(Tile_State::ID_MASK == 0xFFFF << TILE_ID_BIT && Tile_State::X_FLIP_BIT == 1 << TILE_X_FLIP_BIT &&
+	Tile_State::Y_FLIP_BIT == 1 << TILE_Y_FLIP_BIT && Tile_State::PRIORITY_BIT == 1 << TILE_PRIORITY_BIT &&
+	Tile_State::OBP1_BIT == 1 << TILE_OBP1_BIT && Tile_State::PALETTE_SHIFT == TILE_PALETTE_BIT &&
+	Tile_State::NO_PALETTE_BIT == 1 << TILE_NO_PALETTE_BIT, "Format codecs must match Tile_State's bits");
 
-	if (fmt == Tilemap_Format::PLAIN || fmt == Tilemap_Format::GSC_TOWN_MAP || fmt == Tilemap_Format::PC_TOWN_MAP) {
-		bytes.reserve(n + 1);
-		for (Tile_Tessera *tt : tiles) {
-			uchar v = (uchar)tt->id();
-			if (tt->x_flip()) { v |= 0x40; }
-			if (tt->y_flip()) { v |= 0x80; }
-			bytes.push_back(v);
-		}
-	}
-	else if (fmt == Tilemap_Format::GBC_ATTRS) {
-		bytes.reserve(n * 2);
-		for (Tile_Tessera *tt : tiles) {
-			uchar v = (uchar)(tt->id() & 0xFF);
-			bytes.push_back(v);
-			uchar a = 0;
-			if (tt->id() & 0x100) { a |= 0x08; }
-			if (tt->obp1())     { a |= 0x10; }
-			if (tt->priority()) { a |= 0x80; }
-			if (tt->x_flip())   { a |= 0x20; }
-			if (tt->y_flip())   { a |= 0x40; }
-			if (tt->palette() > -1) { a |= tt->palette() & 0x07; }
-			bytes.push_back(a);
-		}
-	}
-	else if (fmt == Tilemap_Format::GBC_ATTRMAP) {
-		bytes.reserve(n * 2);
-		for (Tile_Tessera *tt : tiles) {
-			uchar v = (uchar)(tt->id() & 0xFF);
-			bytes.push_back(v);
-		}
-		for (Tile_Tessera *tt : tiles) {
-			uchar a = 0;
-			if (tt->id() & 0x100) { a |= 0x08; }
-			if (tt->obp1())     { a |= 0x10; }
-			if (tt->priority()) { a |= 0x80; }
-			if (tt->x_flip())   { a |= 0x20; }
-			if (tt->y_flip())   { a |= 0x40; }
-			if (tt->palette() > -1) { a |= tt->palette() & 0x07; }
-			bytes.push_back(a);
+void write_nds_header(uchar *header, size_t n, size_t width, size_t height) {
+	// <https://www.romhacking.net/documents/[469]nds_formats.htm#NSCR>
+	const uchar nds_header[NDS_HEADER_SIZE] = {
+		// Generic header
+		'R', 'C', 'S', 'N', // magic number
+		0xFF, 0xFE, 0, 1,   // constant 0xFFFE0001
+		LE32(n * 2 + 0x24), // section size
+		LE16(0x10),         // header size
+		LE16(1),            // number of sub-sections
+		// Nintendo Screen Resource header
+		'N', 'R', 'C', 'S', // magic number
+		LE32(n * 2 + 0x14), // sub-section size
+		LE16(width * 8),    // width in pixels
+		LE16(height * 8),   // height in pixels
+		0, 0, 0, 0,         // padding
+		LE32(n * 2)         // screen data size
+	};
+	memcpy(header, nds_header, NDS_HEADER_SIZE);
+}
+
+// Each format's fixed-size entries get their own loop, with the codec's fields known at compile time
+template<Tilemap_Format F>
+static void encode_entries(const Tile_State *states, size_t n, uchar *bytes, uchar *attrs) {
+	constexpr const Format_Codec &codec = format_codec(F);
+	for (size_t i = 0; i < n; i++) {
+		uint16_t entry = codec.encode(states[i].bits());
+		if constexpr (codec.entry_bytes == 1) {
+			bytes[i] = (uchar)entry;
 		}
-	}
-	else if (fmt == Tilemap_Format::GBA_4BPP || fmt == Tilemap_Format::GBA_8BPP ||
-		fmt == Tilemap_Format::NDS_4BPP || fmt == Tilemap_Format::NDS_8BPP) {
-		if (fmt == Tilemap_Format::GBA_4BPP || fmt == Tilemap_Format::GBA_8BPP) {
-			bytes.reserve(n * 2);
+		else if constexpr (codec.planar) {
+			bytes[i] = (uchar)(entry & 0xFF);
+			attrs[i] = (uchar)(entry >> 8);
 		}
 		else {
-			// <https://www.romhacking.net/documents/[469]nds_formats.htm#NSCR>
-			bytes.reserve(n * 2 + NDS_HEADER_SIZE);
-			uchar header[NDS_HEADER_SIZE] = {
-				// Generic header
-				'R', 'C', 'S', 'N', // magic number
-				0xFF, 0xFE, 0, 1,   // constant 0xFFFE0001
-				LE32(n * 2 + 0x24), // section size
-				LE16(0x10),         // header size
-				LE16(1),            // number of sub-sections
-				// Nintendo Screen Resource header
-				'N', 'R', 'C', 'S', // magic number
-				LE32(n * 2 + 0x14), // sub-section size
-				LE16(width * 8),    // width in pixels
-				LE16(height * 8),   // height in pixels
-				0, 0, 0, 0,         // padding
-				LE32(n * 2)         // screen data size
-			};
-			bytes.insert(bytes.begin(), RANGE(header));
-		}
-		for (Tile_Tessera *tt : tiles) {
-			uchar v = (uchar)(tt->id() & 0xFF);
-			bytes.push_back(v);
-			uchar a = (tt->id() >> 8) & 0x03;
-			if (tt->x_flip()) { a |= 0x04; }
-			if (tt->y_flip()) { a |= 0x08; }
-			if (tt->palette() > -1) { a |= (tt->palette() << 4) & 0xF0; }
-			bytes.push_back(a);
+			bytes[i * 2] = (uchar)(entry & 0xFF);
+			bytes[i * 2 + 1] = (uchar)(entry >> 8);
 		}
 	}
-	else if (fmt == Tilemap_Format::SGB_BORDER) {
-		bytes.reserve(n * 2);
-		for (Tile_Tessera *tt : tiles) {
-			uchar v = (uchar)(tt->id() & 0xFF);
-			bytes.push_back(v);
-			uchar a = 0x10;
-			if (tt->x_flip()) { a |= 0x40; }
-			if (tt->y_flip()) { a |= 0x80; }
-			if (tt->palette() > -1) { a |= (tt->palette() << 2) & 0x0C; }
-			bytes.push_back(a);
-		}
+}
+
+typedef void (*Entry_Encoder)(const Tile_State *states, size_t n, uchar *bytes, uchar *attrs);
+
+template<size_t... I>
+static constexpr std::array<Entry_Encoder, NUM_FORMATS> make_entry_encoders(std::index_sequence<I...>) {
+	return {encode_entries<(Tilemap_Format)I>...};
+}
+
+static constexpr std::array<Entry_Encoder, NUM_FORMATS> entry_encoders =
+	make_entry_encoders(std::make_index_sequence<NUM_FORMATS>());
+
+// Returns the length of the run of identical entries starting at i, and sets v to the entry
+static size_t rle_run(const Format_Codec &codec, const std::vector<Tile_State> &states, size_t i, uchar &v) {
+	size_t n = states.size(), r = 1, max_run = (size_t)codec.max_run();
+	v = (uchar)codec.encode(states[i].bits());
+	while (i + r < n && r < max_run && (uchar)codec.encode(states[i + r].bits()) == v) {
+		r++;
 	}
-	else if (fmt == Tilemap_Format::SNES_ATTRS) {
-		bytes.reserve(n * 2);
-		for (Tile_Tessera *tt : tiles) {
-			uchar v = (uchar)(tt->id() & 0xFF);
-			bytes.push_back(v);
-			uchar a = (tt->id() >> 8) & 0x03;
-			if (tt->priority()) { a |= 0x20; }
-			if (tt->x_flip())   { a |= 0x40; }
-			if (tt->y_flip())   { a |= 0x80; }
-			if (tt->palette() > -1) { a |= (tt->palette() << 2) & 0x1C; }
-			bytes.push_back(a);
-		}
+	return r;
+}
+
+Tilemap_Encoder::Tilemap_Encoder(const std::vector<Tile_State> &states, Tilemap_Format fmt, size_t width, size_t height) :
+	_states(states), _fmt(fmt), _width(width), _height(height), _index(0), _size(0), _started(false), _finished(false) {
+	const Format_Codec &codec = format_codec(fmt);
+	size_t n = states.size();
+	if (codec.rle == Format_Rle::NONE) {
+		_size = codec.header_size + n * (codec.planar ? 1 : codec.entry_bytes);
 	}
-	else if (fmt == Tilemap_Format::RBY_TOWN_MAP) {
-		bytes.reserve(n);
-		for (size_t i = 0; i < n;) {
-			Tile_Tessera *tt = tiles[i++];
-			uchar v = (uchar)tt->id(), r = 1;
-			while (i < n && (uchar)tiles[i]->id() == v) {
-				i++;
-				if (++r == 0x0F) { break; } // maximum nybble
-			}
-			uchar b = (v << 4) | r;
-			bytes.push_back(b);
+	else {
+		size_t stride = codec.rle == Format_Rle::NYBBLES ? 1 : 2;
+		uchar v;
+		for (size_t i = 0; i < n; _size += stride) {
+			i += rle_run(codec, states, i, v);
 		}
 	}
-	else if (fmt == Tilemap_Format::POKEGEAR_CARD || fmt == Tilemap_Format::SW_TOWN_MAP) {
-		bytes.reserve(n + 1);
-		for (size_t i = 0; i < n;) {
-			Tile_Tessera *tt = tiles[i++];
-			uchar v = (uchar)tt->id(), r = 1;
-			while (i < n && (uchar)tiles[i]->id() == v) {
-				i++;
-				if (++r == 0xFF) { break; } // maximum byte
-			}
-			bytes.push_back(v);
-			bytes.push_back(r);
+	if (codec.terminator != -1) {
+		_size++;
+	}
+}
+
+void Tilemap_Encoder::rewind() {
+	_index = 0;
+	_started = false;
+	_finished = false;
+}
+
+size_t Tilemap_Encoder::next(uchar *bytes, uchar *attrs) {
+	if (_finished) { return 0; }
+	const Format_Codec &codec = format_codec(_fmt);
+	size_t n = _states.size(), c = 0;
+
+	if (!_started) {
+		if (codec.write_header) {
+			codec.write_header(bytes, n, _width, _height);
 		}
+		c = codec.header_size;
+		_started = true;
 	}
 
-	if (fmt == Tilemap_Format::RBY_TOWN_MAP || fmt == Tilemap_Format::SW_TOWN_MAP) {
-		bytes.push_back(0x00);
+	if (codec.rle == Format_Rle::NONE) {
+		size_t stride = codec.planar ? 1 : codec.entry_bytes;
+		size_t k = std::min(n - _index, (TILEMAP_CHUNK_SIZE - c) / stride);
+		entry_encoders[(int)_fmt](_states.data() + _index, k, bytes + c, codec.planar ? attrs + c : NULL);
+		_index += k;
+		c += k * stride;
 	}
-	else if (fmt == Tilemap_Format::GSC_TOWN_MAP || fmt == Tilemap_Format::PC_TOWN_MAP || fmt == Tilemap_Format::POKEGEAR_CARD) {
-		bytes.push_back(0xFF);
+	else {
+		size_t stride = codec.rle == Format_Rle::NYBBLES ? 1 : 2;
+		while (_index < n && c + stride <= TILEMAP_CHUNK_SIZE) {
+			uchar v;
+			size_t r = rle_run(codec, _states, _index, v);
+			_index += r;
+			if (codec.rle == Format_Rle::NYBBLES) {
+				bytes[c++] = (uchar)((v << 4) | r);
+			}
+			else {
+				bytes[c++] = v;
+				bytes[c++] = (uchar)r;
+			}
+		}
 	}
 
-	return bytes;
+	if (_index == n && c < TILEMAP_CHUNK_SIZE) {
+		if (codec.terminator != -1) {
+			bytes[c++] = (uchar)codec.terminator;
+		}
+		_finished = true;
+	}
+	return c;
 }
@@ -2,6 +2,7 @@
 #define TILEMAP_FORMAT_H
 
 #include <vector>
+#include <stdint.h>
 
 #pragma warning(push, 0)
 #include <FL/fl_types.h>
@@ -86,8 +87,155 @@ int format_bytes_per_tile(Tilemap_Format fmt);
 
 Tilemap_Format guess_format(const char *filename);
 
-class Tile_Tessera;
+void write_nds_header(uchar *header, size_t n, size_t width, size_t height);
+
+// Bit positions of a packed Tile_State's fields, which format codecs move entry bits into
+#define TILE_ID_BIT 0
+#define TILE_X_FLIP_BIT 16
+#define TILE_Y_FLIP_BIT 17
+#define TILE_PRIORITY_BIT 18
+#define TILE_OBP1_BIT 19
+#define TILE_PALETTE_BIT 20
+#define TILE_NO_PALETTE_BIT 24
+
+enum class Format_Rle { NONE, NYBBLES, PAIRS };
+
+// One field of a tilemap entry: the entry bits in mask, moved from entry_bit to tile_bit of a Tile_State
+struct Format_Field {
+	uint16_t mask;
+	int shift;
+	inline constexpr Format_Field(uint16_t m = 0, int entry_bit = 0, int tile_bit = 0) : mask(m),
+		shift(tile_bit - entry_bit) {}
+	inline constexpr uint32_t decode(uint16_t entry) const {
+		uint32_t v = entry & mask;
+		return shift >= 0 ? v << shift : v >> -shift;
+	}
+	inline constexpr uint16_t encode(uint32_t bits) const {
+		return (uint16_t)((shift >= 0 ? bits >> shift : bits << -shift) & mask);
+	}
+};
+
+#define MAX_FORMAT_FIELDS 8
+
+// How a format stores its tiles. Each entry is one tile byte, then an attribute byte if entry_bytes is 2,
+// read as one little-endian word; both the reader and the writer of every format are generated from this.
+struct Format_Codec {
+	int entry_bytes;
+	// Attribute bytes are stored after all the tile bytes, or in a separate attrmap when reading
+	bool planar;
+	Format_Field fields[MAX_FORMAT_FIELDS];
+	// Tile_State bits set in every tile read, and entry bits set in every tile written
+	uint32_t decoded_bits;
+	uint16_t encoded_bits;
+	size_t header_size;
+	void (*write_header)(uchar *header, size_t n, size_t width, size_t height);
+	// End marker byte, or -1 if the entries fill the file
+	int terminator;
+	// NYBBLES packs (id << 4) | run into each byte; PAIRS stores an id byte, then a run byte
+	Format_Rle rle;
+	size_t width;
+	inline constexpr int max_run(void) const {
+		return rle == Format_Rle::NYBBLES ? 0x0F : terminator == 0xFF ? 0xFE : 0xFF;
+	}
+	inline constexpr uint32_t decode(uint16_t entry) const {
+		uint32_t bits = decoded_bits;
+		for (const Format_Field &f : fields) { bits |= f.decode(entry); }
+		return bits;
+	}
+	inline constexpr uint16_t encode(uint32_t bits) const {
+		uint16_t entry = encoded_bits;
+		for (const Format_Field &f : fields) { entry |= f.encode(bits); }
+		return entry;
+	}
+};
+
+#define NO_PALETTE (1UL << TILE_NO_PALETTE_BIT)
+
+#define ID_FIELD(m) Format_Field((m), 0, TILE_ID_BIT)
+#define ID_HI_FIELD(m, b) Format_Field((m), (b), TILE_ID_BIT + 8)
+#define X_FLIP_FIELD(b) Format_Field(1 << (b), (b), TILE_X_FLIP_BIT)
+#define Y_FLIP_FIELD(b) Format_Field(1 << (b), (b), TILE_Y_FLIP_BIT)
+#define PRIORITY_FIELD(b) Format_Field(1 << (b), (b), TILE_PRIORITY_BIT)
+#define OBP1_FIELD(b) Format_Field(1 << (b), (b), TILE_OBP1_BIT)
+#define PALETTE_FIELD(m, b) Format_Field((m), (b), TILE_PALETTE_BIT)
+
+inline constexpr Format_Codec format_codecs[NUM_FORMATS] = {
+	// PLAIN
+	{1, false, {ID_FIELD(0xFF)}, NO_PALETTE, 0, 0, NULL, -1, Format_Rle::NONE, 0},
+	// GBC_ATTRS
+	{2, false, {ID_FIELD(0xFF), ID_HI_FIELD(0x0800, 11), X_FLIP_FIELD(13), Y_FLIP_FIELD(14), PRIORITY_FIELD(15),
+		OBP1_FIELD(12), PALETTE_FIELD(0x0700, 8)}, 0, 0, 0, NULL, -1, Format_Rle::NONE, 0},
+	// GBC_ATTRMAP
+	{2, true, {ID_FIELD(0xFF), ID_HI_FIELD(0x0800, 11), X_FLIP_FIELD(13), Y_FLIP_FIELD(14), PRIORITY_FIELD(15),
+		OBP1_FIELD(12), PALETTE_FIELD(0x0700, 8)}, 0, 0, 0, NULL, -1, Format_Rle::NONE, 0},
+	// GBA_4BPP
+	{2, false, {ID_FIELD(0x03FF), X_FLIP_FIELD(10), Y_FLIP_FIELD(11), PALETTE_FIELD(0xF000, 12)}, 0, 0, 0, NULL, -1,
+		Format_Rle::NONE, 0},
+	// GBA_8BPP
+	{2, false, {ID_FIELD(0x03FF), X_FLIP_FIELD(10), Y_FLIP_FIELD(11)}, 0, 0, 0, NULL, -1, Format_Rle::NONE, 0},
+	// NDS_4BPP
+	{2, false, {ID_FIELD(0x03FF), X_FLIP_FIELD(10), Y_FLIP_FIELD(11), PALETTE_FIELD(0xF000, 12)}, 0, 0,
+		NDS_HEADER_SIZE, write_nds_header, -1, Format_Rle::NONE, NDS_WIDTH},
+	// NDS_8BPP
+	{2, false, {ID_FIELD(0x03FF), X_FLIP_FIELD(10), Y_FLIP_FIELD(11)}, 0, 0, NDS_HEADER_SIZE, write_nds_header, -1,
+		Format_Rle::NONE, NDS_WIDTH},
+	// SGB_BORDER
+	{2, false, {ID_FIELD(0xFF), X_FLIP_FIELD(14), Y_FLIP_FIELD(15), PALETTE_FIELD(0x0C00, 10)}, 0, 0x1000, 0, NULL, -1,
+		Format_Rle::NONE, SGB_WIDTH},
+	// SNES_ATTRS
+	{2, false, {ID_FIELD(0x03FF), X_FLIP_FIELD(14), Y_FLIP_FIELD(15), PRIORITY_FIELD(13), PALETTE_FIELD(0x1C00, 10)},
+		0, 0, 0, NULL, -1, Format_Rle::NONE, 0},
+	// RBY_TOWN_MAP
+	{1, false, {ID_FIELD(0xFF)}, NO_PALETTE, 0, 0, NULL, 0x00, Format_Rle::NYBBLES, GAME_BOY_WIDTH},
+	// GSC_TOWN_MAP
+	{1, false, {ID_FIELD(0xFF)}, NO_PALETTE, 0, 0, NULL, 0xFF, Format_Rle::NONE, GAME_BOY_WIDTH},
+	// PC_TOWN_MAP
+	{1, false, {ID_FIELD(0x3F), X_FLIP_FIELD(6), Y_FLIP_FIELD(7)}, NO_PALETTE, 0, 0, NULL, 0xFF, Format_Rle::NONE,
+		GAME_BOY_WIDTH},
+	// SW_TOWN_MAP
+	{1, false, {ID_FIELD(0xFF)}, NO_PALETTE, 0, 0, NULL, 0x00, Format_Rle::PAIRS, GAME_BOY_WIDTH},
+	// POKEGEAR_CARD
+	{1, false, {ID_FIELD(0xFF)}, NO_PALETTE, 0, 0, NULL, 0xFF, Format_Rle::PAIRS, GAME_BOY_WIDTH},
+};
+
+#undef ID_FIELD
+#undef ID_HI_FIELD
+#undef X_FLIP_FIELD
+#undef Y_FLIP_FIELD
+#undef PRIORITY_FIELD
+#undef OBP1_FIELD
+#undef PALETTE_FIELD
+#undef NO_PALETTE
+
+inline constexpr const Format_Codec &format_codec(Tilemap_Format fmt) {
+	return format_codecs[(int)fmt];
+}
+
+// Two-byte entries can be exported as 16-bit words unless their bytes are split into planes
+inline constexpr bool format_can_export_words(Tilemap_Format fmt) {
+	return format_codec(fmt).entry_bytes == 2 && !format_codec(fmt).planar;
+}
 
-std::vector<uchar> make_tilemap_bytes(const std::vector<Tile_Tessera *> &tiles, Tilemap_Format fmt, size_t width, size_t height);
+struct Tile_State;
+
+// Encoders fill buffers of this many bytes per plane at a time
+#define TILEMAP_CHUNK_SIZE 4096
+
+// Encodes a tilemap one chunk at a time, so it can be written without holding all of its bytes
+class Tilemap_Encoder {
+private:
+	const std::vector<Tile_State> &_states;
+	Tilemap_Format _fmt;
+	size_t _width, _height, _index, _size;
+	bool _started, _finished;
+public:
+	Tilemap_Encoder(const std::vector<Tile_State> &states, Tilemap_Format fmt, size_t width, size_t height);
+	// Bytes in the tilemap, or in each of the tilemap and attrmap if they are planar
+	inline size_t size(void) const { return _size; }
+	inline bool done(void) const { return _finished; }
+	void rewind(void);
+	// Fills up to TILEMAP_CHUNK_SIZE bytes of each plane; attrs is only written for planar formats
+	size_t next(uchar *bytes, uchar *attrs);
+};
 
 #endif
@@ -1,525 +1,529 @@
 #include <cstdio>
 #include <cctype>
+#include <algorithm>
+#include <array>
+#include <utility>
 
 #pragma warning(push, 0)
 #include <FL/filename.H>
 #pragma warning(pop)
 
+#include "mapped-file.h"
+#include "file-sink.h"
 #include "tilemap.h"
 #include "tileset.h"
 #include "config.h"
 #include "version.h"
 
-Tilemap::Tilemap() : _tiles(), _width(0), _result(Result::TILEMAP_NULL), _modified(false), _history(), _future() {}
+Tilemap::Tilemap() : _states(), _usage(), _width(0), _result(Result::TILEMAP_NULL), _error_line(0), _error_column(0),
+	_modified(false), _history(), _future(), _history_bytes(0), _recording(false), _recorded() {}
 
 Tilemap::~Tilemap() {
 	clear();
 }
 
-void Tilemap::width(size_t w) {
-	_width = w;
-	size_t n = size();
-	for (size_t i = 0; i < n; i++) {
-		Tile_Tessera *tt = _tiles[i];
-		tt->coords(i / w, i % w);
-	}
-}
-
 void Tilemap::resize(size_t w, size_t h, int px, int py) {
-	size_t n = w * h;
-	std::vector<Tile_Tessera *> tiles;
-	tiles.reserve(n);
-	int mx = std::max(px, 0), my = std::max(py, 0), mw = std::min(w, width() + px), mh = std::min(h, height() + py);
-	for (int y = 0; y < py; y++) {
-		for (int x = 0; x < (int)w; x++) {
-			tiles.emplace_back(new Tile_Tessera());
-		}
-	}
-	for (int y = my; y < mh; y++) {
-		for (int x = 0; x < px; x++) {
-			tiles.emplace_back(new Tile_Tessera());
-		}
-		for (int x = mx; x < mw; x++) {
-			Tile_Tessera *tt = tile(x - px, y - py);
-			tiles.emplace_back(tt ? tt : new Tile_Tessera());
-		}
-		for (int x = mw; x < (int)w; x++) {
-			tiles.emplace_back(new Tile_Tessera());
-		}
-	}
-	for (int y = mh; y < (int)h; y++) {
-		for (int x = 0; x < (int)w; x++) {
-			tiles.emplace_back(new Tile_Tessera());
-		}
+	Tilemap_Edit &edit = remember_structure(Tilemap_Edit::Kind::RESIZE);
+	edit.old_width = _width;
+	edit.old_size = size();
+	edit.new_width = w;
+	edit.new_size = w * h;
+	edit.dx = px;
+	edit.dy = py;
+	if (format_can_edit_palettes(Config::format())) {
+		edit.blank.palette(0);
 	}
 
-	if (format_can_edit_palettes(Config::format())) {
-		for (Tile_Tessera *tt : tiles) {
-			if (tt->palette() == -1) {
-				tt->palette(0);
-			}
+	// Keep the tiles that fall outside the new bounds, and the palettes of kept tiles that need one
+	for (size_t i = 0; i < size(); i++) {
+		long long x = (long long)(i % _width) + px, y = (long long)(i / _width) + py;
+		if (x < 0 || y < 0 || x >= (long long)w || y >= (long long)h) {
+			edit.lost.push_back(_states[i]);
+		}
+		else if (_states[i].palette() == -1 && edit.blank.palette() != -1) {
+			Tile_State ts = _states[i];
+			ts.palette(edit.blank.palette());
+			edit.changes.push_back({(uint32_t)(y * w + x), _states[i], ts});
 		}
 	}
+	_history_bytes += edit.lost.capacity() * sizeof(Tile_State) + edit.changes.capacity() * sizeof(Tile_Change);
 
-	clear();
-	_tiles.swap(tiles);
-	width(w);
+	reshape(edit);
 	_modified = true;
+	trim_history();
 }
 
 void Tilemap::shift(int dx, int dy) {
 	if (!is_rectangular()) { return; }
 
-	size_t n = size();
-	std::vector<Tile_Tessera *> tiles;
-	tiles.reserve(n);
+	Tilemap_Edit &edit = remember_structure(Tilemap_Edit::Kind::SHIFT);
+	edit.old_width = edit.new_width = _width;
+	edit.old_size = edit.new_size = size();
+	edit.dx = dx;
+	edit.dy = dy;
 
-	int w = (int)width(), h = (int)height();
-	for (int y = 0; y < h; y++) {
-		for (int x = 0; x < w; x++) {
-			tiles.emplace_back(tile((x + w - dx) % w, (y + h - dy) % h));
-		}
-	}
-
-	_tiles.swap(tiles);
+	shift_states(_width, dx, dy);
 	_modified = true;
 }
 
 void Tilemap::transpose() {
 	if (!is_rectangular()) { return; }
 
-	size_t n = size();
-	std::vector<Tile_Tessera *> tiles;
-	tiles.reserve(n);
+	Tilemap_Edit &edit = remember_structure(Tilemap_Edit::Kind::TRANSPOSE);
+	edit.old_width = _width;
+	edit.new_width = height();
+	edit.old_size = edit.new_size = size();
+
+	transpose_states(_width);
+	_modified = true;
+}
+
+void Tilemap::reshape(const Tilemap_Edit &edit) {
+	std::vector<Tile_State> states(edit.new_size, edit.blank);
+	size_t w = edit.new_width, h = w ? edit.new_size / w : 0;
+	for (size_t i = 0; i < edit.old_size; i++) {
+		long long x = (long long)(i % edit.old_width) + edit.dx, y = (long long)(i / edit.old_width) + edit.dy;
+		if (x >= 0 && y >= 0 && x < (long long)w && y < (long long)h) {
+			states[(size_t)y * w + (size_t)x] = _states[i];
+		}
+	}
+	for (const Tile_Change &change : edit.changes) {
+		states[change.index] = change.after;
+	}
+	_states.swap(states);
+	_usage.build(_states);
+	_width = w;
+}
+
+void Tilemap::unshape(const Tilemap_Edit &edit) {
+	for (auto it = edit.changes.rbegin(); it != edit.changes.rend(); ++it) {
+		_states[it->index] = it->before;
+	}
+	std::vector<Tile_State> states;
+	states.reserve(edit.old_size);
+	size_t w = edit.new_width, h = w ? edit.new_size / w : 0;
+	auto lost = edit.lost.begin();
+	for (size_t i = 0; i < edit.old_size; i++) {
+		long long x = (long long)(i % edit.old_width) + edit.dx, y = (long long)(i / edit.old_width) + edit.dy;
+		if (x >= 0 && y >= 0 && x < (long long)w && y < (long long)h) {
+			states.push_back(_states[(size_t)y * w + (size_t)x]);
+		}
+		else {
+			states.push_back(*lost++);
+		}
+	}
+	_states.swap(states);
+	_usage.build(_states);
+	_width = edit.old_width;
+}
+
+void Tilemap::shift_states(size_t w, int dx, int dy) {
+	std::vector<Tile_State> states;
+	states.reserve(size());
+
+	int iw = (int)w, ih = (int)(size() / w);
+	dx %= iw;
+	dy %= ih;
+	for (int y = 0; y < ih; y++) {
+		int sy = (y + ih - dy) % ih;
+		for (int x = 0; x < iw; x++) {
+			states.push_back(_states[sy * iw + (x + iw - dx) % iw]);
+		}
+	}
+
+	_states.swap(states);
+	_usage.build(_states);
+	_width = w;
+}
+
+void Tilemap::transpose_states(size_t w) {
+	std::vector<Tile_State> states;
+	states.reserve(size());
 
-	size_t w = width(), h = height();
+	size_t h = size() / w;
 	for (size_t x = 0; x < w; x++) {
 		for (size_t y = 0; y < h; y++) {
-			tiles.emplace_back(tile(x, y));
+			states.push_back(_states[y * w + x]);
 		}
 	}
 
-	clear();
-	_tiles.swap(tiles);
-	width(h);
-	_modified = true;
+	_states.swap(states);
+	_usage.build(_states);
+	_width = h;
 }
 
 void Tilemap::clear() {
-	_tiles.clear();
+	_states.clear();
+	_usage.clear();
 	_width = 0;
 	_result = Result::TILEMAP_NULL;
 	_modified = false;
 	_history.clear();
 	_future.clear();
+	_history_bytes = 0;
+	stop_recording();
 }
 
-void Tilemap::reposition_tiles(int x, int y) {
-	int s = TILE_SIZE * Config::zoom();
-	for (Tile_Tessera *tt : _tiles) {
-		int tx = x + (int)tt->col() * s, ty = y + (int)tt->row() * s;
-		tt->resize(tx, ty, s, s);
+void Tilemap::tile(size_t i, const Tile_State &ts) {
+	Tile_State &cur = _states[i];
+	if (cur == ts) { return; }
+	if (_recording) {
+		Tilemap_Edit &edit = _history.back();
+		auto [it, inserted] = _recorded.try_emplace((uint32_t)i, edit.changes.size());
+		if (inserted) {
+			size_t capacity = edit.changes.capacity();
+			edit.changes.push_back({(uint32_t)i, cur, ts});
+			_history_bytes += (edit.changes.capacity() - capacity) * sizeof(Tile_Change);
+			if (_history_bytes > MAX_HISTORY_BYTES) { trim_history(); }
+		}
+		else {
+			edit.changes[it->second].after = ts;
+		}
+	}
+	else {
+		_future.clear();
 	}
+	_usage.update((uint32_t)i, cur, ts);
+	cur = ts;
+}
+
+const Tile_State &Tilemap::previous_state(size_t i) const {
+	if (_recording) {
+		if (auto it = _recorded.find((uint32_t)i); it != _recorded.end()) {
+			return _history.back().changes[it->second].before;
+		}
+	}
+	return _states[i];
+}
+
+void Tilemap::find_tiles(const Tile_State &ts, bool attr, std::vector<uint32_t> &indexes) const {
+	// Attributes are indexed exactly, but tiles only by ID, so their flips still need checking
+	const std::vector<uint32_t> &uses = attr ? _usage.attribute_uses(ts) : _usage.uses(ts.id());
+	indexes.clear();
+	for (uint32_t i : uses) {
+		if (_states[i].same(ts, attr)) { indexes.push_back(i); }
+	}
+	std::sort(indexes.begin(), indexes.end());
 }
 
 void Tilemap::remember() {
+	stop_recording();
 	_future.clear();
-	while (_history.size() >= MAX_HISTORY_SIZE) { _history.pop_front(); }
+	_history.emplace_back();
+	_history_bytes += _history.back().bytes();
+	_recording = true;
+	trim_history();
+}
 
-	size_t n = size();
-	Tilemap_State ts(n);
-	for (size_t i = 0; i < n; i++) {
-		ts.states[i] = _tiles[i]->state();
+Tilemap_Edit &Tilemap::remember_structure(Tilemap_Edit::Kind kind) {
+	stop_recording();
+	_future.clear();
+	_history.emplace_back(kind);
+	_history_bytes += _history.back().bytes();
+	trim_history();
+	return _history.back();
+}
+
+void Tilemap::stop_recording() {
+	// Drop an entry that recorded nothing, such as a click that did not change its tile
+	if (_recording && _history.back().kind == Tilemap_Edit::Kind::TILES && _history.back().changes.empty()) {
+		_history_bytes -= std::min(_history.back().bytes(), _history_bytes);
+		_history.pop_back();
+	}
+	_recording = false;
+	_recorded.clear();
+}
+
+void Tilemap::trim_history() {
+	// The future only holds entries moved out of the history, so it stays within the same limits
+	// Always keep the newest entry, which may still be recording
+	while (_history.size() > 1 && (_history.size() > MAX_HISTORY_SIZE || _history_bytes > MAX_HISTORY_BYTES)) {
+		_history_bytes -= std::min(_history.front().bytes(), _history_bytes);
+		_history.pop_front();
 	}
-	_history.push_back(ts);
 }
 
 void Tilemap::undo() {
+	stop_recording();
 	if (_history.empty()) { return; }
-	while (_future.size() >= MAX_HISTORY_SIZE) { _future.pop_front(); }
-
-	size_t n = size();
-	Tilemap_State ts(n);
-	for (size_t i = 0; i < n; i++) {
-		ts.states[i] = _tiles[i]->state();
-	}
-	_future.push_back(ts);
 
-	const Tilemap_State &prev = _history.back();
-	for (size_t i = 0; i < n; i++) {
-		_tiles[i]->state(prev.states[i]);
+	Tilemap_Edit &edit = _history.back();
+	switch (edit.kind) {
+	case Tilemap_Edit::Kind::RESIZE:
+		unshape(edit);
+		break;
+	case Tilemap_Edit::Kind::SHIFT:
+		shift_states(edit.new_width, -edit.dx, -edit.dy);
+		break;
+	case Tilemap_Edit::Kind::TRANSPOSE:
+		transpose_states(edit.new_width);
+		break;
+	case Tilemap_Edit::Kind::REFORMAT:
+		Config::format(edit.old_format);
+		// fallthrough
+	case Tilemap_Edit::Kind::TILES:
+	default:
+		for (auto it = edit.changes.rbegin(); it != edit.changes.rend(); ++it) {
+			restore_state(it->index, it->before);
+		}
 	}
+	_history_bytes -= std::min(edit.bytes(), _history_bytes);
+	_future.push_back(std::move(edit));
 	_history.pop_back();
 }
 
 void Tilemap::redo() {
+	stop_recording();
 	if (_future.empty()) { return; }
-	while (_history.size() >= MAX_HISTORY_SIZE) { _history.pop_front(); }
-
-	size_t n = size();
-	Tilemap_State ts(n);
-	for (size_t i = 0; i < n; i++) {
-		ts.states[i] = _tiles[i]->state();
-	}
-	_history.push_back(ts);
 
-	const Tilemap_State &next = _future.back();
-	for (size_t i = 0; i < n; i++) {
-		_tiles[i]->state(next.states[i]);
+	Tilemap_Edit &edit = _future.back();
+	switch (edit.kind) {
+	case Tilemap_Edit::Kind::RESIZE:
+		reshape(edit);
+		break;
+	case Tilemap_Edit::Kind::SHIFT:
+		shift_states(edit.old_width, edit.dx, edit.dy);
+		break;
+	case Tilemap_Edit::Kind::TRANSPOSE:
+		transpose_states(edit.old_width);
+		break;
+	case Tilemap_Edit::Kind::REFORMAT:
+		Config::format(edit.new_format);
+		// fallthrough
+	case Tilemap_Edit::Kind::TILES:
+	default:
+		for (const Tile_Change &change : edit.changes) {
+			restore_state(change.index, change.after);
+		}
 	}
+	_history_bytes += edit.bytes();
+	_history.push_back(std::move(edit));
 	_future.pop_back();
+	trim_history();
 }
 
 bool Tilemap::can_format_as(Tilemap_Format fmt) {
 	int n = format_tileset_size(fmt), m = format_palettes_size(fmt);
 	bool can_flip = format_can_flip(fmt), has_priority = format_has_priority(fmt), has_obp1 = format_has_obp1(fmt);
-	return std::all_of(RANGE(_tiles), [&](const Tile_Tessera *tt) {
-		return tt->id() < n && tt->palette() < m
-			&& (can_flip || (!tt->x_flip() && !tt->y_flip()))
-			&& (has_priority || !tt->priority())
-			&& (has_obp1 || !tt->obp1());
-	});
+	// Reduce every tile's word at once: OR together the flags, and take the largest ID and palette + 1
+	uint32_t flags = 0, max_id = 0, max_palette = 0;
+	for (const Tile_State &ts : _states) {
+		uint32_t b = ts.bits();
+		flags |= b;
+		max_id = std::max(max_id, b & Tile_State::ID_MASK);
+		uint32_t has_palette = ((b & Tile_State::NO_PALETTE_BIT) ? 0 : 0xFFFFFFFF);
+		max_palette = std::max(max_palette, (((b & Tile_State::PALETTE_MASK) >> Tile_State::PALETTE_SHIFT) + 1) & has_palette);
+	}
+	uint32_t bad_flags = (can_flip ? 0 : Tile_State::X_FLIP_BIT | Tile_State::Y_FLIP_BIT) |
+		(has_priority ? 0 : Tile_State::PRIORITY_BIT) | (has_obp1 ? 0 : Tile_State::OBP1_BIT);
+	return max_id < (uint32_t)n && max_palette <= (uint32_t)m && !(flags & bad_flags);
 }
 
 void Tilemap::limit_to_format(Tilemap_Format fmt) {
+	Tilemap_Edit &edit = remember_structure(Tilemap_Edit::Kind::REFORMAT);
+	edit.old_format = Config::format();
+	edit.new_format = fmt;
+	_recording = true;
+
 	int n = format_tileset_size(fmt), m = format_palettes_size(fmt);
 	bool can_flip = format_can_flip(fmt), has_priority = format_has_priority(fmt), has_obp1 = format_has_obp1(fmt);
-	for (Tile_Tessera *tt : _tiles) {
-		if (tt->id() >= n) {
-			tt->id((uint16_t)(n - 1));
+	for (size_t i = 0; i < size(); i++) {
+		Tile_State ts = _states[i];
+		if (ts.id() >= n) {
+			ts.id((uint16_t)(n - 1));
 		}
-		if (tt->palette() == -1 && m > 0) {
-			tt->palette(0);
+		if (ts.palette() == -1 && m > 0) {
+			ts.palette(0);
 		}
-		else if (tt->palette() >= m) {
-			tt->palette(m - 1);
+		else if (ts.palette() >= m) {
+			ts.palette(m - 1);
 		}
 		if (!can_flip) {
-			tt->x_flip(false);
-			tt->y_flip(false);
+			ts.x_flip(false);
+			ts.y_flip(false);
 		}
 		if (!has_priority) {
-			tt->priority(false);
+			ts.priority(false);
 		}
 		if (!has_obp1) {
-			tt->obp1(false);
+			ts.obp1(false);
 		}
+		tile(i, ts);
 	}
+
+	stop_recording();
+	Config::format(fmt);
 	_modified = true;
 }
 
 void Tilemap::new_tiles(size_t w, size_t h) {
 	clear();
-	size_t n = w * h;
-	_tiles.reserve(n);
-	for (size_t i = 0; i < n; i++) {
-		_tiles.emplace_back(new Tile_Tessera());
-	}
+	Tile_State blank;
 	if (format_can_edit_palettes(Config::format())) {
-		for (Tile_Tessera *tt : _tiles) {
-			tt->palette(0);
-		}
+		blank.palette(0);
 	}
+	_states.assign(w * h, blank);
+	_usage.build(_states);
 	_width = w;
 	_modified = true;
 }
 
-Tilemap::Result Tilemap::make_tiles(const std::vector<uchar> &tbytes, const std::vector<uchar> &abytes) {
-	size_t c = tbytes.size();
-	if (c == 0) { return (_result = Result::TILEMAP_EMPTY); }
-
-	std::vector<Tile_Tessera *> tiles;
-	size_t width = 0;
-	Tilemap_Format fmt = Config::format();
-
-	if (fmt == Tilemap_Format::PLAIN) {
-		tiles.reserve(c);
-		for (size_t i = 0; i < c; i++) {
-			uint16_t b = tbytes[i];
-			tiles.emplace_back(new Tile_Tessera(0, 0, 0, 0, b));
-		}
-	}
-
-	else if (fmt == Tilemap_Format::GBC_ATTRS) {
-		if (c % 2) { return (_result = Result::TILEMAP_TOO_SHORT_ATTRS); }
-		tiles.reserve(c / 2);
-		for (size_t i = 0; i < c; i += 2) {
-			uint16_t v = tbytes[i];
-			uchar a = tbytes[i+1];
-			if (!!(a & 0x08)) { v |= 0x100; }
-			bool x_flip = !!(a & 0x20), y_flip = !!(a & 0x40), priority = !!(a & 0x80), obp1 = !!(a & 0x10);
-			int palette = a & 0x07;
-			tiles.emplace_back(new Tile_Tessera(0, 0, 0, 0, v, x_flip, y_flip, priority, obp1, palette));
+// Each format's fixed-size entries get their own loop, with the codec's fields known at compile time
+template<Tilemap_Format F>
+static void decode_entries(const uchar *tbytes, const uchar *abytes, size_t n, std::vector<Tile_State> &states) {
+	constexpr const Format_Codec &codec = format_codec(F);
+	states.resize(n);
+	Tile_State *out = states.data();
+	for (size_t i = 0; i < n; i++) {
+		uint16_t entry;
+		if constexpr (codec.entry_bytes == 1) {
+			entry = tbytes[i];
 		}
-	}
-
-	else if (fmt == Tilemap_Format::GBC_ATTRMAP) {
-		size_t ac = abytes.size();
-		if (ac != c) { return (_result = ac < c ? Result::ATTRMAP_TOO_SHORT : Result::ATTRMAP_TOO_LONG); }
-		tiles.reserve(c);
-		for (size_t i = 0; i < c; i++) {
-			uint16_t v = tbytes[i];
-			uchar a = abytes[i];
-			if (!!(a & 0x08)) { v |= 0x100; }
-			bool x_flip = !!(a & 0x20), y_flip = !!(a & 0x40), priority = !!(a & 0x80), obp1 = !!(a & 0x10);
-			int palette = a & 0x07;
-			tiles.emplace_back(new Tile_Tessera(0, 0, 0, 0, v, x_flip, y_flip, priority, obp1, palette));
+		else if constexpr (codec.planar) {
+			entry = (uint16_t)(tbytes[i] | (abytes[i] << 8));
 		}
-	}
-
-	else if (fmt == Tilemap_Format::GBA_4BPP) {
-		if (c % 2) { return (_result = Result::TILEMAP_TOO_SHORT_ATTRS); }
-		tiles.reserve(c / 2);
-		for (size_t i = 0; i < c; i += 2) {
-			uint16_t v = tbytes[i];
-			uchar a = tbytes[i+1];
-			v = v | ((a & 0x03) << 8);
-			bool x_flip = !!(a & 0x04), y_flip = !!(a & 0x08);
-			int palette = HI_NYB(a);
-			tiles.emplace_back(new Tile_Tessera(0, 0, 0, 0, v, x_flip, y_flip, false, false, palette));
+		else {
+			entry = (uint16_t)(tbytes[i * 2] | (tbytes[i * 2 + 1] << 8));
 		}
+		out[i] = Tile_State::from_bits(codec.decode(entry));
 	}
+}
 
-	else if (fmt == Tilemap_Format::GBA_8BPP) {
-		if (c % 2) { return (_result = Result::TILEMAP_TOO_SHORT_ATTRS); }
-		tiles.reserve(c / 2);
-		for (size_t i = 0; i < c; i += 2) {
-			uint16_t v = tbytes[i];
-			uchar a = tbytes[i+1];
-			v = v | ((a & 0x03) << 8);
-			bool x_flip = !!(a & 0x04), y_flip = !!(a & 0x08);
-			tiles.emplace_back(new Tile_Tessera(0, 0, 0, 0, v, x_flip, y_flip, false, false, 0));
-		}
-	}
+typedef void (*Entry_Decoder)(const uchar *tbytes, const uchar *abytes, size_t n, std::vector<Tile_State> &states);
 
-	else if (fmt == Tilemap_Format::NDS_4BPP) {
-		if (c % 2) { return (_result = Result::TILEMAP_TOO_SHORT_ATTRS); }
-		tiles.reserve((c - NDS_HEADER_SIZE) / 2);
-		for (size_t i = NDS_HEADER_SIZE; i < c; i += 2) {
-			uint16_t v = tbytes[i];
-			uchar a = tbytes[i+1];
-			v = v | ((a & 0x03) << 8);
-			bool x_flip = !!(a & 0x04), y_flip = !!(a & 0x08);
-			int palette = HI_NYB(a);
-			tiles.emplace_back(new Tile_Tessera(0, 0, 0, 0, v, x_flip, y_flip, false, false, palette));
-		}
-		width = NDS_WIDTH;
-	}
-
-	else if (fmt == Tilemap_Format::NDS_8BPP) {
-		if (c % 2) { return (_result = Result::TILEMAP_TOO_SHORT_ATTRS); }
-		tiles.reserve((c - NDS_HEADER_SIZE) / 2);
-		for (size_t i = NDS_HEADER_SIZE; i < c; i += 2) {
-			uint16_t v = tbytes[i];
-			uchar a = tbytes[i+1];
-			v = v | ((a & 0x03) << 8);
-			bool x_flip = !!(a & 0x04), y_flip = !!(a & 0x08);
-			tiles.emplace_back(new Tile_Tessera(0, 0, 0, 0, v, x_flip, y_flip, false, false, 0));
-		}
-		width = NDS_WIDTH;
-	}
-
-	else if (fmt == Tilemap_Format::SGB_BORDER) {
-		if (c % 2) { return (_result = Result::TILEMAP_TOO_SHORT_ATTRS); }
-		tiles.reserve(c / 2);
-		for (size_t i = 0; i < c; i += 2) {
-			uint16_t v = tbytes[i];
-			uchar a = tbytes[i+1];
-			bool x_flip = !!(a & 0x40), y_flip = !!(a & 0x80);
-			int palette = (a & 0x0C) >> 2;
-			tiles.emplace_back(new Tile_Tessera(0, 0, 0, 0, v, x_flip, y_flip, false, false, palette));
-		}
-		width = SGB_WIDTH;
-	}
-
-	else if (fmt == Tilemap_Format::SNES_ATTRS) {
-		if (c % 2) { return (_result = Result::TILEMAP_TOO_SHORT_ATTRS); }
-		tiles.reserve(c / 2);
-		for (size_t i = 0; i < c; i += 2) {
-			uint16_t v = tbytes[i];
-			uchar a = tbytes[i+1];
-			v = v | ((a & 0x03) << 8);
-			bool x_flip = !!(a & 0x40), y_flip = !!(a & 0x80), priority = !!(a & 0x20);
-			int palette = (a & 0x1C) >> 2;
-			tiles.emplace_back(new Tile_Tessera(0, 0, 0, 0, v, x_flip, y_flip, priority, false, palette));
-		}
-	}
-
-	else if (fmt == Tilemap_Format::RBY_TOWN_MAP) {
-		tiles.reserve(c);
-		for (size_t i = 0; i < c - 1; i++) {
-			uchar b = tbytes[i];
-			if (b == 0x00) {
-				for (Tile_Tessera *tt : tiles) { delete tt; }
-				return (_result = Result::TILEMAP_TOO_LONG_00);
-			}
-			uint16_t v = HI_NYB(b), r = LO_NYB(b);
-			for (uint16_t j = 0; j < r; j++) {
-				tiles.emplace_back(new Tile_Tessera(0, 0, 0, 0, v));
-			}
-		}
-		if (tbytes[c-1] != 0x00) {
-			for (Tile_Tessera *tt : tiles) { delete tt; }
-			return (_result = Result::TILEMAP_TOO_SHORT_00);
-		}
-		width = GAME_BOY_WIDTH;
-	}
+template<size_t... I>
+static constexpr std::array<Entry_Decoder, NUM_FORMATS> make_entry_decoders(std::index_sequence<I...>) {
+	return {decode_entries<(Tilemap_Format)I>...};
+}
 
-	else if (fmt == Tilemap_Format::GSC_TOWN_MAP) {
-		tiles.reserve(c);
-		for (size_t i = 0; i < c - 1; i++) {
-			uint16_t b = tbytes[i];
-			if (b == 0xFF) {
-				for (Tile_Tessera *tt : tiles) { delete tt; }
-				return (_result = Result::TILEMAP_TOO_LONG_FF);
-			}
-			tiles.emplace_back(new Tile_Tessera(0, 0, 0, 0, b));
-		}
-		if (tbytes[c-1] != 0xFF) {
-			for (Tile_Tessera *tt : tiles) { delete tt; }
-			return (_result = Result::TILEMAP_TOO_SHORT_FF);
-		}
-		width = GAME_BOY_WIDTH;
-	}
+static constexpr std::array<Entry_Decoder, NUM_FORMATS> entry_decoders =
+	make_entry_decoders(std::make_index_sequence<NUM_FORMATS>());
 
-	else if (fmt == Tilemap_Format::PC_TOWN_MAP) {
-		tiles.reserve(c);
-		for (size_t i = 0; i < c - 1; i++) {
-			uchar b = tbytes[i];
-			if (b == 0xFF) {
-				for (Tile_Tessera *tt : tiles) { delete tt; }
-				return (_result = Result::TILEMAP_TOO_LONG_FF);
-			}
-			bool x_flip = !!(b & 0x40), y_flip = !!(b & 0x80);
-			uint16_t v = b & 0x3F;
-			tiles.emplace_back(new Tile_Tessera(0, 0, 0, 0, v, x_flip, y_flip));
-		}
-		if (tbytes[c-1] != 0xFF) {
-			for (Tile_Tessera *tt : tiles) { delete tt; }
-			return (_result = Result::TILEMAP_TOO_SHORT_FF);
-		}
-		width = GAME_BOY_WIDTH;
-	}
+Tilemap::Result Tilemap::make_tiles(const uchar *tbytes, size_t tn, const uchar *abytes, size_t an) {
+	if (tn == 0) { return (_result = Result::TILEMAP_EMPTY); }
 
-	else if (fmt == Tilemap_Format::SW_TOWN_MAP) {
-		tiles.reserve(c);
-		if (!(c % 2)) { return (_result = Result::TILEMAP_TOO_SHORT_00); }
-		for (size_t i = 0; i < c - 1; i += 2) {
-			uint16_t v = tbytes[i];
-			if (v == 0x00) {
-				for (Tile_Tessera *tt : tiles) { delete tt; }
-				return (_result = Result::TILEMAP_TOO_LONG_00);
-			}
-			uint16_t r = tbytes[i+1];
-			if (r == 0x00) {
-				for (Tile_Tessera *tt : tiles) { delete tt; }
-				return (_result = Result::TILEMAP_TOO_LONG_00);
+	std::vector<Tile_State> states;
+	Tilemap_Format fmt = Config::format();
+	const Format_Codec &codec = format_codec(fmt);
+
+	if (codec.terminator != -1) {
+		// The end marker must be the last byte, and cannot appear before it
+		bool ff = codec.terminator == 0xFF;
+		Result too_short = ff ? Result::TILEMAP_TOO_SHORT_FF : Result::TILEMAP_TOO_SHORT_00;
+		Result too_long = ff ? Result::TILEMAP_TOO_LONG_FF : Result::TILEMAP_TOO_LONG_00;
+		uchar end = (uchar)codec.terminator;
+		size_t c = tn - 1;
+		if (codec.rle == Format_Rle::PAIRS && c % 2) { return (_result = too_short); }
+		states.reserve(c);
+		for (size_t i = 0; i < c;) {
+			uchar v = tbytes[i++], r = 1;
+			if (v == end) { return (_result = too_long); }
+			if (codec.rle == Format_Rle::NYBBLES) {
+				r = LO_NYB(v);
+				v = HI_NYB(v);
 			}
-			for (uint16_t j = 0; j < r; j++) {
-				tiles.emplace_back(new Tile_Tessera(0, 0, 0, 0, v));
+			else if (codec.rle == Format_Rle::PAIRS) {
+				r = tbytes[i++];
+				if (r == end) { return (_result = too_long); }
 			}
+			states.insert(states.end(), r, Tile_State::from_bits(codec.decode(v)));
 		}
-		if (tbytes[c-1] != 0x00) {
-			for (Tile_Tessera *tt : tiles) { delete tt; }
-			return (_result = Result::TILEMAP_TOO_SHORT_00);
-		}
-		width = GAME_BOY_WIDTH;
+		if (tbytes[c] != end) { return (_result = too_short); }
 	}
-
-	else if (fmt == Tilemap_Format::POKEGEAR_CARD) {
-		tiles.reserve(c);
-		if (!(c % 2)) { return (_result = Result::TILEMAP_TOO_SHORT_FF); }
-		for (size_t i = 0; i < c - 1; i += 2) {
-			uint16_t v = tbytes[i];
-			if (v == 0xFF) {
-				for (Tile_Tessera *tt : tiles) { delete tt; }
-				return (_result = Result::TILEMAP_TOO_LONG_FF);
-			}
-			uint16_t r = tbytes[i+1];
-			if (r == 0xFF) {
-				for (Tile_Tessera *tt : tiles) { delete tt; }
-				return (_result = Result::TILEMAP_TOO_LONG_FF);
-			}
-			for (uint16_t j = 0; j < r; j++) {
-				tiles.emplace_back(new Tile_Tessera(0, 0, 0, 0, v));
-			}
+	else {
+		size_t c = tn, h = codec.header_size;
+		if (codec.planar) {
+			if (an != c) { return (_result = an < c ? Result::ATTRMAP_TOO_SHORT : Result::ATTRMAP_TOO_LONG); }
 		}
-		if (tbytes[c-1] != 0xFF) {
-			for (Tile_Tessera *tt : tiles) { delete tt; }
-			return (_result = Result::TILEMAP_TOO_SHORT_FF);
+		else if (c % codec.entry_bytes) {
+			return (_result = Result::TILEMAP_TOO_SHORT_ATTRS);
 		}
-		width = GAME_BOY_WIDTH;
+		size_t n = c > h ? (c - h) / (codec.planar ? 1 : codec.entry_bytes) : 0;
+		entry_decoders[(int)fmt](tbytes + h, abytes, n, states);
 	}
 
-	if (tiles.empty()) { return (_result = Result::TILEMAP_EMPTY); }
+	if (states.empty()) { return (_result = Result::TILEMAP_EMPTY); }
 
-	_tiles.swap(tiles);
-	if (width > 0) { _width = width; }
+	_states.swap(states);
+	_usage.build(_states);
+	if (codec.width > 0) { _width = codec.width; }
 	else { guess_width(); }
 
 	return (_result = Result::TILEMAP_OK);
 }
 
-static bool read_file_bytes(const char *f, std::vector<uchar> &bytes) {
-	FILE *file = fl_fopen(f, "rb");
-	if (!file) { return false; }
-	size_t n = file_size(file);
-	bytes.reserve(n);
-	for (int b = fgetc(file); b != EOF; b = fgetc(file)) {
-		bytes.push_back((uchar)b);
-	}
-	fclose(file);
-	return true;
-}
-
 Tilemap::Result Tilemap::read_tiles(const char *tf, const char *af) {
-	std::vector<uchar> tbytes, abytes;
-	if (!read_file_bytes(tf, tbytes)) { return (_result = Result::TILEMAP_BAD_FILE); }
-	if (af && af[0] && !read_file_bytes(af, abytes)) { return (_result = Result::ATTRMAP_BAD_FILE); }
-	return make_tiles(tbytes, abytes);
+	Mapped_File tfile, afile;
+	if (!tfile.open(tf)) { return (_result = Result::TILEMAP_BAD_FILE); }
+	if (af && af[0] && !afile.open(af)) { return (_result = Result::ATTRMAP_BAD_FILE); }
+	return make_tiles(tfile.data(), tfile.size(), afile.data(), afile.size());
 }
 
-bool Tilemap::write_tiles(const char *tf, const char *af, Tilemap_Format fmt) {
-	FILE *file = fl_fopen(tf, "wb");
-	if (!file) { return false; }
+Tilemap::Write_Result Tilemap::write_tiles(const char *tf, const char *af, Tilemap_Format fmt) {
+	bool planar = format_codec(fmt).planar;
+	File_Sink file, attr_file;
+	if (!file.open(tf)) { return Write_Result::WRITE_FAILED; }
+	if (planar && !attr_file.open(af)) { return Write_Result::WRITE_FAILED; }
 
-	std::vector<uchar> bytes = make_tilemap_bytes(_tiles, fmt, width(), height());
-	if (fmt == Tilemap_Format::GBC_ATTRMAP) {
-		FILE *attr_file = fl_fopen(af, "wb");
-		if (!attr_file) { fclose(file); return false; }
-
-		size_t nb = bytes.size() / 2;
-		fwrite(bytes.data(), 1, nb, file);
-		fwrite(bytes.data() + nb, 1, nb, attr_file);
-
-		fclose(attr_file);
-	}
-	else {
-		fwrite(bytes.data(), 1, bytes.size(), file);
+	Tilemap_Encoder encoder(_states, fmt, width(), height());
+	uchar bytes[TILEMAP_CHUNK_SIZE], attrs[TILEMAP_CHUNK_SIZE];
+	while (size_t n = encoder.next(bytes, attrs)) {
+		file.write(bytes, n);
+		if (planar) {
+			attr_file.write(attrs, n);
+		}
 	}
 
-	fclose(file);
-	return true;
+	// Both files are complete before either replaces its destination, so only a failure
+	// between the two renames can leave a new tilemap beside an old attrmap
+	if (!file.finish() || (planar && !attr_file.finish())) { return Write_Result::WRITE_FAILED; }
+	if (!file.commit()) { return Write_Result::WRITE_FAILED; }
+	if (planar && !attr_file.commit()) { return Write_Result::ATTRMAP_NOT_REPLACED; }
+	return Write_Result::WRITE_OK;
 }
 
-bool Tilemap::export_tiles(const char *f) const {
-	FILE *file = fl_fopen(f, "wb");
-	if (!file) { return false; }
+bool Tilemap::export_tiles(const char *f, const Export_Options &options) const {
+	File_Sink sink;
+	if (!sink.open(f)) { return false; }
 
 	Tilemap_Format fmt = Config::format();
-	std::vector<uchar> bytes = make_tilemap_bytes(_tiles, fmt, width(), height());
+	Tilemap_Encoder encoder(_states, fmt, width(), height());
 	if (ends_with_ignore_case(f, ".csv")) {
-		export_csv_tiles(file, bytes, fmt);
+		export_csv_tiles(sink, encoder, fmt, options);
 	}
 	else if (ends_with_ignore_case(f, ".c") || ends_with_ignore_case(f, ".h")) {
-		export_c_tiles(file, bytes, fmt, f);
+		export_c_tiles(sink, encoder, fmt, f, options);
 	}
 	else {
-		export_asm_tiles(file, bytes, fmt, f);
+		export_asm_tiles(sink, encoder, fmt, f, options);
 	}
 
-	fclose(file);
-	return true;
+	return sink.commit();
+}
+
+// Calls f(i, v) for each byte of the tilemap, or of the attrmap if attrs is set,
+// or for each little-endian word of them if words is set
+template<typename F>
+static void each_tilemap_value(Tilemap_Encoder &encoder, bool attrs, bool words, F f) {
+	uchar bytes[TILEMAP_CHUNK_SIZE], attr_bytes[TILEMAP_CHUNK_SIZE];
+	encoder.rewind();
+	size_t i = 0;
+	int low = -1;
+	while (size_t n = encoder.next(bytes, attr_bytes)) {
+		const uchar *chunk = attrs ? attr_bytes : bytes;
+		for (size_t j = 0; j < n; j++) {
+			if (!words) {
+				f(i++, chunk[j]);
+			}
+			else if (low < 0) {
+				low = chunk[j];
+			}
+			else {
+				f(i++, (unsigned int)(low | chunk[j] << 8));
+				low = -1;
+			}
+		}
+	}
 }
 
 static void escape_filename(char *name, size_t len, const char *f) {
@@ -540,93 +544,83 @@ static void escape_filename(char *name, size_t len, const char *f) {
 	}
 }
 
-void Tilemap::export_c_tiles(FILE *file, const std::vector<uchar> &bytes, Tilemap_Format fmt, const char *f) const {
+void Tilemap::export_c_tiles(File_Sink &sink, Tilemap_Encoder &encoder, Tilemap_Format fmt, const char *f,
+	const Export_Options &options) const {
 	char name[FL_PATH_MAX] = {};
 	escape_filename(name, sizeof(name), f);
-	fprintf(file, "/*\n Tilemap: %zu x %zu, %s\n Exported by " PROGRAM_NAME "\n*/\n\n",
+	sink.print("/*\n Tilemap: %zu x %zu, %s\n Exported by " PROGRAM_NAME "\n*/\n\n",
 		width(), height(), format_name(fmt));
-	if (fmt == Tilemap_Format::GBC_ATTRMAP) {
-		size_t nb = bytes.size() / 2;
-		fprintf(file, "unsigned char %s_tilemap[] = {", name);
-		for (size_t i = 0; i < nb; i++) {
-			if (i % 12 == 0) fputs("\n ", file);
-			fprintf(file, " 0x%02x", bytes[i]);
-			if (i < nb - 1) fputc(',', file);
-		}
-		fputs("\n};\n\n", file);
-		fprintf(file, "unsigned char %s_attrmap[] = {", name);
-		for (size_t i = 0; i < nb; i++) {
-			if (i % 12 == 0) fputs("\n ", file);
-			fprintf(file, " 0x%02x", bytes[nb+i]);
-			if (i < nb - 1) fputc(',', file);
-		}
-		fputs("\n};\n\n", file);
-		fprintf(file, "unsigned int %s_len = %zu;\n", name, nb);
-	}
-	else {
-		size_t nb = bytes.size();
-		fprintf(file, "unsigned char %s_tilemap[] = {", name);
-		for (size_t i = 0; i < nb; i++) {
-			if (i % 12 == 0) fputs("\n ", file);
-			fprintf(file, " 0x%02x", bytes[i]);
-			if (i < nb - 1) fputc(',', file);
-		}
-		fputs("\n};\n\n", file);
-		fprintf(file, "unsigned int %s_len = %zu;\n", name, nb);
-	}
+	bool words = options.words && format_can_export_words(fmt);
+	const char *type = words ? "unsigned short" : "unsigned char";
+	int digits = words ? 4 : 2;
+	size_t nb = encoder.size(), nv = words ? nb / 2 : nb;
+	size_t rw = options.values_per_line ? options.values_per_line : 12;
+	auto export_value = [&sink, nv, rw, digits](size_t i, unsigned int v) {
+		if (i % rw == 0) { sink.text("\n "); }
+		sink.text(" 0x");
+		sink.hex(v, digits);
+		if (i < nv - 1) { sink.put(','); }
+	};
+	sink.print("%s %s_tilemap[] = {", type, name);
+	each_tilemap_value(encoder, false, words, export_value);
+	sink.text("\n};\n\n");
+	if (format_codec(fmt).planar) {
+		sink.print("%s %s_attrmap[] = {", type, name);
+		each_tilemap_value(encoder, true, words, export_value);
+		sink.text("\n};\n\n");
+	}
+	sink.print("unsigned int %s_len = %zu;\n", name, nb);
 }
 
-void Tilemap::export_asm_tiles(FILE *file, const std::vector<uchar> &bytes, Tilemap_Format fmt, const char *f) const {
+void Tilemap::export_asm_tiles(File_Sink &sink, Tilemap_Encoder &encoder, Tilemap_Format fmt, const char *f,
+	const Export_Options &options) const {
 	char name[FL_PATH_MAX] = {};
 	escape_filename(name, sizeof(name), f);
-	fprintf(file, "; Tilemap: %zu x %zu, %s\n; Exported by " PROGRAM_NAME "\n\n",
+	sink.print("; Tilemap: %zu x %zu, %s\n; Exported by " PROGRAM_NAME "\n\n",
 		width(), height(), format_name(fmt));
-	size_t rw = width() * format_bytes_per_tile(fmt);
+	bool words = options.words && format_can_export_words(fmt);
+	const char *directive = words ? "\n\tdw" : "\n\tdb";
+	int digits = words ? 4 : 2;
+	size_t nb = encoder.size(), nv = words ? nb / 2 : nb;
+	size_t rw = options.values_per_line ? options.values_per_line : width() * format_bytes_per_tile(fmt) / (words ? 2 : 1);
 	if (rw == 0) { rw = 16; }
-	if (fmt == Tilemap_Format::GBC_ATTRMAP) {
-		size_t nb = bytes.size() / 2;
-		fprintf(file, "%s_Tilemap::", name);
-		for (size_t i = 0; i < nb; i++) {
-			if (i % rw == 0) fputs("\n\tdb", file);
-			fprintf(file, " $%02x", bytes[i]);
-			if (i < nb - 1 && i % rw != rw - 1) fputc(',', file);
-		}
-		fputs("\n.end::\n\n", file);
-		fprintf(file, "%s_Attrmap::", name);
-		for (size_t i = 0; i < nb; i++) {
-			if (i % rw == 0) fputs("\n\tdb", file);
-			fprintf(file, " $%02x", bytes[nb+i]);
-			if (i < nb - 1 && i % rw != rw - 1) fputc(',', file);
-		}
-		fputs("\n.end::\n\n", file);
-		fprintf(file, "%s_LEN EQU %zu\n", name, nb);
+	auto export_value = [&sink, nv, rw, digits, directive](size_t i, unsigned int v) {
+		if (i % rw == 0) { sink.text(directive); }
+		sink.text(" $");
+		sink.hex(v, digits);
+		if (i < nv - 1 && i % rw != rw - 1) { sink.put(','); }
+	};
+	sink.print("%s_Tilemap::", name);
+	each_tilemap_value(encoder, false, words, export_value);
+	if (format_codec(fmt).planar) {
+		sink.text("\n.end::\n\n");
+		sink.print("%s_Attrmap::", name);
+		each_tilemap_value(encoder, true, words, export_value);
+		sink.text("\n.end::\n\n");
 	}
 	else {
-		size_t nb = bytes.size();
-		fprintf(file, "%s_Tilemap::", name);
-		for (size_t i = 0; i < nb; i++) {
-			if (i % rw == 0) fputs("\n\tdb ", file);
-			fprintf(file, " $%02x", bytes[i]);
-			if (i < nb - 1 && i % rw != rw - 1) fputc(',', file);
-		}
-		fputs("\n\n", file);
-		fprintf(file, "%s_LEN EQU %zu\n", name, nb);
+		sink.text("\n\n");
 	}
+	sink.print("%s_LEN EQU %zu\n", name, nb);
 }
 
-void Tilemap::export_csv_tiles(FILE *file, const std::vector<uchar> &bytes, Tilemap_Format fmt) const {
-	size_t rw = width() * format_bytes_per_tile(fmt);
-	size_t nb = bytes.size();
-	for (size_t i = 0; i < nb; i++) {
-		fprintf(file, "%d", bytes[i]);
-		fputc(i < nb - 1 && (rw == 0 || i % rw != rw - 1) ? ',' : '\n', file);
-	}
+void Tilemap::export_csv_tiles(File_Sink &sink, Tilemap_Encoder &encoder, Tilemap_Format fmt,
+	const Export_Options &options) const {
+	bool words = options.words && format_can_export_words(fmt);
+	size_t nb = encoder.size(), nv = words ? nb / 2 : nb;
+	size_t rw = options.values_per_line ? options.values_per_line : width() * format_bytes_per_tile(fmt) / (words ? 2 : 1);
+	each_tilemap_value(encoder, false, words, [&sink, nv, rw](size_t i, unsigned int v) {
+		sink.dec(v);
+		sink.put(i < nv - 1 && (rw == 0 || i % rw != rw - 1) ? ',' : '\n');
+	});
 }
 
 void Tilemap::print_tilemap() const {
-	for (Tile_Tessera *tt : _tiles) {
-		int dx = (int)tt->col() * TILE_SIZE, dy = (int)tt->row() * TILE_SIZE;
-		tt->print(dx, dy, true, false);
+	size_t n = size();
+	for (size_t i = 0; i < n; i++) {
+		const Tile_State &ts = _states[i];
+		int dx = (int)(i % _width) * TILE_SIZE, dy = (int)(i / _width) * TILE_SIZE;
+		ts.print(dx, dy, true, false, ts.palette());
 	}
 }
 
@@ -658,6 +652,18 @@ void Tilemap::guess_width() {
 #undef N_FITS_SIZE
 }
 
+std::string Tilemap::write_error_message(Write_Result result, const char *tf, const char *af) {
+	std::string msg = "Could not write to ";
+	if (result == Write_Result::ATTRMAP_NOT_REPLACED) {
+		const char *tilemap_basename = fl_filename_name(tf);
+		msg = msg + fl_filename_name(af) + "!\n\n" + tilemap_basename + " was saved, so it no longer matches its attrmap.";
+	}
+	else {
+		msg = msg + fl_filename_name(tf) + "!";
+	}
+	return msg;
+}
+
 const char *Tilemap::error_message(Result result) {
 	switch (result) {
 	case Result::TILEMAP_OK:
@@ -4,18 +4,54 @@
 #include <cstdio>
 #include <deque>
 #include <vector>
+#include <unordered_map>
 
 #include "config.h"
 #include "utils.h"
 #include "tile-buttons.h"
+#include "tilemap-format.h"
+#include "tile-usage.h"
 
-#define MAX_HISTORY_SIZE 100
+class File_Sink;
 
-struct Tilemap_State {
-	std::vector<Tile_State> states;
-	Tilemap_State() : states() {}
-	Tilemap_State(size_t n) : states(n) {}
-	inline const Tile_State &state(size_t i) const { return states[i]; }
+#define MAX_HISTORY_SIZE 10000
+#define MAX_HISTORY_BYTES (64 * 1024 * 1024)
+
+// How exported text lays out values; zero values per line keeps each language's default
+struct Export_Options {
+	bool words;
+	size_t values_per_line;
+};
+
+// How imported text is read: words makes each CSV or C value a 16-bit entry, and
+// those and dw or .word values are little-endian unless big_endian is set
+struct Import_Options {
+	bool words;
+	bool big_endian;
+};
+
+struct Tile_Change {
+	uint32_t index;
+	Tile_State before, after;
+};
+
+// One undoable step: the tiles it changed, and for structural operations, how the map was reshaped
+struct Tilemap_Edit {
+	enum class Kind { TILES, RESIZE, SHIFT, TRANSPOSE, REFORMAT };
+	Kind kind;
+	std::vector<Tile_Change> changes;
+	// Tiles cut off by a resize, in their old order; created tiles are all blank
+	std::vector<Tile_State> lost;
+	// Widths and sizes before and after the step, and the offset of a resize or shift
+	size_t old_width, old_size, new_width, new_size;
+	int dx, dy;
+	Tile_State blank;
+	Tilemap_Format old_format, new_format;
+	inline Tilemap_Edit(Kind k = Kind::TILES) : kind(k), changes(), lost(), old_width(0), old_size(0), new_width(0),
+		new_size(0), dx(0), dy(0), blank(), old_format(), new_format() {}
+	inline size_t bytes(void) const {
+		return sizeof(*this) + changes.capacity() * sizeof(Tile_Change) + lost.capacity() * sizeof(Tile_State);
+	}
 };
 
 class Tilemap {
@@ -23,34 +59,50 @@ public:
 	enum class Result { TILEMAP_OK, TILEMAP_BAD_FILE, TILEMAP_EMPTY, TILEMAP_TOO_SHORT_FF, TILEMAP_TOO_LONG_FF,
 		TILEMAP_TOO_SHORT_00, TILEMAP_TOO_LONG_00, TILEMAP_TOO_SHORT_RLE, TILEMAP_TOO_SHORT_ATTRS, TILEMAP_INVALID,
 		TILEMAP_NULL, ATTRMAP_BAD_FILE, ATTRMAP_TOO_SHORT, ATTRMAP_TOO_LONG, ATTRMAP_INVALID };
+	// ATTRMAP_NOT_REPLACED means the tilemap was saved but its attrmap was not, so they no longer match
+	enum class Write_Result { WRITE_OK, WRITE_FAILED, ATTRMAP_NOT_REPLACED };
 private:
-	std::vector<Tile_Tessera *> _tiles;
+	// Tile states in row-major order; the widgets that show them belong to the main window
+	std::vector<Tile_State> _states;
+	Tile_Usage _usage;
 	size_t _width;
 	Result _result;
+	// Where an imported text file could not be parsed, or 0 if it was not
+	size_t _error_line, _error_column;
 	bool _modified;
-	std::deque<Tilemap_State> _history, _future;
+	std::deque<Tilemap_Edit> _history, _future;
+	size_t _history_bytes;
+	// Whether tile changes are recorded into the last history entry, and where each changed tile is in it
+	bool _recording;
+	std::unordered_map<uint32_t, size_t> _recorded;
 public:
 	Tilemap();
 	~Tilemap();
-	inline size_t size(void) const { return _tiles.size(); }
+	inline size_t size(void) const { return _states.size(); }
 	inline size_t width(void) const { return _width; }
-	void width(size_t w);
+	inline void width(size_t w) { _width = w; }
 	void resize(size_t w, size_t h, int px, int py);
 	void shift(int dx, int dy);
 	void transpose(void);
 	inline bool is_rectangular(void) const { return size() % _width == 0; }
 	inline size_t height(void) const { return _width ? (size() + _width - 1) / _width : 0; }
-	inline Tile_Tessera *tile(size_t x, size_t y) const { return tile(y * _width + x); }
-	inline Tile_Tessera *tile(size_t i) const { return i < _tiles.size() ? _tiles[i] : NULL; }
-	inline void tile(size_t x, size_t y, Tile_Tessera *tt) { _tiles[y * _width + x] = tt; }
+	inline const std::vector<Tile_State> &states(void) const { return _states; }
+	inline const Tile_State &state(size_t i) const { return _states[i]; }
+	inline const Tile_State &state(size_t x, size_t y) const { return _states[y * _width + x]; }
+	inline bool has_tile(size_t x, size_t y) const { return x < _width && y * _width + x < size(); }
+	inline void tile(size_t x, size_t y, const Tile_State &ts) { tile(y * _width + x, ts); }
+	void tile(size_t i, const Tile_State &ts);
+	const Tile_State &previous_state(size_t i) const;
+	inline const Tile_Usage &usage(void) const { return _usage; }
+	void find_tiles(const Tile_State &ts, bool attr, std::vector<uint32_t> &indexes) const;
 	inline Result result(void) const { return _result; }
+	inline size_t error_line(void) const { return _error_line; }
+	inline size_t error_column(void) const { return _error_column; }
 	inline bool modified(void) const { return _modified; }
 	inline void modified(bool m) { _modified = m; }
 	inline bool can_undo(void) const { return !_history.empty(); }
 	inline bool can_redo(void) const { return !_future.empty(); }
-	inline const Tilemap_State &last_state(void) const { return _history.back(); }
 	void clear();
-	void reposition_tiles(int x, int y);
 	void remember(void);
 	void undo(void);
 	void redo(void);
@@ -58,18 +110,33 @@ public:
 	void limit_to_format(Tilemap_Format fmt);
 	void new_tiles(size_t w, size_t h);
 	Result read_tiles(const char *tf, const char *af);
-	bool write_tiles(const char *tf, const char *af, Tilemap_Format fmt);
-	Result import_tiles(const char *tf, const char *af);
-	bool export_tiles(const char *f) const;
+	Write_Result write_tiles(const char *tf, const char *af, Tilemap_Format fmt);
+	Result import_tiles(const char *tf, const char *af, const Import_Options &options);
+	bool export_tiles(const char *f, const Export_Options &options) const;
 	void print_tilemap(void) const;
 	void guess_width(void);
 private:
-	Result make_tiles(const std::vector<uchar> &tbytes, const std::vector<uchar> &abytes);
-	void export_c_tiles(FILE *file, const std::vector<uchar> &bytes, Tilemap_Format fmt, const char *f) const;
-	void export_asm_tiles(FILE *file, const std::vector<uchar> &bytes, Tilemap_Format fmt, const char *f) const;
-	void export_csv_tiles(FILE *file, const std::vector<uchar> &bytes, Tilemap_Format fmt) const;
+	Result make_tiles(const uchar *tbytes, size_t tn, const uchar *abytes, size_t an);
+	inline void restore_state(size_t i, const Tile_State &ts) {
+		_usage.update((uint32_t)i, _states[i], ts);
+		_states[i] = ts;
+	}
+	Tilemap_Edit &remember_structure(Tilemap_Edit::Kind kind);
+	void stop_recording(void);
+	void trim_history(void);
+	void reshape(const Tilemap_Edit &edit);
+	void unshape(const Tilemap_Edit &edit);
+	void shift_states(size_t w, int dx, int dy);
+	void transpose_states(size_t w);
+	void export_c_tiles(File_Sink &sink, Tilemap_Encoder &encoder, Tilemap_Format fmt, const char *f,
+		const Export_Options &options) const;
+	void export_asm_tiles(File_Sink &sink, Tilemap_Encoder &encoder, Tilemap_Format fmt, const char *f,
+		const Export_Options &options) const;
+	void export_csv_tiles(File_Sink &sink, Tilemap_Encoder &encoder, Tilemap_Format fmt,
+		const Export_Options &options) const;
 public:
 	static const char *error_message(Result result);
+	static std::string write_error_message(Write_Result result, const char *tf, const char *af);
 };
 
 #endif
@@ -1,5 +1,6 @@
 #include <array>
 #include <vector>
+#include <cstring>
 
 #pragma warning(push, 0)
 #include <FL/fl_types.h>
@@ -7,27 +8,24 @@
 #include <FL/Fl_PNG_Image.H>
 #include <FL/Fl_GIF_Image.H>
 #include <FL/Fl_BMP_Image.H>
-#include <FL/Fl_Image_Surface.H>
 #include <FL/fl_draw.H>
 #pragma warning(pop)
 
 #include "utils.h"
 #include "tileset.h"
 #include "tile-buttons.h"
+#include "tile-cache.h"
+#include "mapped-file.h"
 #include "config.h"
 
-Tileset::Tileset(int start_id, int offset, int length) : _1x_image(NULL), _2x_image(NULL), _zoomed_image(NULL),
-	_num_tiles(0), _start_id(start_id), _offset(offset), _length(length), _result(Result::TILESET_NULL) {}
+Tileset::Tileset(int start_id, int offset, int length) : _1x_image(NULL), _num_tiles(0), _start_id(start_id), _offset(offset), _length(length), _result(Result::TILESET_NULL) {}
 
 Tileset::~Tileset() {}
 
 void Tileset::clear() {
+	Tile_Cache::purge(_1x_image);
 	delete _1x_image;
 	_1x_image = NULL;
-	delete _2x_image;
-	_2x_image = NULL;
-	delete _zoomed_image;
-	_zoomed_image = NULL;
 	_num_tiles = 0;
 	_start_id = 0x000;
 	_offset = 0;
@@ -35,69 +33,31 @@ void Tileset::clear() {
 	_result = Result::TILESET_NULL;
 }
 
-void Tileset::update_zoom() {
-	if (!_1x_image) { return; }
-	int z = Config::zoom();
-	_zoomed_image = (Fl_RGB_Image *)_1x_image->copy(_1x_image->w() * z, _1x_image->h() * z);
-}
-
 void Tileset::shift(int dn) {
 	_start_id += dn;
 }
 
-bool Tileset::draw_tile(const Tile_State *ts, int x, int y, int z, bool active) const {
-	int index = (int)ts->id - _start_id + _offset;
+int Tileset::end_id() const {
+	if (!_1x_image) { return _start_id; }
 	int limit = (int)_num_tiles;
 	if (_length > 0) { limit = std::min(limit, _length + _offset); }
-	if (index < _offset || index >= limit || !_2x_image || !_zoomed_image) { return false; }
+	return _start_id + std::max(limit - _offset, 0);
+}
 
-	int s = TILE_SIZE * z;
+bool Tileset::draw_tile(int index, const Tile_State *ts, int x, int y, int z, bool active) const {
 	if (!active) {
+		int s = TILE_SIZE * z;
 		fl_rectf(x, y, s, s, FL_INACTIVE_COLOR);
 		return true;
 	}
 
-	if (z == DEFAULT_ZOOM) {
-		int wt = _2x_image->w() / TILE_SIZE_2X;
-		int tx = index % wt * TILE_SIZE_2X, ty = index / wt * TILE_SIZE_2X;
-		if (!ts->x_flip && !ts->y_flip) {
-			_2x_image->draw(x, y, TILE_SIZE_2X, TILE_SIZE_2X, tx, ty);
-		}
-		else {
-			const uchar *data = (const uchar *)_2x_image->data()[0];
-			int d = _2x_image->d(), ld = _2x_image->ld();
-			if (!ld) { ld = _2x_image->w() * d; }
-			data += ty * ld + tx * d + (ts->y_flip ? ts->x_flip ? ld + d : ld : ts->x_flip ? d : 0) * (TILE_SIZE_2X - 1);
-			int td = ts->x_flip ? -d : d;
-			int tld = ts->y_flip ? -ld : ld;
-			fl_draw_image(data, x, y, TILE_SIZE_2X, TILE_SIZE_2X, td, tld);
-		}
-	}
-	else {
-		int wt = _zoomed_image->w() / s;
-		int tx = index % wt * s, ty = index / wt * s;
-		if (!ts->x_flip && !ts->y_flip) {
-			_zoomed_image->draw(x, y, s, s, tx, ty);
-		}
-		else {
-			const uchar *data = (const uchar *)_zoomed_image->data()[0];
-			int d = _zoomed_image->d(), ld = _zoomed_image->ld();
-			if (!ld) { ld = _zoomed_image->w() * d; }
-			data += ty * ld + tx * d + (ts->y_flip ? ts->x_flip ? ld + d : ld : ts->x_flip ? d : 0) * (s - 1);
-			int td = ts->x_flip ? -d : d;
-			int tld = ts->y_flip ? -ld : ld;
-			fl_draw_image(data, x, y, s, s, td, tld);
-		}
-	}
+	Fl_RGB_Image *img = Tile_Cache::tile(_1x_image, index, z, ts->x_flip(), ts->y_flip());
+	if (!img) { return false; }
+	img->draw(x, y);
 	return true;
 }
 
-bool Tileset::print_tile(const Tile_State *ts, int x, int y, bool active) const {
-	int index = (int)ts->id - _start_id + _offset;
-	int limit = (int)_num_tiles;
-	if (_length > 0) { limit = std::min(limit, _length + _offset); }
-	if (index < _offset || index >= limit || !_1x_image) { return false; }
-
+bool Tileset::print_tile(int index, const Tile_State *ts, int x, int y, bool active) const {
 	if (!active) {
 		fl_rectf(x, y, TILE_SIZE, TILE_SIZE, FL_INACTIVE_COLOR);
 		return true;
@@ -106,18 +66,13 @@ bool Tileset::print_tile(const Tile_State *ts, int x, int y, bool active) const
 	int wt = _1x_image->w() / TILE_SIZE;
 	int tx = index % wt * TILE_SIZE, ty = index / wt * TILE_SIZE;
 
-	if (!ts->x_flip && !ts->y_flip) {
-		_1x_image->draw(x, y, TILE_SIZE, TILE_SIZE, tx, ty);
-	}
-	else {
-		const uchar *data = (const uchar *)_1x_image->data()[0];
-		int d = _1x_image->d(), ld = _1x_image->ld();
-		if (!ld) { ld = _1x_image->w() * d; }
-		data += ty * ld + tx * d + (ts->y_flip ? ts->x_flip ? ld + d : ld : ts->x_flip ? d : 0) * (TILE_SIZE - 1);
-		int td = ts->x_flip ? -d : d;
-		int tld = ts->y_flip ? -ld : ld;
-		fl_draw_image(data, x, y, TILE_SIZE, TILE_SIZE, td, tld);
+	// Flipped tiles come from a copy of the whole tileset with each tile flipped in place
+	Fl_RGB_Image *img = _1x_image;
+	if (ts->x_flip() || ts->y_flip()) {
+		img = Tile_Cache::flipped(_1x_image, ts->x_flip(), ts->y_flip());
+		if (!img) { return false; }
 	}
+	img->draw(x, y, TILE_SIZE, TILE_SIZE, tx, ty);
 	return true;
 }
 
@@ -157,240 +112,199 @@ Tileset::Result Tileset::read_bmp_graphics(const char *f) {
 }
 
 Tileset::Result Tileset::read_1bpp_graphics(const char *f) {
-	FILE *file = fl_fopen(f, "rb");
-	if (!file) { return (_result = Result::TILESET_BAD_FILE); }
-
-	size_t n = file_size(file);
-	if (n % BYTES_PER_1BPP_TILE) { fclose(file); return (_result = Result::TILESET_BAD_DIMS); }
-
-	std::vector<uchar> data(n);
-	size_t r = fread(data.data(), 1, n, file);
-	fclose(file);
-	if (r != n) { return (_result = Result::TILESET_BAD_FILE); }
-
-	return parse_1bpp_data(data);
+	Mapped_File file;
+	if (!file.open(f)) { return (_result = Result::TILESET_BAD_FILE); }
+	if (file.size() % BYTES_PER_1BPP_TILE) { return (_result = Result::TILESET_BAD_DIMS); }
+	return parse_1bpp_data(file.data(), file.size());
 }
 
 Tileset::Result Tileset::read_2bpp_graphics(const char *f) {
-	FILE *file = fl_fopen(f, "rb");
-	if (!file) { return (_result = Result::TILESET_BAD_FILE); }
-
-	size_t n = file_size(file);
-	if (n % BYTES_PER_2BPP_TILE) { fclose(file); return (_result = Result::TILESET_BAD_DIMS); }
-
-	std::vector<uchar> data(n);
-	size_t r = fread(data.data(), 1, n, file);
-	fclose(file);
-	if (r != n) { return (_result = Result::TILESET_BAD_FILE); }
-
-	return parse_2bpp_data(data);
+	Mapped_File file;
+	if (!file.open(f)) { return (_result = Result::TILESET_BAD_FILE); }
+	if (file.size() % BYTES_PER_2BPP_TILE) { return (_result = Result::TILESET_BAD_DIMS); }
+	return parse_2bpp_data(file.data(), file.size());
 }
 
 Tileset::Result Tileset::read_4bpp_graphics(const char *f) {
-	FILE *file = fl_fopen(f, "rb");
-	if (!file) { return (_result = Result::TILESET_BAD_FILE); }
-
-	size_t n = file_size(file);
-	if (n % BYTES_PER_4BPP_TILE) { fclose(file); return (_result = Result::TILESET_BAD_DIMS); }
-
-	std::vector<uchar> data(n);
-	size_t r = fread(data.data(), 1, n, file);
-	fclose(file);
-	if (r != n) { return (_result = Result::TILESET_BAD_FILE); }
-
-	return parse_4bpp_data(data);
+	Mapped_File file;
+	if (!file.open(f)) { return (_result = Result::TILESET_BAD_FILE); }
+	if (file.size() % BYTES_PER_4BPP_TILE) { return (_result = Result::TILESET_BAD_DIMS); }
+	return parse_4bpp_data(file.data(), file.size());
 }
 
 Tileset::Result Tileset::read_8bpp_graphics(const char *f) {
-	FILE *file = fl_fopen(f, "rb");
-	if (!file) { return (_result = Result::TILESET_BAD_FILE); }
-
-	size_t n = file_size(file);
-	if (n % BYTES_PER_8BPP_TILE) { fclose(file); return (_result = Result::TILESET_BAD_DIMS); }
-
-	std::vector<uchar> data(n);
-	size_t r = fread(data.data(), 1, n, file);
-	fclose(file);
-	if (r != n) { return (_result = Result::TILESET_BAD_FILE); }
-
-	return parse_8bpp_data(data);
+	Mapped_File file;
+	if (!file.open(f)) { return (_result = Result::TILESET_BAD_FILE); }
+	if (file.size() % BYTES_PER_8BPP_TILE) { return (_result = Result::TILESET_BAD_DIMS); }
+	return parse_8bpp_data(file.data(), file.size());
 }
 
 static Tileset::Result decompress_lz_data(const char *f, std::vector<uchar> &data);
 
 Tileset::Result Tileset::read_1bpp_lz_graphics(const char *f) {
 	std::vector<uchar> data(MAX_NUM_TILES * BYTES_PER_1BPP_TILE);
-	if (decompress_lz_data(f, data) != Result::TILESET_OK) {
+	if ((_result = decompress_lz_data(f, data)) != Result::TILESET_OK) {
 		return _result;
 	}
-	return parse_1bpp_data(data);
+	return parse_1bpp_data(data.data(), data.size());
 }
 
 Tileset::Result Tileset::read_2bpp_lz_graphics(const char *f) {
 	std::vector<uchar> data(MAX_NUM_TILES * BYTES_PER_2BPP_TILE);
-	if (decompress_lz_data(f, data) != Result::TILESET_OK) {
+	if ((_result = decompress_lz_data(f, data)) != Result::TILESET_OK) {
 		return _result;
 	}
-	return parse_2bpp_data(data);
+	return parse_2bpp_data(data.data(), data.size());
 }
 
-enum class Hue { WHITE, DARK, LIGHT, BLACK };
-
-static Fl_Color hue_colors[NUM_HUES] = {fl_rgb_color(0xFF), fl_rgb_color(0x55), fl_rgb_color(0xAA), fl_rgb_color(0x00)};
+// Tiles are decoded straight into one gray byte per pixel, then spread into an RGB image.
+// The tileset image is one tile wide, so each decoded row of TILE_SIZE pixels follows the last.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TILESET_DECODE_SSE2
+#include <emmintrin.h>
+#endif
+
+#define ROW_MASK_55 0x5555555555555555ULL
+#define ROW_MASK_AA 0xAAAAAAAAAAAAAAAAULL
+
+// Each byte spread into a row of TILE_SIZE bytes, 0xFF for each set bit, leftmost pixel (bit 7) first
+static const std::array<uint64_t, 256> &bit_row_masks() {
+	static const std::array<uint64_t, 256> masks = []() {
+		std::array<uint64_t, 256> m = {};
+		for (int b = 0; b < 256; b++) {
+			uchar row[TILE_SIZE];
+			for (int i = 0; i < TILE_SIZE; i++) {
+				row[i] = (b >> (TILE_SIZE - i - 1) & 1) ? 0xFF : 0x00;
+			}
+			memcpy(&m[b], row, sizeof(row));
+		}
+		return m;
+	}();
+	return masks;
+}
 
-static void convert_1bpp_row(uchar b, Hue *row) {
-	// %ABCD_EFGH -> %A %B %C %D %E %F %G %H
-	for (int i = 0; i < TILE_SIZE; i++) {
-		int j = TILE_SIZE - i - 1;
-		row[i] = (b >> j & 1) ? Hue::BLACK : Hue::WHITE;
+static void decode_1bpp_rows(const uchar *data, size_t nr, uchar *gray) {
+	// %ABCD_EFGH -> %A %B %C %D %E %F %G %H; set bits are black
+	const std::array<uint64_t, 256> &masks = bit_row_masks();
+	for (size_t r = 0; r < nr; r++) {
+		uint64_t row = ~masks[data[r]];
+		memcpy(gray + r * TILE_SIZE, &row, sizeof(row));
 	}
 }
 
-static void convert_2bpp_row(uchar b1, uchar b2, Hue *row) {
-	// %ABCD_EFGH %abcd_efgh -> %Aa %Bb %Cc %Dd %Ee %Ff %GG %Hh
-	for (int i = 0; i < TILE_SIZE; i++) {
-		int j = TILE_SIZE - i - 1;
-		row[i] = (Hue)((b1 >> j & 1) * 2 + (b2 >> j & 1));
+static void decode_2bpp_rows(const uchar *data, size_t nr, uchar *gray) {
+	// %ABCD_EFGH %abcd_efgh -> %Aa %Bb %Cc %Dd %Ee %Ff %Gg %Hh; 0 = 0xFF, 1 = 0x55, 2 = 0xAA, 3 = 0x00
+	const std::array<uint64_t, 256> &masks = bit_row_masks();
+	for (size_t r = 0; r < nr; r++) {
+		uint64_t row = ~((masks[data[r * 2]] & ROW_MASK_55) | (masks[data[r * 2 + 1]] & ROW_MASK_AA));
+		memcpy(gray + r * TILE_SIZE, &row, sizeof(row));
 	}
 }
 
-Tileset::Result Tileset::parse_1bpp_data(const std::vector<uchar> &data) {
-	_num_tiles = data.size() / BYTES_PER_1BPP_TILE;
-
-	int limit = (int)_num_tiles - _offset;
-	if (_length > 0) { limit = std::min(limit, _length + _offset); }
-	if (_start_id + limit > MAX_NUM_TILES) { return (_result = Result::TILESET_TOO_LARGE); }
-
-	Fl_Image_Surface *surface = new Fl_Image_Surface(TILE_SIZE, (int)_num_tiles * TILE_SIZE);
-	surface->set_current();
-
-	Hue row[TILE_SIZE] = {};
-	for (size_t i = 0; i < _num_tiles; i++) {
-		for (size_t j = 0; j < TILE_SIZE; j++) {
-			uchar b = data[i * BYTES_PER_1BPP_TILE + j];
-			convert_1bpp_row(b, row);
-			for (int k = 0; k < TILE_SIZE; k++) {
-				Hue hue = row[k];
-				fl_color(hue_colors[(int)hue]);
-				fl_point(k, (int)(i * TILE_SIZE + j));
-			}
-		}
+static void decode_4bpp_rows(const uchar *data, size_t nr, uchar *gray) {
+	// Each byte is two pixels, low nybble first; nybble n is shade 0xFF - n * 0x11
+	size_t n = nr * TILE_SIZE / 2, i = 0;
+#ifdef TILESET_DECODE_SSE2
+	const __m128i lo_mask = _mm_set1_epi8(0x0F), ones = _mm_set1_epi8((char)0xFF);
+	for (; i + 16 <= n; i += 16) {
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+		__m128i lo = _mm_and_si128(b, lo_mask);
+		__m128i hi = _mm_and_si128(_mm_srli_epi16(b, 4), lo_mask);
+		__m128i p1 = _mm_unpacklo_epi8(lo, hi), p2 = _mm_unpackhi_epi8(lo, hi);
+		p1 = _mm_or_si128(p1, _mm_slli_epi16(p1, 4));
+		p2 = _mm_or_si128(p2, _mm_slli_epi16(p2, 4));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(gray + i * 2), _mm_xor_si128(p1, ones));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(gray + i * 2 + 16), _mm_xor_si128(p2, ones));
+	}
+#endif
+	for (; i < n; i++) {
+		uchar b = data[i];
+		gray[i * 2] = (uchar)~(LO_NYB(b) << 4 | LO_NYB(b));
+		gray[i * 2 + 1] = (uchar)~(HI_NYB(b) << 4 | HI_NYB(b));
 	}
+}
 
-	Fl_RGB_Image *img = surface->image();
-	delete surface;
-	Fl_Display_Device::display_device()->set_current();
+static void decode_8bpp_rows(const uchar *data, size_t nr, uchar *gray) {
+	// Each byte is one pixel; byte b is shade 0xFF - b
+	for (size_t i = 0, n = nr * TILE_SIZE; i < n; i++) {
+		gray[i] = (uchar)~data[i];
+	}
+}
 
-	return postprocess_graphics(img);
+static Fl_RGB_Image *gray_tiles_image(const std::vector<uchar> &gray, size_t nt) {
+	size_t n = nt * NUM_TILE_PIXELS;
+	uchar *bytes = new uchar[n * 3];
+	for (size_t i = 0; i < n; i++) {
+		bytes[i * 3] = bytes[i * 3 + 1] = bytes[i * 3 + 2] = gray[i];
+	}
+	Fl_RGB_Image *img = new Fl_RGB_Image(bytes, TILE_SIZE, (int)nt * TILE_SIZE, 3);
+	img->alloc_array = 1;
+	return img;
 }
 
-Tileset::Result Tileset::parse_2bpp_data(const std::vector<uchar> &data) {
-	_num_tiles = data.size() / BYTES_PER_2BPP_TILE;
+Tileset::Result Tileset::parse_1bpp_data(const uchar *data, size_t n) {
+	_num_tiles = n / BYTES_PER_1BPP_TILE;
 
 	int limit = (int)_num_tiles - _offset;
 	if (_length > 0) { limit = std::min(limit, _length + _offset); }
 	if (_start_id + limit > MAX_NUM_TILES) { return (_result = Result::TILESET_TOO_LARGE); }
 
-	Fl_Image_Surface *surface = new Fl_Image_Surface(TILE_SIZE, (int)_num_tiles * TILE_SIZE);
-	surface->set_current();
-
-	Hue row[TILE_SIZE] = {};
-	for (size_t i = 0; i < _num_tiles; i++) {
-		for (size_t j = 0; j < TILE_SIZE; j++) {
-			uchar b1 = data[i * BYTES_PER_2BPP_TILE + j * 2];
-			uchar b2 = data[i * BYTES_PER_2BPP_TILE + j * 2 + 1];
-			convert_2bpp_row(b1, b2, row);
-			for (int k = 0; k < TILE_SIZE; k++) {
-				Hue hue = row[k];
-				fl_color(hue_colors[(int)hue]);
-				fl_point(k, (int)(i * TILE_SIZE + j));
-			}
-		}
-	}
-
-	Fl_RGB_Image *img = surface->image();
-	delete surface;
-	Fl_Display_Device::display_device()->set_current();
-
-	return postprocess_graphics(img);
+	std::vector<uchar> gray(_num_tiles * NUM_TILE_PIXELS);
+	decode_1bpp_rows(data, _num_tiles * TILE_SIZE, gray.data());
+	return postprocess_graphics(gray_tiles_image(gray, _num_tiles));
 }
 
-static Fl_Color bpp4_colors[16] = {
-	fl_rgb_color(0xFF), fl_rgb_color(0xEE), fl_rgb_color(0xDD), fl_rgb_color(0xCC),
-	fl_rgb_color(0xBB), fl_rgb_color(0xAA), fl_rgb_color(0x99), fl_rgb_color(0x88),
-	fl_rgb_color(0x77), fl_rgb_color(0x66), fl_rgb_color(0x55), fl_rgb_color(0x44),
-	fl_rgb_color(0x33), fl_rgb_color(0x22), fl_rgb_color(0x11), fl_rgb_color(0x00)
-};
-
-Tileset::Result Tileset::parse_4bpp_data(const std::vector<uchar> &data) {
-	_num_tiles = data.size() / BYTES_PER_4BPP_TILE;
+Tileset::Result Tileset::parse_2bpp_data(const uchar *data, size_t n) {
+	_num_tiles = n / BYTES_PER_2BPP_TILE;
 
 	int limit = (int)_num_tiles - _offset;
 	if (_length > 0) { limit = std::min(limit, _length + _offset); }
 	if (_start_id + limit > MAX_NUM_TILES) { return (_result = Result::TILESET_TOO_LARGE); }
 
-	Fl_Image_Surface *surface = new Fl_Image_Surface(TILE_SIZE, (int)_num_tiles * TILE_SIZE);
-	surface->set_current();
-
-	for (size_t i = 0; i < _num_tiles; i++) {
-		for (size_t j = 0; j < TILE_SIZE; j++) {
-			int py = (int)(i * TILE_SIZE + j);
-			for (int k = 0; k < TILE_SIZE / 2; k++) {
-				uchar b = data[i * BYTES_PER_4BPP_TILE + j * TILE_SIZE / 2 + k];
-				fl_color(bpp4_colors[LO_NYB(b)]);
-				fl_point(k * 2, py);
-				fl_color(bpp4_colors[HI_NYB(b)]);
-				fl_point(k * 2 + 1, py);
-			}
-		}
-	}
-
-	Fl_RGB_Image *img = surface->image();
-	delete surface;
-	Fl_Display_Device::display_device()->set_current();
-
-	return postprocess_graphics(img);
+	std::vector<uchar> gray(_num_tiles * NUM_TILE_PIXELS);
+	decode_2bpp_rows(data, _num_tiles * TILE_SIZE, gray.data());
+	return postprocess_graphics(gray_tiles_image(gray, _num_tiles));
 }
 
-Tileset::Result Tileset::parse_8bpp_data(const std::vector<uchar> &data) {
-	_num_tiles = data.size() / BYTES_PER_8BPP_TILE;
+Tileset::Result Tileset::parse_4bpp_data(const uchar *data, size_t n) {
+	_num_tiles = n / BYTES_PER_4BPP_TILE;
 
 	int limit = (int)_num_tiles - _offset;
 	if (_length > 0) { limit = std::min(limit, _length + _offset); }
 	if (_start_id + limit > MAX_NUM_TILES) { return (_result = Result::TILESET_TOO_LARGE); }
 
-	Fl_Image_Surface *surface = new Fl_Image_Surface(TILE_SIZE, (int)_num_tiles * TILE_SIZE);
-	surface->set_current();
+	std::vector<uchar> gray(_num_tiles * NUM_TILE_PIXELS);
+	decode_4bpp_rows(data, _num_tiles * TILE_SIZE, gray.data());
+	return postprocess_graphics(gray_tiles_image(gray, _num_tiles));
+}
 
-	for (size_t i = 0; i < _num_tiles; i++) {
-		for (size_t j = 0; j < TILE_SIZE; j++) {
-			int py = (int)(i * TILE_SIZE + j);
-			for (int k = 0; k < TILE_SIZE; k++) {
-				uchar b = data[i * BYTES_PER_8BPP_TILE + j * TILE_SIZE + k];
-				fl_color(0xFF-b, 0xFF-b, 0xFF-b);
-				fl_point(k, py);
-			}
-		}
-	}
+Tileset::Result Tileset::parse_8bpp_data(const uchar *data, size_t n) {
+	_num_tiles = n / BYTES_PER_8BPP_TILE;
 
-	Fl_RGB_Image *img = surface->image();
-	delete surface;
-	Fl_Display_Device::display_device()->set_current();
+	int limit = (int)_num_tiles - _offset;
+	if (_length > 0) { limit = std::min(limit, _length + _offset); }
+	if (_start_id + limit > MAX_NUM_TILES) { return (_result = Result::TILESET_TOO_LARGE); }
 
-	return postprocess_graphics(img);
+	std::vector<uchar> gray(_num_tiles * NUM_TILE_PIXELS);
+	decode_8bpp_rows(data, _num_tiles * TILE_SIZE, gray.data());
+	return postprocess_graphics(gray_tiles_image(gray, _num_tiles));
 }
 
 Tileset::Result Tileset::read_rgcn_graphics(const char *f) {
-	FILE *file = fl_fopen(f, "rb");
-	if (!file) { return (_result = Result::TILESET_BAD_FILE); }
+	Mapped_File file;
+	if (!file.open(f)) { return (_result = Result::TILESET_BAD_FILE); }
 
 	// <https://www.romhacking.net/documents/%5B469%5Dnds_formats.htm#NCGR>
 	// <https://github.com/pleonex/tinke/blob/master/Plugins/Images/Images/NCGR.cs>
-	fseek(file, 16 + 4 + 4, SEEK_CUR); // skip generic header, "RAHC", sub-section size
+	size_t p = 16 + 4 + 4; // skip generic header, "RAHC", sub-section size
+	if (file.size() < p + 2 + 2 + 1) { return (_result = Result::TILESET_BAD_FILE); }
 
-	uint16_t th = read_uint16(file);
-	uint16_t tw = read_uint16(file);
-	int depth = fgetc(file);
+	const uchar *header = file.data() + p;
+	uint16_t th = (uint16_t)(header[0] | (header[1] << 8));
+	uint16_t tw = (uint16_t)(header[2] | (header[3] << 8));
+	int depth = header[4];
+	p += 2 + 2 + 1;
 
 	// Not all possible depth values can go with tilemaps
 	// <https://github.com/pleonex/tinke/blob/master/Ekona/Images/Actions.cs#:~:text=ColorFormat>
@@ -399,18 +313,16 @@ Tileset::Result Tileset::read_rgcn_graphics(const char *f) {
 	else if (depth == 2) { bpp = BYTES_PER_2BPP_TILE; }
 	else if (depth == 3) { bpp = BYTES_PER_4BPP_TILE; }
 	else if (depth == 4) { bpp = BYTES_PER_8BPP_TILE; }
-	else { fclose(file); return (_result = Result::TILESET_BAD_FILE); }
+	else { return (_result = Result::TILESET_BAD_FILE); }
 
-	fseek(file, 3 + 4 + 4 + 4 + 4, SEEK_CUR); // skip padding, tile form flag, tile data size, padding
+	p += 3 + 4 + 4 + 4 + 4; // skip padding, tile form flag, tile data size, padding
 
 	size_t n = tw * th * bpp;
-	std::vector<uchar> data(n);
-	size_t r = fread(data.data(), 1, n, file);
-	fclose(file);
-	if (r != n) { return (_result = Result::TILESET_BAD_FILE); }
+	if (file.size() < p + n) { return (_result = Result::TILESET_BAD_FILE); }
 
-	return bpp == BYTES_PER_2BPP_TILE ? parse_2bpp_data(data) : bpp == BYTES_PER_4BPP_TILE ? parse_4bpp_data(data) :
-		bpp == BYTES_PER_8BPP_TILE ? parse_8bpp_data(data) : parse_1bpp_data(data);
+	const uchar *data = file.data() + p;
+	return bpp == BYTES_PER_2BPP_TILE ? parse_2bpp_data(data, n) : bpp == BYTES_PER_4BPP_TILE ? parse_4bpp_data(data, n) :
+		bpp == BYTES_PER_8BPP_TILE ? parse_8bpp_data(data, n) : parse_1bpp_data(data, n);
 }
 
 Tileset::Result Tileset::read_rts_graphics(const char *f, bool skip_rmp) {
@@ -458,10 +370,6 @@ Tileset::Result Tileset::postprocess_graphics(Fl_RGB_Image *img) {
 	if (!img || img->fail()) { return (_result = Result::TILESET_BAD_FILE); }
 
 	_1x_image = img;
-	_2x_image = (Fl_RGB_Image *)img->copy(img->w() * DEFAULT_ZOOM, img->h() * DEFAULT_ZOOM);
-	if (!_2x_image || _2x_image->fail()) { clear(); return (_result = Result::TILESET_BAD_FILE); }
-	update_zoom();
-	if (!_zoomed_image || _zoomed_image->fail()) { clear(); return (_result = Result::TILESET_BAD_FILE); }
 
 	int w = _1x_image->w(), h = _1x_image->h();
 	if (w % TILE_SIZE || h % TILE_SIZE) { clear(); return (_result = Result::TILESET_BAD_DIMS); }
@@ -533,51 +441,57 @@ static auto bit_flipped = ([]() constexpr {
 })();
 
 static Tileset::Result decompress_lz_data(const char *f, std::vector<uchar> &data) {
-	FILE *file = fl_fopen(f, "rb");
-	if (!file) { return Tileset::Result::TILESET_BAD_FILE; }
-
-	size_t n = file_size(file);
-	std::vector<uchar> lz_data(n);
-	size_t r = fread(lz_data.data(), 1, n, file);
-	fclose(file);
-	if (r != n) { return Tileset::Result::TILESET_BAD_FILE; }
+	Mapped_File file;
+	if (!file.open(f)) { return Tileset::Result::TILESET_BAD_FILE; }
+
+	// The input may be mapped, so never read past its end; running out of bytes means it was truncated
+	const uchar *lz_data = file.data();
+	size_t n = file.size(), address = 0;
+	bool truncated = false;
+	auto next = [&]() -> uchar {
+		if (address < n) { return lz_data[address++]; }
+		truncated = true;
+		return LZ_END;
+	};
 
 	size_t len = 0;
-	for (size_t address = 0, lim = data.size();;) {
+	for (size_t lim = data.size();;) {
 		uchar q[2];
 		int offset;
-		uchar b = lz_data[address++];
+		uchar b = next();
+		if (truncated) { return Tileset::Result::TILESET_TOO_SHORT; }
 		if (b == LZ_END) { break; }
-		if (len >= lim) { return Tileset::Result::TILESET_TOO_LARGE; }
 		Lz_Command cmd = (Lz_Command)((b & 0xe0) >> 5);
 		int length = 0;
 		if (cmd == Lz_Command::LZ_LONG) {
 			cmd = (Lz_Command)((b & 0x1c) >> 2);
 			length = (int)(b & 0x03) * 0x100;
-			b = lz_data[address++];
+			b = next();
 			length += (int)b + 1;
 		}
 		else {
 			length = (int)(b & 0x1f) + 1;
 		}
+		if (truncated) { return Tileset::Result::TILESET_TOO_SHORT; }
+		if (len + (size_t)length > lim) { return Tileset::Result::TILESET_TOO_LARGE; }
 		switch (cmd) {
 		case Lz_Command::LZ_LITERAL:
 			// Copy data directly.
 			for (int i = 0; i < length; i++) {
-				data[len++] = lz_data[address++];
+				data[len++] = next();
 			}
 			break;
 		case Lz_Command::LZ_ITERATE:
 			// Write one byte repeatedly.
-			b = lz_data[address++];
+			b = next();
 			for (int i = 0; i < length; i++) {
 				data[len++] = b;
 			}
 			break;
 		case Lz_Command::LZ_ALTERNATE:
 			// Write alternating bytes.
-			q[0] = lz_data[address++];
-			q[1] = lz_data[address++];
+			q[0] = next();
+			q[1] = next();
 			// Copy data directly.
 			for (int i = 0; i < length; i++) {
 				data[len++] = q[i & 1];
@@ -591,16 +505,21 @@ static Tileset::Result decompress_lz_data(const char *f, std::vector<uchar> &dat
 			break;
 		case Lz_Command::LZ_REPEAT:
 			// Repeat bytes from output.
-			b = lz_data[address++];
-			offset = b >= 0x80 ? (int)len - (int)(b & 0x7f) - 1 : (int)b * 0x100 + lz_data[address++];
+			b = next();
+			offset = b >= 0x80 ? (int)len - (int)(b & 0x7f) - 1 : (int)b * 0x100 + next();
+			if (truncated) { return Tileset::Result::TILESET_TOO_SHORT; }
+			// The copy may overlap its own output, so each byte read has already been written
+			if (offset < 0 || offset >= (int)len) { return Tileset::Result::TILESET_BAD_CMD; }
 			for (int i = 0; i < length; i++) {
 				data[len++] = data[offset + i];
 			}
 			break;
 		case Lz_Command::LZ_FLIP:
 			// Repeat flipped bytes from output.
-			b = lz_data[address++];
-			offset = b >= 0x80 ? (int)len - (int)(b & 0x7f) - 1 : (int)b * 0x100 + lz_data[address++];
+			b = next();
+			offset = b >= 0x80 ? (int)len - (int)(b & 0x7f) - 1 : (int)b * 0x100 + next();
+			if (truncated) { return Tileset::Result::TILESET_TOO_SHORT; }
+			if (offset < 0 || offset >= (int)len) { return Tileset::Result::TILESET_BAD_CMD; }
 			for (int i = 0; i < length; i++) {
 				b = data[offset + i];
 				data[len++] = bit_flipped[b];
@@ -608,8 +527,10 @@ static Tileset::Result decompress_lz_data(const char *f, std::vector<uchar> &dat
 			break;
 		case Lz_Command::LZ_REVERSE:
 			// Repeat reversed bytes from output.
-			b = lz_data[address++];
-			offset = b >= 0x80 ? (int)len - (int)(b & 0x7f) - 1 : (int)b * 0x100 + lz_data[address++];
+			b = next();
+			offset = b >= 0x80 ? (int)len - (int)(b & 0x7f) - 1 : (int)b * 0x100 + next();
+			if (truncated) { return Tileset::Result::TILESET_TOO_SHORT; }
+			if (offset >= (int)len || offset - length + 1 < 0) { return Tileset::Result::TILESET_BAD_CMD; }
 			for (int i = 0; i < length; i++) {
 				data[len++] = data[offset - i];
 			}
@@ -618,6 +539,7 @@ static Tileset::Result decompress_lz_data(const char *f, std::vector<uchar> &dat
 		default:
 			return Tileset::Result::TILESET_BAD_CMD;
 		}
+		if (truncated) { return Tileset::Result::TILESET_TOO_SHORT; }
 	}
 
 	data.resize(len);
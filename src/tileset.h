@@ -10,7 +10,6 @@
 #include "utils.h"
 #include "tile.h"
 
-#define NUM_HUES 4
 #define BYTES_PER_1BPP_TILE (NUM_TILE_PIXELS / 8)
 #define BYTES_PER_2BPP_TILE (BYTES_PER_1BPP_TILE * 2)
 #define BYTES_PER_4BPP_TILE (BYTES_PER_1BPP_TILE * 4)
@@ -29,7 +28,7 @@ public:
 	enum class Result { TILESET_OK, TILESET_BAD_FILE, TILESET_BAD_EXT, TILESET_BAD_DIMS,
 		TILESET_TOO_SHORT, TILESET_TOO_LARGE, TILESET_BAD_CMD, TILESET_NULL };
 private:
-	Fl_RGB_Image *_1x_image, *_2x_image, *_zoomed_image;
+	Fl_RGB_Image *_1x_image;
 	size_t _num_tiles;
 	int _start_id, _offset, _length;
 	Result _result;
@@ -41,11 +40,13 @@ public:
 	inline int offset(void) const { return _offset; }
 	inline int length(void) const { return _length; }
 	inline Result result(void) const { return _result; }
+	// Tile IDs from start_id() up to but not including end_id() are drawn by this tileset
+	int end_id(void) const;
+	inline int tile_index(uint16_t id) const { return (int)id - _start_id + _offset; }
 	void clear(void);
-	void update_zoom(void);
 	void shift(int dn);
-	bool draw_tile(const Tile_State *ts, int x, int y, int z, bool active) const;
-	bool print_tile(const Tile_State *ts, int x, int y, bool active) const;
+	bool draw_tile(int index, const Tile_State *ts, int x, int y, int z, bool active) const;
+	bool print_tile(int index, const Tile_State *ts, int x, int y, bool active) const;
 	Result read_tiles(const char *f);
 private:
 	Result read_png_graphics(const char *f);
@@ -59,10 +60,10 @@ private:
 	Result read_2bpp_lz_graphics(const char *f);
 	Result read_rgcn_graphics(const char *f);
 	Result read_rts_graphics(const char *f, bool skip_rmp);
-	Result parse_1bpp_data(const std::vector<uchar> &data);
-	Result parse_2bpp_data(const std::vector<uchar> &data);
-	Result parse_4bpp_data(const std::vector<uchar> &data);
-	Result parse_8bpp_data(const std::vector<uchar> &data);
+	Result parse_1bpp_data(const uchar *data, size_t n);
+	Result parse_2bpp_data(const uchar *data, size_t n);
+	Result parse_4bpp_data(const uchar *data, size_t n);
+	Result parse_8bpp_data(const uchar *data, size_t n);
 	Result postprocess_graphics(Fl_RGB_Image *img);
 public:
 	static const char *error_message(Result result);
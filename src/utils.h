@@ -10,6 +10,8 @@
 #include <string_view>
 #include <algorithm>
 #include <fstream>
+#include <thread>
+#include <vector>
 
 #pragma warning(push, 0)
 #include <FL/fl_types.h>
@@ -80,4 +82,29 @@ bool check_read(FILE *file, uchar *expected, size_t n);
 uint16_t read_uint16(FILE *file);
 size_t read_rmp_size(FILE *file);
 
+// How many worker threads to split n items across, with at least min_chunk items each
+// and at most max_workers threads, or one per core if max_workers is 0
+inline size_t num_workers(size_t n, size_t min_chunk, size_t max_workers = 0) {
+	size_t nc = max_workers ? max_workers : (size_t)std::max(std::thread::hardware_concurrency(), 1U);
+	return std::max(std::min(nc, n / std::max(min_chunk, (size_t)1)), (size_t)1);
+}
+
+// Call f(worker, begin, end) on nw contiguous ranges of [0, n), one per thread
+template<typename F>
+void parallel_for(size_t nw, size_t n, F f) {
+	if (nw < 2) {
+		f((size_t)0, (size_t)0, n);
+		return;
+	}
+	std::vector<std::thread> workers;
+	workers.reserve(nw - 1);
+	for (size_t w = 1; w < nw; w++) {
+		workers.emplace_back(f, w, n * w / nw, n * (w + 1) / nw);
+	}
+	f((size_t)0, (size_t)0, n / nw);
+	for (std::thread &t : workers) {
+		t.join();
+	}
+}
+
 #endif